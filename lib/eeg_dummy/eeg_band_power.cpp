@@ -0,0 +1,171 @@
+#include "eeg_band_power.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "eeg_signal_generator.h"
+
+namespace
+{
+
+// α / β の既定帯域 (ALPHA_FREQ_HZ / BETA_FREQ_HZ を含む)
+constexpr BandEdges DEFAULT_BANDS[] = {{8, 12}, {13, 30}};
+constexpr float BAND_POWER_DB_SCALE = 256.0f;
+
+} // namespace
+
+bool BandPowerEstimator::configure(uint8_t rateHz, uint8_t channelMask, const BandEdges *bands, size_t bandCount)
+{
+    rateHz_ = 0;
+    if (rateHz == 0 || rateHz > BAND_POWER_MAX_RATE_HZ || SAMPLE_RATE_HZ % rateHz != 0 || channelMask == 0 ||
+        bandCount > BAND_POWER_MAX_BANDS)
+    {
+        return false;
+    }
+    if (bandCount == 0)
+    {
+        bands = DEFAULT_BANDS;
+        bandCount = sizeof(DEFAULT_BANDS) / sizeof(DEFAULT_BANDS[0]);
+    }
+
+    // 各帯域に入る rateHz 間隔のビンを並べる。帯域がビン間に収まる場合は中心に最も近いビンを 1 つ
+    size_t binCount = 0;
+    uint8_t binBand[BAND_POWER_MAX_BINS];
+    uint32_t binK[BAND_POWER_MAX_BINS];
+    const uint32_t nyquistBin = SAMPLE_RATE_HZ / 2 / rateHz;
+    for (size_t b = 0; b < bandCount; ++b)
+    {
+        if (bands[b].loHz > bands[b].hiHz || bands[b].hiHz * 2 >= SAMPLE_RATE_HZ)
+        {
+            return false;
+        }
+        uint32_t first = (bands[b].loHz + rateHz - 1) / rateHz;
+        uint32_t last = bands[b].hiHz / rateHz;
+        if (first > last)
+        {
+            first = last = (bands[b].loHz + bands[b].hiHz + rateHz) / (2 * rateHz);
+        }
+        for (uint32_t k = first; k <= last && k < nyquistBin; ++k)
+        {
+            if (binCount == BAND_POWER_MAX_BINS)
+            {
+                return false;
+            }
+            binBand[binCount] = static_cast<uint8_t>(b);
+            binK[binCount] = k;
+            binCount++;
+        }
+    }
+
+    channelMask_ = channelMask;
+    channels_ = 0;
+    for (uint8_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        if (channelMask & (1u << ch))
+        {
+            channelIndex_[channels_++] = ch;
+        }
+    }
+    blockSamples_ = SAMPLE_RATE_HZ / rateHz;
+    float windowEnergy = 0.0f;
+    for (size_t n = 0; n < blockSamples_; ++n)
+    {
+        // 周期的 Hann (ブロックを並べたときに継ぎ目が揃う)
+        window_[n] = 0.5f - 0.5f * cosf(2.0f * EEG_PI * n / blockSamples_);
+        windowEnergy += window_[n] * window_[n];
+    }
+    normalise_ = 2.0f / (blockSamples_ * windowEnergy);
+    for (size_t i = 0; i < binCount; ++i)
+    {
+        binBand_[i] = binBand[i];
+        binCoeff_[i] = 2.0f * cosf(2.0f * EEG_PI * binK[i] / blockSamples_);
+    }
+    binCount_ = binCount;
+    memcpy(bands_, bands, bandCount * sizeof(BandEdges));
+    bandCount_ = bandCount;
+    rateHz_ = rateHz;
+
+    packet_.packet_type = PKT_TYPE_BAND_POWER;
+    packet_.rate_hz = rateHz;
+    packet_.channel_mask = channelMask;
+    packet_.num_bands = static_cast<uint8_t>(bandCount);
+    memset(packet_.band_edges, 0, sizeof(packet_.band_edges));
+    for (size_t b = 0; b < bandCount; ++b)
+    {
+        packet_.band_edges[b * 2] = bands[b].loHz;
+        packet_.band_edges[b * 2 + 1] = bands[b].hiHz;
+    }
+    reset();
+    return true;
+}
+
+void BandPowerEstimator::reset()
+{
+    memset(s1_, 0, sizeof(s1_));
+    memset(s2_, 0, sizeof(s2_));
+    phase_ = 0;
+    blockIndex_ = 0;
+}
+
+bool BandPowerEstimator::push(const int16_t *signals)
+{
+    if (rateHz_ == 0)
+    {
+        return false;
+    }
+    float x[CH_MAX];
+    const float w = window_[phase_];
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        x[c] = w * signals[channelIndex_[c]];
+    }
+    for (size_t i = 0; i < binCount_; ++i)
+    {
+        const float coeff = binCoeff_[i];
+        float *s1 = s1_[i];
+        float *s2 = s2_[i];
+        for (size_t c = 0; c < channels_; ++c)
+        {
+            const float s0 = x[c] + coeff * s1[c] - s2[c];
+            s2[c] = s1[c];
+            s1[c] = s0;
+        }
+    }
+    if (++phase_ < blockSamples_)
+    {
+        return false;
+    }
+    finishBlock();
+    return true;
+}
+
+void BandPowerEstimator::finishBlock()
+{
+    float power[BAND_POWER_MAX_BANDS][CH_MAX] = {};
+    for (size_t i = 0; i < binCount_; ++i)
+    {
+        const float coeff = binCoeff_[i];
+        float *band = power[binBand_[i]];
+        for (size_t c = 0; c < channels_; ++c)
+        {
+            const float a = s1_[i][c];
+            const float b = s2_[i][c];
+            band[c] += a * a + b * b - coeff * a * b;
+        }
+    }
+    memset(s1_, 0, sizeof(s1_));
+    memset(s2_, 0, sizeof(s2_));
+    phase_ = 0;
+
+    size_t v = 0;
+    for (size_t b = 0; b < bandCount_; ++b)
+    {
+        for (size_t c = 0; c < channels_; ++c)
+        {
+            const float p = power[b][c] * normalise_;
+            const float q = p > 0.0f ? 10.0f * log10f(p) * BAND_POWER_DB_SCALE : -32768.0f;
+            packet_.power[v++] = static_cast<int16_t>(q >= 32767.0f ? 32767 : (q <= -32768.0f ? -32768 : lrintf(q)));
+        }
+    }
+    packet_.block_index = blockIndex_++;
+}
@@ -0,0 +1,67 @@
+// 帯域パワーの特徴量 (ブロック Goertzel, サンプルごとに逐次更新)
+//
+// 1/rate_hz 秒のブロックに Hann 窓を掛け、帯域内の rate_hz 間隔の各ビンを Goertzel で求める。
+// ブロックの終わりで |X_k|^2 を Parseval で平均二乗に正規化して帯域ごとに足し、dB (Q8) で出す。
+// 生サンプルの代わりにこれだけを送れば、2 帯域 x 8ch を 2Hz で約 90 B/s (生データは約 5 KB/s)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+
+constexpr size_t BAND_POWER_MAX_BINS = 32;     // 全帯域の合計ビン数 (チャンネルあたり)
+constexpr uint8_t BAND_POWER_MAX_RATE_HZ = 10; // ブロック 25 サンプル
+constexpr size_t BAND_POWER_MAX_BLOCK = SAMPLE_RATE_HZ;
+
+struct BandEdges
+{
+    uint8_t loHz;
+    uint8_t hiHz;
+};
+
+class BandPowerEstimator
+{
+public:
+    // rateHz は SAMPLE_RATE_HZ を割り切る 1..10、帯域は lo <= hi < ナイキスト。
+    // bandCount == 0 なら α (8-12Hz) / β (13-30Hz)。不正なら false で無効のまま
+    bool configure(uint8_t rateHz, uint8_t channelMask, const BandEdges *bands, size_t bandCount);
+    void disable() { rateHz_ = 0; }
+    void reset();
+
+    // 1 サンプル入力する。ブロックが終わったら packet() を更新して true
+    bool push(const int16_t *signals);
+
+    bool enabled() const { return rateHz_ != 0; }
+    uint8_t rateHz() const { return rateHz_; }
+    size_t channels() const { return channels_; }
+    size_t bands() const { return bandCount_; }
+    size_t bins() const { return binCount_; }
+    const BandPowerPacket &packet() const { return packet_; }
+    size_t packetSize() const { return BAND_POWER_PACKET_HEADER_BYTES + bandCount_ * channels_ * sizeof(int16_t); }
+
+private:
+    void finishBlock();
+
+    uint8_t rateHz_ = 0;
+    uint8_t channelMask_ = 0;
+    uint8_t channelIndex_[CH_MAX] = {};
+    size_t channels_ = 0;
+    size_t blockSamples_ = 0;
+    size_t phase_ = 0;
+    uint16_t blockIndex_ = 0;
+
+    BandEdges bands_[BAND_POWER_MAX_BANDS] = {};
+    size_t bandCount_ = 0;
+    uint8_t binBand_[BAND_POWER_MAX_BINS] = {}; // ビン → 帯域
+    float binCoeff_[BAND_POWER_MAX_BINS] = {};  // 2cos(2πk/N)
+    size_t binCount_ = 0;
+    float window_[BAND_POWER_MAX_BLOCK] = {};
+    float normalise_ = 0.0f; // 2 / (N Σw^2)
+
+    // Goertzel 状態はビンごとにチャンネルを並べる
+    float s1_[BAND_POWER_MAX_BINS][CH_MAX] = {};
+    float s2_[BAND_POWER_MAX_BINS][CH_MAX] = {};
+
+    BandPowerPacket packet_{};
+};
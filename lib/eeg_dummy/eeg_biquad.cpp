@@ -0,0 +1,148 @@
+#include "eeg_biquad.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+
+constexpr double BIQUAD_PI = 3.14159265358979323846;
+constexpr double BUTTERWORTH_Q = 0.70710678118654752;
+
+int32_t toQ30(double v)
+{
+    const double scaled = v * (1 << BIQUAD_COEFF_FRAC_BITS);
+    if (scaled >= 2147483647.0)
+    {
+        return 2147483647;
+    }
+    if (scaled <= -2147483648.0)
+    {
+        return static_cast<int32_t>(-2147483647 - 1);
+    }
+    return static_cast<int32_t>(llround(scaled));
+}
+
+BiquadCoeffs normalise(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    BiquadCoeffs c;
+    c.b0 = toQ30(b0 / a0);
+    c.b1 = toQ30(b1 / a0);
+    c.b2 = toQ30(b2 / a0);
+    c.a1 = toQ30(a1 / a0);
+    c.a2 = toQ30(a2 / a0);
+    return c;
+}
+
+int32_t saturate32(int64_t v)
+{
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : static_cast<int32_t>(v));
+}
+
+} // namespace
+
+BiquadCoeffs BiquadChain::notch(double freqHz, double q, double sampleRateHz)
+{
+    const double w0 = 2.0 * BIQUAD_PI * freqHz / sampleRateHz;
+    const double alpha = sin(w0) / (2.0 * q);
+    return normalise(1.0, -2.0 * cos(w0), 1.0, 1.0 + alpha, -2.0 * cos(w0), 1.0 - alpha);
+}
+
+BiquadCoeffs BiquadChain::highpass(double freqHz, double sampleRateHz)
+{
+    const double w0 = 2.0 * BIQUAD_PI * freqHz / sampleRateHz;
+    const double alpha = sin(w0) / (2.0 * BUTTERWORTH_Q);
+    const double c = cos(w0);
+    return normalise((1.0 + c) * 0.5, -(1.0 + c), (1.0 + c) * 0.5, 1.0 + alpha, -2.0 * c, 1.0 - alpha);
+}
+
+BiquadCoeffs BiquadChain::lowpass(double freqHz, double sampleRateHz)
+{
+    const double w0 = 2.0 * BIQUAD_PI * freqHz / sampleRateHz;
+    const double alpha = sin(w0) / (2.0 * BUTTERWORTH_Q);
+    const double c = cos(w0);
+    return normalise((1.0 - c) * 0.5, 1.0 - c, (1.0 - c) * 0.5, 1.0 + alpha, -2.0 * c, 1.0 - alpha);
+}
+
+bool BiquadChain::configure(const FilterSpec &spec)
+{
+    const double nyquist = SAMPLE_RATE_HZ * 0.5;
+    if (spec.notchHz >= nyquist || spec.highpassCentiHz >= nyquist * 100.0 || spec.lowpassHz >= nyquist)
+    {
+        return false;
+    }
+    BiquadCoeffs coeffs[BIQUAD_MAX_STAGES];
+    size_t n = 0;
+    if (spec.notchHz > 0)
+    {
+        coeffs[n++] = notch(spec.notchHz, BIQUAD_NOTCH_Q);
+        if (spec.notchHarmonics >= 2 && spec.notchHz * 2 < nyquist)
+        {
+            coeffs[n++] = notch(spec.notchHz * 2.0, BIQUAD_NOTCH_Q);
+        }
+    }
+    if (spec.highpassCentiHz > 0)
+    {
+        coeffs[n++] = highpass(spec.highpassCentiHz / 100.0);
+    }
+    if (spec.lowpassHz > 0)
+    {
+        coeffs[n++] = lowpass(spec.lowpassHz);
+    }
+    spec_ = spec;
+    memcpy(coeffs_, coeffs, n * sizeof(BiquadCoeffs));
+    stages_ = n;
+    reset();
+    return true;
+}
+
+void BiquadChain::reset()
+{
+    memset(x1_, 0, sizeof(x1_));
+    memset(x2_, 0, sizeof(x2_));
+    memset(y1_, 0, sizeof(y1_));
+    memset(y2_, 0, sizeof(y2_));
+    memset(error_, 0, sizeof(error_));
+}
+
+void BiquadChain::process(int16_t *signals)
+{
+    // int16 → Q31 (上位 16bit)
+    int32_t x[CH_MAX];
+    for (size_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        x[ch] = static_cast<int32_t>(signals[ch]) * 65536;
+    }
+
+    constexpr int64_t FRAC_MASK = (int64_t(1) << BIQUAD_COEFF_FRAC_BITS) - 1;
+    for (size_t s = 0; s < stages_; ++s)
+    {
+        const BiquadCoeffs c = coeffs_[s];
+        int32_t *x1 = x1_[s];
+        int32_t *x2 = x2_[s];
+        int32_t *y1 = y1_[s];
+        int32_t *y2 = y2_[s];
+        int32_t *err = error_[s];
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            int64_t acc = static_cast<int64_t>(c.b0) * x[ch] + static_cast<int64_t>(c.b1) * x1[ch] +
+                          static_cast<int64_t>(c.b2) * x2[ch] - static_cast<int64_t>(c.a1) * y1[ch] -
+                          static_cast<int64_t>(c.a2) * y2[ch] + err[ch];
+            // 誤差帰還: 切り捨てた下位ビット (常に 0 以上) を次回へ
+            err[ch] = static_cast<int32_t>(acc & FRAC_MASK);
+            const int32_t y = saturate32(acc >> BIQUAD_COEFF_FRAC_BITS);
+            x2[ch] = x1[ch];
+            x1[ch] = x[ch];
+            y2[ch] = y1[ch];
+            y1[ch] = y;
+            x[ch] = y;
+        }
+    }
+
+    // Q31 → int16 (四捨五入 + 飽和)
+    for (size_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        const int32_t rounded = static_cast<int32_t>((static_cast<int64_t>(x[ch]) + 32768) >> 16);
+        signals[ch] = static_cast<int16_t>(rounded > 32767 ? 32767 : (rounded < -32768 ? -32768 : rounded));
+    }
+}
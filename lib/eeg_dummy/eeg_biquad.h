@@ -0,0 +1,68 @@
+// デバイス側フィルタ: 固定小数点 (Q31) の双二次 (biquad) カスケード
+//
+// 直接形 I + 誤差帰還 (1 次のノイズシェーピング)。係数は Q30 で持ち ([-2, 2) を表せる)、
+// 積和は 64bit、出力で落とした下位ビットを次のサンプルの積和に足し戻す。
+// 状態はチャンネル方向に並べた配列 (SoA) で持ち、内側のループを全チャンネルで回すので
+// ホストではコンパイラがベクトル化できる。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+
+constexpr size_t BIQUAD_MAX_STAGES = 4; // ノッチ x2 (基本波 + 第 2 高調波) + ハイパス + ローパス
+constexpr int BIQUAD_COEFF_FRAC_BITS = 30;
+constexpr double BIQUAD_NOTCH_Q = 25.0;
+
+// y = b0 x0 + b1 x1 + b2 x2 - a1 y1 - a2 y2 (Q30)
+struct BiquadCoeffs
+{
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+};
+
+// CMD_SET_FILTER のペイロード。0 の項目は使わない
+struct FilterSpec
+{
+    uint8_t notchHz = 0;          // 50 / 60 など
+    uint8_t notchHarmonics = 1;   // 1: 基本波のみ, 2: 第 2 高調波も (ナイキスト未満なら)
+    uint16_t highpassCentiHz = 0; // 2 次バターワース
+    uint8_t lowpassHz = 0;        // 2 次バターワース
+};
+
+class BiquadChain
+{
+public:
+    // 不正な周波数 (ナイキスト以上) を含む場合は false で、それまでの設定のまま
+    bool configure(const FilterSpec &spec);
+    void disable() { stages_ = 0; }
+    void reset();
+
+    // CH_MAX チャンネル分をその場で処理する
+    void process(int16_t *signals);
+
+    bool enabled() const { return stages_ > 0; }
+    size_t stages() const { return stages_; }
+    const FilterSpec &spec() const { return spec_; }
+    const BiquadCoeffs &coeffs(size_t stage) const { return coeffs_[stage]; }
+
+    // RBJ Audio EQ Cookbook の設計式を Q30 に量子化したもの
+    static BiquadCoeffs notch(double freqHz, double q, double sampleRateHz = SAMPLE_RATE_HZ);
+    static BiquadCoeffs highpass(double freqHz, double sampleRateHz = SAMPLE_RATE_HZ);
+    static BiquadCoeffs lowpass(double freqHz, double sampleRateHz = SAMPLE_RATE_HZ);
+
+private:
+    FilterSpec spec_;
+    BiquadCoeffs coeffs_[BIQUAD_MAX_STAGES] = {};
+    size_t stages_ = 0;
+
+    int32_t x1_[BIQUAD_MAX_STAGES][CH_MAX] = {};
+    int32_t x2_[BIQUAD_MAX_STAGES][CH_MAX] = {};
+    int32_t y1_[BIQUAD_MAX_STAGES][CH_MAX] = {};
+    int32_t y2_[BIQUAD_MAX_STAGES][CH_MAX] = {};
+    int32_t error_[BIQUAD_MAX_STAGES][CH_MAX] = {};
+};
@@ -0,0 +1,83 @@
+// 切断中に生成したチャンクを貯めておくリングバッファ (store-and-forward)
+//
+// 領域は呼び出し側が渡す (ファームウェアでは PSRAM)。満杯になったら最も古いチャンクを捨てて入れるので、
+// 長い切断でも残るのは直近 capacity チャンク分で、穴は常に先頭側にできる。
+// 追送が終わるまではライブのチャンクも後ろに積み、送信順を生成順 (start_index 順) に保つ。
+// 受信側の連続性チェックとダイジェストは到着順に畳み込むため。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeg_protocol.h"
+#include "eeg_stream_digest.h"
+
+struct BacklogChunk
+{
+    ChunkedSamplePacket packet;
+    StreamDigest digest; // このチャンクまで畳み込んだ値 (追送時にチェックポイントを出す)
+};
+
+class ChunkBacklog
+{
+public:
+    void attach(BacklogChunk *storage, size_t capacity)
+    {
+        storage_ = storage;
+        capacity_ = storage != nullptr ? capacity : 0;
+        clear();
+    }
+
+    void clear()
+    {
+        head_ = 0;
+        count_ = 0;
+        dropped_ = 0;
+    }
+
+    void push(const ChunkedSamplePacket &chunk, const StreamDigest &digest)
+    {
+        if (capacity_ == 0)
+        {
+            dropped_++;
+            return;
+        }
+        if (count_ == capacity_)
+        {
+            head_ = (head_ + 1) % capacity_;
+            count_--;
+            dropped_++;
+        }
+        BacklogChunk &slot = storage_[(head_ + count_) % capacity_];
+        memcpy(&slot.packet, &chunk, sizeof(chunk));
+        slot.digest = digest;
+        count_++;
+    }
+
+    // 最も古いチャンク (empty() でないときだけ有効)
+    const BacklogChunk &front() const { return storage_[head_]; }
+
+    void pop()
+    {
+        if (count_ > 0)
+        {
+            head_ = (head_ + 1) % capacity_;
+            count_--;
+        }
+    }
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    size_t capacity() const { return capacity_; }
+    // clear() 以降、満杯 (または領域なし) で捨てたチャンク数
+    uint32_t dropped() const { return dropped_; }
+    BacklogChunk *storage() const { return storage_; }
+
+private:
+    BacklogChunk *storage_ = nullptr;
+    size_t capacity_ = 0;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint32_t dropped_ = 0;
+};
@@ -0,0 +1,61 @@
+// 水晶発振器のずれ (固定オフセット + 温度変化のようなゆっくりした揺らぎ) のモデル
+//
+// 揺らぎは Ornstein-Uhlenbeck 過程: 定常状態の標準偏差が wanderPpm、相関時間が wanderTauSec。
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "eeg_random.h"
+
+struct ClockProfile
+{
+    float offsetPpm = 0.0f;
+    float wanderPpm = 0.0f;
+    float wanderTauSec = 600.0f;
+};
+
+class ClockDriftModel
+{
+public:
+    explicit ClockDriftModel(uint64_t seed = 1) : rng_(seed, 0xC10C) {}
+
+    void configure(const ClockProfile &profile)
+    {
+        profile_ = profile;
+        if (profile_.wanderTauSec < 1.0f)
+        {
+            profile_.wanderTauSec = 1.0f;
+        }
+        wander_ = 0.0f;
+    }
+
+    const ClockProfile &profile() const { return profile_; }
+
+    // dtSec 経過させて現在のずれ (ppm) を返す。dtSec = 0 なら状態 (乱数系列も) は進めない
+    float update(float dtSec)
+    {
+        if (profile_.wanderPpm > 0.0f && dtSec > 0.0f)
+        {
+            const float decay = expf(-dtSec / profile_.wanderTauSec);
+            const float sigma = profile_.wanderPpm * sqrtf(1.0f - decay * decay);
+            wander_ = wander_ * decay + sigma * gaussian();
+        }
+        return currentPpm();
+    }
+
+    float currentPpm() const { return profile_.offsetPpm + wander_; }
+
+private:
+    float gaussian()
+    {
+        // Box-Muller (1 秒に 1 回程度しか呼ばないので三角関数で十分)
+        const float u1 = rng_.nextUniform() * 0.999999f + 1e-7f;
+        const float u2 = rng_.nextUniform();
+        return sqrtf(-2.0f * logf(u1)) * cosf(6.28318531f * u2);
+    }
+
+    Pcg32 rng_;
+    ClockProfile profile_;
+    float wander_ = 0.0f;
+};
@@ -0,0 +1,149 @@
+// 受信コマンドの記録 (再生用のコンパクトなバイナリログ)
+//
+// 形式: ヘッダ "ECL1" の後にレコードを連ねる。
+//   [varint サンプル差分][cmd][len][payload × len]
+// サンプル差分はセッション内の直前レコードからの差 (CMD_START_STREAMING で 0 に戻る)。
+// サンプル位置は「そのサンプルを生成する直前に適用された」ことを表す。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeg_protocol.h"
+
+constexpr uint8_t COMMAND_LOG_MAGIC[4] = {'E', 'C', 'L', '1'};
+constexpr size_t COMMAND_LOG_MAX_PAYLOAD = 15;
+
+struct CommandLogEntry
+{
+    uint32_t sampleIndex; // セッション内のサンプル位置
+    uint8_t cmd;
+    uint8_t length; // payload のバイト数
+    uint8_t payload[COMMAND_LOG_MAX_PAYLOAD];
+};
+
+class CommandLog
+{
+public:
+    CommandLog(uint8_t *storage, size_t capacity) : storage_(storage), capacity_(capacity) { clear(); }
+
+    void clear()
+    {
+        size_ = 0;
+        lastIndex_ = 0;
+        overflowed_ = false;
+        if (capacity_ >= sizeof(COMMAND_LOG_MAGIC))
+        {
+            memcpy(storage_, COMMAND_LOG_MAGIC, sizeof(COMMAND_LOG_MAGIC));
+            size_ = sizeof(COMMAND_LOG_MAGIC);
+        }
+    }
+
+    // 容量が足りなければ記録せず overflowed() を立てる (以降のレコードも捨てる)
+    bool record(uint32_t sampleIndex, uint8_t cmd, const uint8_t *payload, size_t length)
+    {
+        if (overflowed_)
+        {
+            return false;
+        }
+        if (cmd == CMD_START_STREAMING)
+        {
+            lastIndex_ = 0;
+        }
+        length = length > COMMAND_LOG_MAX_PAYLOAD ? COMMAND_LOG_MAX_PAYLOAD : length;
+        uint8_t varint[5];
+        size_t varintLen = 0;
+        uint32_t delta = sampleIndex - lastIndex_;
+        do
+        {
+            varint[varintLen++] = static_cast<uint8_t>((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0x00));
+            delta >>= 7;
+        } while (delta != 0);
+
+        const size_t needed = varintLen + 2 + length;
+        if (size_ + needed > capacity_)
+        {
+            overflowed_ = true;
+            return false;
+        }
+        memcpy(storage_ + size_, varint, varintLen);
+        storage_[size_ + varintLen] = cmd;
+        storage_[size_ + varintLen + 1] = static_cast<uint8_t>(length);
+        if (length > 0)
+        {
+            memcpy(storage_ + size_ + varintLen + 2, payload, length);
+        }
+        size_ += needed;
+        lastIndex_ = sampleIndex;
+        return true;
+    }
+
+    const uint8_t *data() const { return storage_; }
+    size_t size() const { return size_; }
+    bool overflowed() const { return overflowed_; }
+
+private:
+    uint8_t *storage_;
+    size_t capacity_;
+    size_t size_ = 0;
+    uint32_t lastIndex_ = 0;
+    bool overflowed_ = false;
+};
+
+class CommandLogReader
+{
+public:
+    CommandLogReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+    bool valid() const { return size_ >= sizeof(COMMAND_LOG_MAGIC) && memcmp(data_, COMMAND_LOG_MAGIC, sizeof(COMMAND_LOG_MAGIC)) == 0; }
+
+    // 次のレコードを読む。末尾または壊れたレコードで false
+    bool next(CommandLogEntry &entry)
+    {
+        if (pos_ == 0)
+        {
+            if (!valid())
+            {
+                return false;
+            }
+            pos_ = sizeof(COMMAND_LOG_MAGIC);
+        }
+        uint32_t delta = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (pos_ >= size_ || shift > 28)
+            {
+                return false;
+            }
+            const uint8_t b = data_[pos_++];
+            delta |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        if (pos_ + 2 > size_)
+        {
+            return false;
+        }
+        entry.cmd = data_[pos_];
+        entry.length = data_[pos_ + 1];
+        pos_ += 2;
+        if (entry.length > COMMAND_LOG_MAX_PAYLOAD || pos_ + entry.length > size_)
+        {
+            return false;
+        }
+        memcpy(entry.payload, data_ + pos_, entry.length);
+        pos_ += entry.length;
+        lastIndex_ = (entry.cmd == CMD_START_STREAMING) ? 0 : lastIndex_ + delta;
+        entry.sampleIndex = lastIndex_;
+        return true;
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+    size_t pos_ = 0;
+    uint32_t lastIndex_ = 0;
+};
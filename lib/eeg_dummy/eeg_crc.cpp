@@ -0,0 +1,150 @@
+#include "eeg_crc.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define EEG_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define EEG_CRC32C_ARMV8 1
+#endif
+
+namespace
+{
+
+constexpr uint32_t CRC32C_POLY = 0x82F63B78u;
+
+struct Crc32cTables
+{
+    uint32_t t[8][256];
+
+    Crc32cTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1u)));
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            for (int s = 1; s < 8; ++s)
+            {
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+// 初回使用時に生成する (起動時間とフラッシュを使わない)
+const Crc32cTables &tables()
+{
+    static const Crc32cTables instance;
+    return instance;
+}
+
+#if EEG_CRC32C_SSE42
+__attribute__((target("sse4.2"))) uint32_t crc32cSse42(const uint8_t *p, size_t size, uint32_t crc)
+{
+    uint64_t c = crc;
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; size > 0; ++p, --size)
+    {
+        c32 = _mm_crc32_u8(c32, *p);
+    }
+    return c32;
+}
+#endif
+
+} // namespace
+
+uint32_t crc32cBytewise(const void *data, size_t size, uint32_t crc)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const uint32_t(&t0)[256] = tables().t[0];
+    crc = ~crc;
+    while (size-- > 0)
+    {
+        crc = (crc >> 8) ^ t0[(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+uint32_t crc32cSlice8(const void *data, size_t size, uint32_t crc)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const Crc32cTables &tb = tables();
+    crc = ~crc;
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        // リトルエンディアン前提 (ESP32 / x86 / AArch64)
+        uint32_t lo;
+        uint32_t hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= crc;
+        crc = tb.t[7][lo & 0xFF] ^ tb.t[6][(lo >> 8) & 0xFF] ^ tb.t[5][(lo >> 16) & 0xFF] ^ tb.t[4][lo >> 24] ^
+              tb.t[3][hi & 0xFF] ^ tb.t[2][(hi >> 8) & 0xFF] ^ tb.t[1][(hi >> 16) & 0xFF] ^ tb.t[0][hi >> 24];
+    }
+    while (size-- > 0)
+    {
+        crc = (crc >> 8) ^ tb.t[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+bool crc32cHardwareAvailable()
+{
+#if EEG_CRC32C_SSE42
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+#elif EEG_CRC32C_ARMV8
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32cHardware(const void *data, size_t size, uint32_t crc)
+{
+#if EEG_CRC32C_SSE42
+    if (crc32cHardwareAvailable())
+    {
+        return ~crc32cSse42(static_cast<const uint8_t *>(data), size, ~crc);
+    }
+#elif EEG_CRC32C_ARMV8
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+    for (; size > 0; ++p, --size)
+    {
+        crc = __crc32cb(crc, *p);
+    }
+    return ~crc;
+#endif
+    return crc32cSlice8(data, size, crc);
+}
+
+uint32_t crc32c(const void *data, size_t size, uint32_t crc)
+{
+#if EEG_CRC32C_SSE42 || EEG_CRC32C_ARMV8
+    return crc32cHardware(data, size, crc);
+#else
+    return crc32cSlice8(data, size, crc);
+#endif
+}
@@ -0,0 +1,35 @@
+// パケットトレーラ用の CRC-32C (Castagnoli, 反射多項式 0x82F63B78)
+//
+// ソフトウェア実装は slice-by-8 (8 x 256 エントリ = 8KB のテーブル、初回使用時に生成)。
+// x86-64 の SSE4.2 / AArch64 の CRC 拡張が使えるホストでは crc32 命令に切り替える。
+// ESP32-S3 の ROM CRC は IEEE 多項式のみなので、デバイスでは slice-by-8 を使う。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// crc は前回の戻り値 (初回は 0)。分割して渡しても一括と同じ値になる
+uint32_t crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+// 実装を指定した版 (ベンチマーク用)
+uint32_t crc32cBytewise(const void *data, size_t size, uint32_t crc = 0);
+uint32_t crc32cSlice8(const void *data, size_t size, uint32_t crc = 0);
+uint32_t crc32cHardware(const void *data, size_t size, uint32_t crc = 0); // 使えなければ slice-by-8
+bool crc32cHardwareAvailable();
+
+// パケット末尾に LE32 で付ける / 検査する (size はトレーラを含まない長さ)
+inline void appendPacketCrc(uint8_t *packet, size_t size)
+{
+    const uint32_t crc = crc32c(packet, size);
+    packet[size + 0] = static_cast<uint8_t>(crc);
+    packet[size + 1] = static_cast<uint8_t>(crc >> 8);
+    packet[size + 2] = static_cast<uint8_t>(crc >> 16);
+    packet[size + 3] = static_cast<uint8_t>(crc >> 24);
+}
+
+inline bool checkPacketCrc(const uint8_t *packet, size_t size)
+{
+    const uint32_t stored = packet[size] | (packet[size + 1] << 8) | (packet[size + 2] << 16) |
+                            (static_cast<uint32_t>(packet[size + 3]) << 24);
+    return crc32c(packet, size) == stored;
+}
@@ -0,0 +1,128 @@
+// 生成のデッドライン監視と段階的な品質の切り下げ
+//
+// チャンク (1 ブロック = SAMPLES_PER_CHUNK サンプル) ごとに処理時間と tick の遅れを受け取り、
+// 余裕がなくなったら任意の処理を決まった順に 1 段ずつ止める。サンプルを落とす (tick を取りこぼす) 代わりに
+// 中身の品質を下げてサンプルクロックを守るのが目的。余裕が続けば 1 段ずつ戻す。
+//
+//   DEGRADE_NO_NOISE     背景ノイズを止める (乱数系列は進めるので seek の互換は保つ)
+//   DEGRADE_NO_ANALYSIS  スペクトル / 帯域パワーの計算を止める
+//   DEGRADE_NO_FILTER    ストリームのフィルタを素通しにする
+//   DEGRADE_FEW_VOICES   SSVEP の同時応答数を絞る
+//
+// 時間の単位は呼び出し側が決める (ファームウェアではサイクル数)。
+// 生成に効く段階 (ノイズ / フィルタ / SSVEP) は CMD_SET_QUALITY としてエンジンに通し、コマンドログから再生できるようにする。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum DegradeLevel : uint8_t
+{
+    DEGRADE_NONE = 0,
+    DEGRADE_NO_NOISE = 1,
+    DEGRADE_NO_ANALYSIS = 2,
+    DEGRADE_NO_FILTER = 3,
+    DEGRADE_FEW_VOICES = 4,
+    DEGRADE_MAX = DEGRADE_FEW_VOICES,
+};
+
+constexpr int32_t DEGRADE_SLACK_PERMILLE = 150;  // 余裕がこれを切ったら 1 段下げる
+constexpr int32_t RECOVER_SLACK_PERMILLE = 500;  // これ以上の余裕が続いたら 1 段戻す
+constexpr uint32_t DEGRADE_LAG_TICKS = 8;        // 未処理 tick がこれだけ溜まったら下げる (32ms 遅れ)
+constexpr uint32_t RECOVER_LAG_TICKS = 2;
+constexpr uint32_t DEGRADE_HOLD_BLOCKS = 2;      // 下げた直後は効果が出るまで次を下げない
+constexpr uint32_t RECOVER_BLOCKS = 20;          // 2 秒余裕が続いたら戻す
+constexpr size_t DEGRADED_SSVEP_VOICES = 2;      // DEGRADE_FEW_VOICES での SSVEP の同時応答数
+
+class DeadlineMonitor
+{
+public:
+    void configure(uint32_t blockBudget)
+    {
+        budget_ = blockBudget;
+        level_ = DEGRADE_NONE;
+        hold_ = 0;
+        healthy_ = 0;
+        changes_ = 0;
+        slack_ = 1000;
+        minSlack_ = 1000;
+    }
+
+    // 1 ブロック分の処理時間、その間の未処理 tick の最大値、取りこぼした tick 数を渡す。段階が変わったら true
+    bool endBlock(uint32_t busy, uint32_t maxLagTicks, uint32_t lostTicks)
+    {
+        if (budget_ == 0)
+        {
+            return false;
+        }
+        slack_ = busy >= budget_ ? -static_cast<int32_t>((static_cast<uint64_t>(busy - budget_) * 1000) / budget_)
+                                 : static_cast<int32_t>((static_cast<uint64_t>(budget_ - busy) * 1000) / budget_);
+        minSlack_ = slack_ < minSlack_ ? slack_ : minSlack_;
+
+        const bool late = lostTicks > 0 || maxLagTicks >= DEGRADE_LAG_TICKS || slack_ < DEGRADE_SLACK_PERMILLE;
+        const bool comfortable = maxLagTicks <= RECOVER_LAG_TICKS && slack_ >= RECOVER_SLACK_PERMILLE;
+        if (hold_ > 0)
+        {
+            hold_--;
+        }
+        if (late)
+        {
+            healthy_ = 0;
+            if (hold_ == 0 && level_ < DEGRADE_MAX)
+            {
+                level_++;
+                changes_++;
+                hold_ = DEGRADE_HOLD_BLOCKS;
+                return true;
+            }
+            return false;
+        }
+        healthy_ = comfortable ? healthy_ + 1 : 0;
+        if (healthy_ >= RECOVER_BLOCKS && level_ > DEGRADE_NONE)
+        {
+            level_--;
+            changes_++;
+            healthy_ = 0;
+            return true;
+        }
+        return false;
+    }
+
+    uint8_t level() const { return level_; }
+    int32_t slackPermille() const { return slack_; } // 直近ブロックの余裕 (予算に対する ‰、負なら超過)
+    uint32_t changes() const { return changes_; }
+
+    // 前回呼んでからの最小の余裕 (テレメトリ用)
+    int32_t takeMinSlackPermille()
+    {
+        const int32_t value = minSlack_;
+        minSlack_ = slack_;
+        return value;
+    }
+
+private:
+    uint32_t budget_ = 0;
+    uint8_t level_ = DEGRADE_NONE;
+    uint32_t hold_ = 0;
+    uint32_t healthy_ = 0;
+    uint32_t changes_ = 0;
+    int32_t slack_ = 1000;
+    int32_t minSlack_ = 1000;
+};
+
+inline const char *degradeLevelName(uint8_t level)
+{
+    switch (level)
+    {
+    case DEGRADE_NONE:
+        return "full";
+    case DEGRADE_NO_NOISE:
+        return "no-noise";
+    case DEGRADE_NO_ANALYSIS:
+        return "no-analysis";
+    case DEGRADE_NO_FILTER:
+        return "no-filter";
+    default:
+        return "few-voices";
+    }
+}
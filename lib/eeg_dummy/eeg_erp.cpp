@@ -0,0 +1,182 @@
+#include "eeg_erp.h"
+
+#include <string.h>
+
+bool ErpAverager::configure(size_t preSamples, size_t postSamples, uint32_t reportSamples, uint8_t channelMask,
+                            bool resetAfterReport)
+{
+    epochSamples_ = 0;
+    if (postSamples == 0 || preSamples + postSamples > ERP_MAX_EPOCH_SAMPLES || reportSamples == 0 || channelMask == 0)
+    {
+        return false;
+    }
+    channels_ = 0;
+    for (uint8_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        if (channelMask & (1u << ch))
+        {
+            channelIndex_[channels_++] = ch;
+        }
+    }
+    preSamples_ = preSamples;
+    epochSamples_ = preSamples + postSamples;
+    reportSamples_ = reportSamples;
+    resetAfterReport_ = resetAfterReport;
+
+    packet_.packet_type = PKT_TYPE_ERP_AVERAGE;
+    packet_.frac_bits = ERP_FRAC_BITS;
+    packet_.pre_samples = static_cast<uint8_t>(preSamples);
+    packet_.num_samples = static_cast<uint8_t>(epochSamples_);
+    reset();
+    return true;
+}
+
+void ErpAverager::reset()
+{
+    sampleCount_ = 0;
+    sinceReport_ = 0;
+    lastTrigger_ = 0;
+    ringPos_ = 0;
+    memset(ring_, 0, sizeof(ring_));
+    pendingHead_ = 0;
+    pendingCount_ = 0;
+    memset(conditions_, 0, sizeof(conditions_));
+    memset(epochCount_, 0, sizeof(epochCount_));
+    memset(sums_, 0, sizeof(sums_));
+    reportCursor_ = 0;
+    reportEnd_ = 0;
+    reportIndex_ = 0;
+    stats_ = ErpStats();
+}
+
+int ErpAverager::conditionSlot(uint8_t trigger)
+{
+    for (size_t s = 0; s < ERP_MAX_CONDITIONS; ++s)
+    {
+        if (conditions_[s] == trigger)
+        {
+            return static_cast<int>(s);
+        }
+        if (conditions_[s] == 0)
+        {
+            conditions_[s] = trigger;
+            return static_cast<int>(s);
+        }
+    }
+    return -1;
+}
+
+void ErpAverager::accumulate(const PendingEpoch &epoch)
+{
+    if (epochCount_[epoch.slot] >= ERP_MAX_EPOCHS)
+    {
+        stats_.droppedOverflow++;
+        return;
+    }
+    // ringPos_ は次に書く位置 = 最も古いサンプル。ちょうど epochSamples_ 前から読む
+    size_t start = ringPos_ + ERP_MAX_EPOCH_SAMPLES - epochSamples_;
+    start = start >= ERP_MAX_EPOCH_SAMPLES ? start - ERP_MAX_EPOCH_SAMPLES : start;
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        const int16_t *ring = ring_[c];
+        int32_t *sum = sums_[epoch.slot][c];
+        size_t pos = start;
+        for (size_t i = 0; i < epochSamples_; ++i)
+        {
+            sum[i] += ring[pos];
+            pos = pos + 1 == ERP_MAX_EPOCH_SAMPLES ? 0 : pos + 1;
+        }
+    }
+    epochCount_[epoch.slot]++;
+    stats_.epochs++;
+}
+
+bool ErpAverager::push(const int16_t *signals, uint8_t trigger)
+{
+    if (epochSamples_ == 0)
+    {
+        return false;
+    }
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        ring_[c][ringPos_] = signals[channelIndex_[c]];
+    }
+    ringPos_ = ringPos_ + 1 == ERP_MAX_EPOCH_SAMPLES ? 0 : ringPos_ + 1;
+    const uint32_t index = sampleCount_++;
+
+    // 立ち上がりを基準にする (パルス幅の間は同じエポック)
+    if (trigger != 0 && lastTrigger_ == 0)
+    {
+        const int slot = conditionSlot(trigger);
+        if (index < preSamples_)
+        {
+            stats_.droppedNoBaseline++;
+        }
+        else if (slot < 0 || pendingCount_ == ERP_MAX_PENDING)
+        {
+            stats_.droppedOverflow++;
+        }
+        else
+        {
+            PendingEpoch &epoch = pending_[(pendingHead_ + pendingCount_) % ERP_MAX_PENDING];
+            epoch.onset = index;
+            epoch.slot = static_cast<uint8_t>(slot);
+            pendingCount_++;
+        }
+    }
+    lastTrigger_ = trigger;
+
+    // 基準から post サンプル揃ったエポックを足す (基準は古い順に並んでいる)
+    const uint32_t postSamples = static_cast<uint32_t>(epochSamples_ - preSamples_);
+    while (pendingCount_ > 0 && index + 1 - pending_[pendingHead_].onset >= postSamples)
+    {
+        accumulate(pending_[pendingHead_]);
+        pendingHead_ = (pendingHead_ + 1) % ERP_MAX_PENDING;
+        pendingCount_--;
+    }
+
+    if (++sinceReport_ >= reportSamples_ && reportCursor_ == reportEnd_)
+    {
+        sinceReport_ = 0;
+        reportCursor_ = 0;
+        reportEnd_ = ERP_MAX_CONDITIONS * channels_;
+        reportIndex_++;
+    }
+    return emitNext();
+}
+
+bool ErpAverager::emitNext()
+{
+    while (reportCursor_ < reportEnd_)
+    {
+        const size_t slot = reportCursor_ / channels_;
+        const size_t c = reportCursor_ % channels_;
+        reportCursor_++;
+        const uint16_t count = epochCount_[slot];
+        if (count == 0)
+        {
+            continue;
+        }
+        const int32_t *sum = sums_[slot][c];
+        const int64_t half = count / 2;
+        for (size_t i = 0; i < epochSamples_; ++i)
+        {
+            // 平均 x 2^frac_bits を四捨五入 (負側も対称に)
+            const int64_t scaled = static_cast<int64_t>(sum[i]) * (1 << ERP_FRAC_BITS);
+            int64_t v = scaled >= 0 ? (scaled + half) / count : -((-scaled + half) / count);
+            v = v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+            packet_.values[i] = static_cast<int16_t>(v);
+        }
+        packet_.condition = conditions_[slot];
+        packet_.channel = channelIndex_[c];
+        packet_.epoch_count = count;
+        packet_.report_index = static_cast<uint16_t>(reportIndex_ - 1);
+        if (resetAfterReport_ && c + 1 == channels_)
+        {
+            epochCount_[slot] = 0;
+            memset(sums_[slot], 0, sizeof(sums_[slot]));
+        }
+        return true;
+    }
+    return false;
+}
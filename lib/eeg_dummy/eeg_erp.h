@@ -0,0 +1,85 @@
+// トリガー同期の加算平均 (ERP)
+//
+// trigger_state の立ち上がり (0 → 非 0) をエポックの基準にし、値ごとに条件を分ける。
+// 直近のサンプルをリングに残しておき、基準から post サンプル経ったところで
+// [基準 - pre, 基準 + post) をまとめて条件別の整数アキュムレータへ足す。
+// report 周期ごとに、エポックがある条件 x チャンネルの平均を 1 サンプルに 1 パケットずつ送る。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+
+constexpr size_t ERP_MAX_CONDITIONS = 4;     // 最初に現れた順に割り当てる
+constexpr size_t ERP_MAX_PENDING = 16;       // 基準は来たがまだ post が揃っていないエポック
+constexpr uint8_t ERP_FRAC_BITS = 4;         // 平均すると 1 count 未満の振幅が見えるので 1/16 count 単位で送る
+constexpr uint16_t ERP_MAX_EPOCHS = 32767;   // int32 の和が桁あふれしない上限 (以降は足さない)
+
+struct ErpStats
+{
+    uint32_t epochs = 0;          // 足したエポック
+    uint32_t droppedNoBaseline = 0; // セッション開始直後で pre が揃わなかった
+    uint32_t droppedOverflow = 0;   // 条件数 / 保留数 / エポック数の上限
+};
+
+class ErpAverager
+{
+public:
+    // preSamples + postSamples は 1..ERP_MAX_EPOCH_SAMPLES、reportSamples > 0。不正なら false で無効のまま
+    bool configure(size_t preSamples, size_t postSamples, uint32_t reportSamples, uint8_t channelMask, bool resetAfterReport);
+    void disable() { epochSamples_ = 0; }
+    // 平均とリングを捨てる (設定はそのまま)
+    void reset();
+
+    // 1 サンプル入力する。平均のパケットを 1 つ作ったら true (packet() / packetSize() が有効)
+    bool push(const int16_t *signals, uint8_t trigger);
+
+    bool enabled() const { return epochSamples_ != 0; }
+    size_t epochSamples() const { return epochSamples_; }
+    size_t preSamples() const { return preSamples_; }
+    size_t channels() const { return channels_; }
+    const ErpStats &stats() const { return stats_; }
+    const ErpAveragePacket &packet() const { return packet_; }
+    size_t packetSize() const { return ERP_PACKET_HEADER_BYTES + epochSamples_ * sizeof(int16_t); }
+
+private:
+    struct PendingEpoch
+    {
+        uint32_t onset; // 基準サンプルの通し番号
+        uint8_t slot;
+    };
+
+    int conditionSlot(uint8_t trigger);
+    void accumulate(const PendingEpoch &epoch);
+    bool emitNext();
+
+    size_t preSamples_ = 0;
+    size_t epochSamples_ = 0;
+    uint32_t reportSamples_ = 0;
+    bool resetAfterReport_ = false;
+    uint8_t channelIndex_[CH_MAX] = {};
+    size_t channels_ = 0;
+
+    uint32_t sampleCount_ = 0; // reset() からの通し番号
+    uint32_t sinceReport_ = 0;
+    uint8_t lastTrigger_ = 0;
+    size_t ringPos_ = 0;
+    int16_t ring_[CH_MAX][ERP_MAX_EPOCH_SAMPLES] = {};
+
+    PendingEpoch pending_[ERP_MAX_PENDING] = {};
+    size_t pendingHead_ = 0;
+    size_t pendingCount_ = 0;
+
+    uint8_t conditions_[ERP_MAX_CONDITIONS] = {}; // スロット → トリガー値 (0 は未使用)
+    uint16_t epochCount_[ERP_MAX_CONDITIONS] = {};
+    int32_t sums_[ERP_MAX_CONDITIONS][CH_MAX][ERP_MAX_EPOCH_SAMPLES] = {};
+
+    // 送信中の報告: スロット x チャンネルを順に回る (reportCursor_ == reportEnd_ なら送信なし)
+    size_t reportCursor_ = 0;
+    size_t reportEnd_ = 0;
+    uint16_t reportIndex_ = 0;
+
+    ErpStats stats_;
+    ErpAveragePacket packet_{};
+};
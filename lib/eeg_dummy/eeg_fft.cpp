@@ -0,0 +1,197 @@
+#include "eeg_fft.h"
+
+namespace
+{
+
+// sin(2πi/512), i = 0..128 (Q31)
+const int32_t FFT_QUARTER_SINE_Q31[FFT_MAX_SIZE / 4 + 1] = {
+    0, 26352928, 52701887, 79042909, 105372028, 131685278,
+    157978697, 184248325, 210490206, 236700388, 262874923, 289009871,
+    315101294, 341145265, 367137860, 393075166, 418953276, 444768293,
+    470516330, 496193509, 521795963, 547319836, 572761285, 598116478,
+    623381597, 648552837, 673626408, 698598533, 723465451, 748223418,
+    772868706, 797397602, 821806413, 846091463, 870249095, 894275670,
+    918167571, 941921200, 965532978, 988999351, 1012316784, 1035481765,
+    1058490807, 1081340445, 1104027236, 1126547765, 1148898640, 1171076495,
+    1193077990, 1214899812, 1236538675, 1257991319, 1279254515, 1300325059,
+    1321199780, 1341875532, 1362349204, 1382617710, 1402677999, 1422527050,
+    1442161874, 1461579513, 1480777044, 1499751575, 1518500249, 1537020243,
+    1555308767, 1573363067, 1591180425, 1608758157, 1626093615, 1643184190,
+    1660027308, 1676620431, 1692961061, 1709046738, 1724875039, 1740443580,
+    1755750016, 1770792043, 1785567395, 1800073848, 1814309215, 1828271355,
+    1841958164, 1855367580, 1868497585, 1881346201, 1893911493, 1906191569,
+    1918184580, 1929888719, 1941302224, 1952423376, 1963250500, 1973781966,
+    1984016188, 1993951624, 2003586778, 2012920200, 2021950483, 2030676268,
+    2039096240, 2047209132, 2055013722, 2062508835, 2069693341, 2076566159,
+    2083126253, 2089372637, 2095304369, 2100920555, 2106220351, 2111202958,
+    2115867625, 2120213650, 2124240379, 2127947205, 2131333571, 2134398965,
+    2137142926, 2139565042, 2141664947, 2143442325, 2144896909, 2146028479,
+    2146836865, 2147321945, 2147483647,
+};
+
+// (ar + j ai)(br + j bi)
+inline void cmulQ31(int32_t ar, int32_t ai, int32_t br, int32_t bi, int32_t &re, int32_t &im)
+{
+    const int64_t round = int64_t(1) << 30;
+    re = static_cast<int32_t>((static_cast<int64_t>(ar) * br - static_cast<int64_t>(ai) * bi + round) >> 31);
+    im = static_cast<int32_t>((static_cast<int64_t>(ar) * bi + static_cast<int64_t>(ai) * br + round) >> 31);
+}
+
+void bitReverse(int32_t *data, size_t n)
+{
+    size_t j = 0;
+    for (size_t i = 0; i < n - 1; ++i)
+    {
+        if (i < j)
+        {
+            const int32_t re = data[2 * i];
+            const int32_t im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+        size_t bit = n >> 1;
+        while (j & bit)
+        {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+}
+
+} // namespace
+
+int32_t fftSinQ31(size_t i)
+{
+    i &= FFT_MAX_SIZE - 1;
+    constexpr size_t Q = FFT_MAX_SIZE / 4;
+    if (i <= Q)
+    {
+        return FFT_QUARTER_SINE_Q31[i];
+    }
+    if (i <= 2 * Q)
+    {
+        return FFT_QUARTER_SINE_Q31[2 * Q - i];
+    }
+    if (i <= 3 * Q)
+    {
+        return -FFT_QUARTER_SINE_Q31[i - 2 * Q];
+    }
+    return -FFT_QUARTER_SINE_Q31[4 * Q - i];
+}
+
+int32_t fftCosQ31(size_t i)
+{
+    return fftSinQ31(i + FFT_MAX_SIZE / 4);
+}
+
+int32_t fftHannQ31(size_t n, size_t log2n)
+{
+    // (1 - cos) / 2。cos = 1 の端は 0 にする
+    const int32_t c = fftCosQ31(n << (FFT_MAX_LOG2 - log2n));
+    return static_cast<int32_t>((static_cast<int64_t>(INT32_MAX) - c) >> 1);
+}
+
+void fftComplexQ31(int32_t *data, size_t log2n)
+{
+    const size_t n = size_t(1) << log2n;
+    bitReverse(data, n);
+
+    size_t quarter = 1; // 基数 4 の 1/4 長 L
+    if (log2n & 1)
+    {
+        for (size_t i = 0; i < n; i += 2)
+        {
+            int32_t *a = data + 2 * i;
+            const int32_t re = a[2];
+            const int32_t im = a[3];
+            a[2] = (a[0] >> 1) - (re >> 1);
+            a[3] = (a[1] >> 1) - (im >> 1);
+            a[0] = (a[0] >> 1) + (re >> 1);
+            a[1] = (a[1] >> 1) + (im >> 1);
+        }
+        quarter = 2;
+    }
+
+    // X[k]      = a0 + A1 + A2 + A3
+    // X[k + L]  = a0 - A1 - j(A2 - A3)
+    // X[k + 2L] = a0 + A1 - (A2 + A3)
+    // X[k + 3L] = a0 - A1 + j(A2 - A3)
+    // ビット反転順では A1 = W^2k a1, A2 = W^k a2, A3 = W^3k a3 (W = e^{-j2π/4L})
+    for (; quarter * 4 <= n; quarter *= 4)
+    {
+        const size_t span = quarter * 4;
+        const size_t step = FFT_MAX_SIZE / span;
+        for (size_t k = 0; k < quarter; ++k)
+        {
+            const int32_t w1r = fftCosQ31(k * step), w1i = -fftSinQ31(k * step);
+            const int32_t w2r = fftCosQ31(2 * k * step), w2i = -fftSinQ31(2 * k * step);
+            const int32_t w3r = fftCosQ31(3 * k * step), w3i = -fftSinQ31(3 * k * step);
+            for (size_t base = k; base < n; base += span)
+            {
+                int32_t *p0 = data + 2 * base;
+                int32_t *p1 = p0 + 2 * quarter;
+                int32_t *p2 = p1 + 2 * quarter;
+                int32_t *p3 = p2 + 2 * quarter;
+                int32_t a1r, a1i, a2r, a2i, a3r, a3i;
+                if (k == 0)
+                {
+                    a1r = p1[0], a1i = p1[1], a2r = p2[0], a2i = p2[1], a3r = p3[0], a3i = p3[1];
+                }
+                else
+                {
+                    cmulQ31(p1[0], p1[1], w2r, w2i, a1r, a1i);
+                    cmulQ31(p2[0], p2[1], w1r, w1i, a2r, a2i);
+                    cmulQ31(p3[0], p3[1], w3r, w3i, a3r, a3i);
+                }
+                // 64bit で足してから 1/4 に縮める (丸め付き)
+                const int64_t s0r = static_cast<int64_t>(p0[0]) + a1r, s0i = static_cast<int64_t>(p0[1]) + a1i;
+                const int64_t d0r = static_cast<int64_t>(p0[0]) - a1r, d0i = static_cast<int64_t>(p0[1]) - a1i;
+                const int64_t s1r = static_cast<int64_t>(a2r) + a3r, s1i = static_cast<int64_t>(a2i) + a3i;
+                const int64_t d1r = static_cast<int64_t>(a2r) - a3r, d1i = static_cast<int64_t>(a2i) - a3i;
+                p0[0] = static_cast<int32_t>((s0r + s1r + 2) >> 2);
+                p0[1] = static_cast<int32_t>((s0i + s1i + 2) >> 2);
+                p2[0] = static_cast<int32_t>((s0r - s1r + 2) >> 2);
+                p2[1] = static_cast<int32_t>((s0i - s1i + 2) >> 2);
+                // -j(d1r + j d1i) = d1i - j d1r
+                p1[0] = static_cast<int32_t>((d0r + d1i + 2) >> 2);
+                p1[1] = static_cast<int32_t>((d0i - d1r + 2) >> 2);
+                p3[0] = static_cast<int32_t>((d0r - d1i + 2) >> 2);
+                p3[1] = static_cast<int32_t>((d0i + d1r + 2) >> 2);
+            }
+        }
+    }
+}
+
+void fftRealQ31(int32_t *data, size_t log2n)
+{
+    // z[m] = x[2m] + j x[2m+1] はそのまま [re, im] の並び
+    const size_t m = size_t(1) << (log2n - 1);
+    fftComplexQ31(data, log2n - 1);
+
+    // Z は DFT / M。E = (Z[k] + Z*[M-k]) / 2, O = -j (Z[k] - Z*[M-k]) / 2 として
+    // X[k] / N = (E + W^k O) / 2, X[M-k] / N = conj(E - W^k O) / 2 (W = e^{-j2π/N})
+    const int32_t z0r = data[0];
+    const int32_t z0i = data[1];
+    data[0] = static_cast<int32_t>((static_cast<int64_t>(z0r) + z0i) >> 1);
+    data[1] = static_cast<int32_t>((static_cast<int64_t>(z0r) - z0i) >> 1);
+    const size_t step = FFT_MAX_SIZE >> log2n;
+    for (size_t k = 1; k <= m / 2; ++k)
+    {
+        int32_t *a = data + 2 * k;
+        int32_t *b = data + 2 * (m - k);
+        const int32_t er = static_cast<int32_t>((static_cast<int64_t>(a[0]) + b[0]) >> 1);
+        const int32_t ei = static_cast<int32_t>((static_cast<int64_t>(a[1]) - b[1]) >> 1);
+        // O = -j G, G = (Z[k] - Z*[M-k]) / 2 → O = (G.im, -G.re)
+        const int32_t gr = static_cast<int32_t>((static_cast<int64_t>(a[0]) - b[0]) >> 1);
+        const int32_t gi = static_cast<int32_t>((static_cast<int64_t>(a[1]) + b[1]) >> 1);
+        int32_t tr, ti;
+        cmulQ31(gi, -gr, fftCosQ31(k * step), -fftSinQ31(k * step), tr, ti);
+        a[0] = static_cast<int32_t>((static_cast<int64_t>(er) + tr) >> 1);
+        a[1] = static_cast<int32_t>((static_cast<int64_t>(ei) + ti) >> 1);
+        b[0] = static_cast<int32_t>((static_cast<int64_t>(er) - tr) >> 1);
+        b[1] = static_cast<int32_t>(-((static_cast<int64_t>(ei) - ti) >> 1));
+    }
+}
@@ -0,0 +1,28 @@
+// 固定小数点 (Q31) の FFT
+//
+// 複素 FFT は基数 4 (段数が奇数なら最初に基数 2 を 1 段)、ビット反転順の入力に対する時間間引き。
+// 各段で 1/4 (基数 2 は 1/2) に縮めるので、出力は DFT / n になり桁あふれしない。
+// 実 FFT は N 点の実数列を N/2 点の複素数列として変換し、分割ステップで戻す。
+// 回転因子は 512 分割の 1/4 周期正弦テーブル (const なのでファームウェアではフラッシュに置かれる)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr size_t FFT_MIN_LOG2 = 6; // 64 点
+constexpr size_t FFT_MAX_LOG2 = 9; // 512 点 (250Hz で約 2 秒)
+constexpr size_t FFT_MAX_SIZE = size_t(1) << FFT_MAX_LOG2;
+
+// 角度 2πi/FFT_MAX_SIZE の cos / sin (Q31)
+int32_t fftSinQ31(size_t i);
+int32_t fftCosQ31(size_t i);
+
+// data は [re, im] を n = 2^log2n 個並べたもの。その場で順方向 DFT / n に置き換える (log2n <= FFT_MAX_LOG2 - 1)
+void fftComplexQ31(int32_t *data, size_t log2n);
+
+// data[0..N-1] の実数列 (N = 2^log2n) を X[k] / N (k = 0..N/2-1, [re, im]) に置き換える。
+// X[0] は実数なので data[1] には代わりに X[N/2] / N (ナイキスト, 実数) が入る
+void fftRealQ31(int32_t *data, size_t log2n);
+
+// 周期的 Hann 窓 w[n] (0..N-1) を Q31 で返す。テーブルは回転因子と共用
+int32_t fftHannQ31(size_t n, size_t log2n);
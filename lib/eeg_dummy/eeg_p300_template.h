@@ -0,0 +1,223 @@
+// P300 テンプレートの整数化 (コンパイル時)
+//
+// p300_waveform_data.h の float 波形 (µV) を、コンパイル時に共通スケールの符号付き整数へ量子化する。
+// float の配列は定数式の中でしか使わないので、バイナリに残るのは整数の表だけになる。
+//
+//   既定                            : int16 の表 (625 x 2 B = 1250 B、float の 2500 B の半分)
+//   EEG_P300_TEMPLATE_BITS=N (8..16) : 量子化のビット数 (1 LSB = ピーク / (2^(N-1) - 1))
+//   EEG_P300_PACKED_TEMPLATE=1       : 隣接差分を固定幅ビット列に詰めて持つ。32 サンプルごとにキー値を置き、
+//                                      そこから順に差分を足して復元する (再生は先頭から順に読むだけなので安い)。
+//                                      16 ビットで 1140 B、12 ビットで 828 B、10 ビットで 672 B
+//
+// 16 ビットでも 1 LSB ≈ 0.0003µV なので、出力 (1 カウント ≈ 5.7µV) には量子化の差は出ない。
+//
+// 量子化は C++11 の constexpr で書いている (ファームウェアは gnu++11)。ループが書けないので、
+// 表の展開はインデックス列のパック展開、最大値などは二分の再帰で求める (再帰の深さを log N に抑える)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "p300_waveform_data.h"
+
+#ifndef EEG_P300_TEMPLATE_BITS
+#define EEG_P300_TEMPLATE_BITS 16
+#endif
+
+#ifndef EEG_P300_PACKED_TEMPLATE
+#define EEG_P300_PACKED_TEMPLATE 0
+#endif
+
+static_assert(EEG_P300_TEMPLATE_BITS >= 8 && EEG_P300_TEMPLATE_BITS <= 16, "EEG_P300_TEMPLATE_BITS must be 8..16");
+
+constexpr size_t P300_TEMPLATE_BITS = EEG_P300_TEMPLATE_BITS;
+constexpr int32_t P300_TEMPLATE_MAX_CODE = (1 << (P300_TEMPLATE_BITS - 1)) - 1;
+constexpr size_t P300_PACKED_KEY_INTERVAL = 32;
+
+// ========= コンパイル時の補助 =========
+template <size_t... I>
+struct P300IndexList
+{
+    typedef P300IndexList type;
+};
+
+template <class A, class B>
+struct P300ConcatIndex;
+
+template <size_t... A, size_t... B>
+struct P300ConcatIndex<P300IndexList<A...>, P300IndexList<B...>> : P300IndexList<A..., (sizeof...(A) + B)...>
+{
+};
+
+// 0..N-1 (半分ずつ作ってつなぐので、テンプレートの入れ子も log N 段)
+template <size_t N>
+struct P300MakeIndex : P300ConcatIndex<typename P300MakeIndex<N / 2>::type, typename P300MakeIndex<N - N / 2>::type>
+{
+};
+
+template <>
+struct P300MakeIndex<0> : P300IndexList<>
+{
+};
+
+template <>
+struct P300MakeIndex<1> : P300IndexList<0>
+{
+};
+
+constexpr double p300Abs(double x)
+{
+    return x < 0.0 ? -x : x;
+}
+
+constexpr int32_t p300Round(double x)
+{
+    return x >= 0.0 ? static_cast<int32_t>(x + 0.5) : -static_cast<int32_t>(-x + 0.5);
+}
+
+constexpr double p300PeakUv(size_t lo, size_t hi)
+{
+    return hi - lo == 1 ? p300Abs(P300_WAVEFORM_MICROVOLT[lo])
+                        : (p300PeakUv(lo, (lo + hi) / 2) > p300PeakUv((lo + hi) / 2, hi) ? p300PeakUv(lo, (lo + hi) / 2)
+                                                                                           : p300PeakUv((lo + hi) / 2, hi));
+}
+
+// 1 LSB あたりの µV
+constexpr double P300_TEMPLATE_LSB_UV = p300PeakUv(0, P300_CYCLE_SAMPLES) / P300_TEMPLATE_MAX_CODE;
+
+constexpr int16_t p300Quantise(size_t i)
+{
+    return static_cast<int16_t>(p300Round(P300_WAVEFORM_MICROVOLT[i] / P300_TEMPLATE_LSB_UV));
+}
+
+// ========= int16 の表 =========
+template <class>
+struct P300TemplateTable;
+
+template <size_t... I>
+struct P300TemplateTable<P300IndexList<I...>>
+{
+    static constexpr int16_t samples[sizeof...(I)] = {p300Quantise(I)...};
+};
+
+template <size_t... I>
+constexpr int16_t P300TemplateTable<P300IndexList<I...>>::samples[sizeof...(I)];
+
+// ========= 差分 + 固定幅ビット列 =========
+// キー位置の差分は 0 (キー値で置き換える)
+constexpr int32_t p300Delta(size_t i)
+{
+    return i % P300_PACKED_KEY_INTERVAL == 0 ? 0 : p300Quantise(i) - p300Quantise(i - 1);
+}
+
+constexpr int32_t p300MaxAbsDelta(size_t lo, size_t hi)
+{
+    return hi - lo == 1 ? (p300Delta(lo) < 0 ? -p300Delta(lo) : p300Delta(lo))
+                        : (p300MaxAbsDelta(lo, (lo + hi) / 2) > p300MaxAbsDelta((lo + hi) / 2, hi) ? p300MaxAbsDelta(lo, (lo + hi) / 2)
+                                                                                                   : p300MaxAbsDelta((lo + hi) / 2, hi));
+}
+
+constexpr size_t p300BitsFor(int32_t magnitude)
+{
+    return magnitude == 0 ? 0 : 1 + p300BitsFor(magnitude >> 1);
+}
+
+constexpr size_t P300_PACKED_FIELD_BITS = p300BitsFor(p300MaxAbsDelta(0, P300_CYCLE_SAMPLES)) + 1; // 符号込み
+constexpr uint32_t P300_PACKED_FIELD_MASK = (1u << P300_PACKED_FIELD_BITS) - 1;
+// 読み出しは 2 語まとめて読むので末尾に 1 語足しておく
+constexpr size_t P300_PACKED_WORDS = (P300_CYCLE_SAMPLES * P300_PACKED_FIELD_BITS + 31) / 32 + 1;
+constexpr size_t P300_PACKED_KEYS = (P300_CYCLE_SAMPLES + P300_PACKED_KEY_INTERVAL - 1) / P300_PACKED_KEY_INTERVAL;
+
+static_assert(P300_PACKED_FIELD_BITS <= 24, "P300 template deltas too wide to pack");
+
+constexpr uint32_t p300FieldBits(size_t f)
+{
+    return static_cast<uint32_t>(p300Delta(f)) & P300_PACKED_FIELD_MASK;
+}
+
+// 語 w に入るフィールド f の部分
+constexpr uint32_t p300FieldInWord(size_t f, size_t w)
+{
+    return f >= P300_CYCLE_SAMPLES ? 0
+           : f * P300_PACKED_FIELD_BITS >= 32 * w
+               ? (f * P300_PACKED_FIELD_BITS - 32 * w < 32 ? p300FieldBits(f) << (f * P300_PACKED_FIELD_BITS - 32 * w) : 0)
+               : (32 * w - f * P300_PACKED_FIELD_BITS < P300_PACKED_FIELD_BITS ? p300FieldBits(f) >> (32 * w - f * P300_PACKED_FIELD_BITS) : 0);
+}
+
+constexpr uint32_t p300PackWord(size_t w, size_t f, size_t last)
+{
+    return f > last ? 0 : p300FieldInWord(f, w) | p300PackWord(w, f + 1, last);
+}
+
+constexpr uint32_t p300PackedWord(size_t w)
+{
+    return p300PackWord(w, (32 * w) / P300_PACKED_FIELD_BITS, (32 * w + 31) / P300_PACKED_FIELD_BITS);
+}
+
+template <class, class>
+struct P300PackedTable;
+
+template <size_t... W, size_t... K>
+struct P300PackedTable<P300IndexList<W...>, P300IndexList<K...>>
+{
+    static constexpr uint32_t words[sizeof...(W)] = {p300PackedWord(W)...};
+    static constexpr int16_t keys[sizeof...(K)] = {p300Quantise(K * P300_PACKED_KEY_INTERVAL)...};
+};
+
+template <size_t... W, size_t... K>
+constexpr uint32_t P300PackedTable<P300IndexList<W...>, P300IndexList<K...>>::words[sizeof...(W)];
+
+template <size_t... W, size_t... K>
+constexpr int16_t P300PackedTable<P300IndexList<W...>, P300IndexList<K...>>::keys[sizeof...(K)];
+
+typedef P300TemplateTable<P300MakeIndex<P300_CYCLE_SAMPLES>::type> P300Template;
+typedef P300PackedTable<P300MakeIndex<P300_PACKED_WORDS>::type, P300MakeIndex<P300_PACKED_KEYS>::type> P300PackedTemplate;
+
+// ========= 再生 =========
+// テンプレートを先頭から順に読む。seek() の後は next() ごとに 1 サンプル進む
+class P300TemplateReader
+{
+public:
+    void seek(size_t index)
+    {
+#if EEG_P300_PACKED_TEMPLATE
+        // 直前のキーから差分を足して進める (最大 31 回)
+        index_ = index - index % P300_PACKED_KEY_INTERVAL;
+        value_ = 0;
+        while (index_ < index)
+        {
+            next();
+        }
+#else
+        index_ = index;
+#endif
+    }
+
+    int16_t next()
+    {
+#if EEG_P300_PACKED_TEMPLATE
+        if (index_ % P300_PACKED_KEY_INTERVAL == 0)
+        {
+            value_ = P300PackedTemplate::keys[index_ / P300_PACKED_KEY_INTERVAL];
+        }
+        else
+        {
+            const size_t bit = index_ * P300_PACKED_FIELD_BITS;
+            const uint64_t pair = P300PackedTemplate::words[bit >> 5] | (static_cast<uint64_t>(P300PackedTemplate::words[(bit >> 5) + 1]) << 32);
+            const uint32_t raw = static_cast<uint32_t>(pair >> (bit & 31)) & P300_PACKED_FIELD_MASK;
+            // 符号拡張
+            value_ += static_cast<int32_t>(raw << (32 - P300_PACKED_FIELD_BITS)) >> (32 - P300_PACKED_FIELD_BITS);
+        }
+        index_++;
+        return static_cast<int16_t>(value_);
+#else
+        return P300Template::samples[index_++];
+#endif
+    }
+
+private:
+    size_t index_ = 0;
+#if EEG_P300_PACKED_TEMPLATE
+    int32_t value_ = 0;
+#endif
+};
@@ -0,0 +1,87 @@
+// 刺激スケジュール (パラダイム) の定義
+//
+// 各イベントのオンセットとトリガー値はイベント番号 k だけから決まる (状態を持たない)。
+// そのため任意のサンプル位置から途中参加でき、複数スレッドで区間を分けて生成しても
+// 逐次生成と同じ系列になる。
+#pragma once
+
+#include <stdint.h>
+
+#include "eeg_random.h"
+#include "eeg_signal_generator.h"
+
+struct StimulusParadigm
+{
+    StimulusMode mode = STIM_MODE_P300;
+    uint64_t seed = 1;
+    uint32_t firstOnsetSamples = SAMPLE_RATE_HZ; // 最初の刺激は 1 秒後
+    uint32_t isiMinSamples = 200;                // 0.8 s
+    uint32_t isiMaxSamples = 300;                // 1.2 s
+    float targetProbability = 0.2f;              // P300: target(1) の確率、残りは non-target(2)
+
+    // オンセットは等間隔の格子に [0, (max-min)/2) のジッタを乗せる。隣接 ISI は [min, max] に収まる
+    uint64_t onsetOf(uint64_t k) const
+    {
+        const uint32_t period = (isiMinSamples + isiMaxSamples) / 2;
+        const uint32_t span = (isiMaxSamples - isiMinSamples) / 2;
+        const uint32_t jitter = static_cast<uint32_t>(hashUniform(seed, k * 2u) * span);
+        return firstOnsetSamples + k * period + jitter;
+    }
+
+    uint8_t triggerValueOf(uint64_t k) const
+    {
+        const float u = hashUniform(seed, k * 2u + 1u);
+        if (mode == STIM_MODE_SSVEP)
+        {
+            return static_cast<uint8_t>(1 + static_cast<uint32_t>(u * SSVEP_MAX_TAGS) % SSVEP_MAX_TAGS);
+        }
+        return u < targetProbability ? 1 : 2;
+    }
+
+    // sampleIndex 以降で最初に起きるイベントの番号
+    uint64_t firstEventAtOrAfter(uint64_t sampleIndex) const
+    {
+        const uint32_t period = (isiMinSamples + isiMaxSamples) / 2;
+        uint64_t k = 0;
+        if (period > 0 && sampleIndex > firstOnsetSamples + period)
+        {
+            k = (sampleIndex - firstOnsetSamples) / period - 1;
+        }
+        while (onsetOf(k) < sampleIndex)
+        {
+            k++;
+        }
+        return k;
+    }
+};
+
+// 生成器と並走してパラダイムどおりにトリガーを打つ
+class ParadigmScheduler
+{
+public:
+    void begin(const StimulusParadigm &paradigm, uint64_t sampleIndex)
+    {
+        paradigm_ = paradigm;
+        nextEvent_ = paradigm_.firstEventAtOrAfter(sampleIndex);
+        nextOnset_ = paradigm_.onsetOf(nextEvent_);
+    }
+
+    // sampleIndex のサンプルを生成する直前に呼ぶ。打ったトリガー値 (なければ 0) を返す
+    uint8_t poll(EegSignalGenerator &generator, uint64_t sampleIndex)
+    {
+        if (sampleIndex < nextOnset_)
+        {
+            return 0;
+        }
+        const uint8_t value = paradigm_.triggerValueOf(nextEvent_);
+        generator.startStimulusEvent(value);
+        nextEvent_++;
+        nextOnset_ = paradigm_.onsetOf(nextEvent_);
+        return value;
+    }
+
+private:
+    StimulusParadigm paradigm_;
+    uint64_t nextEvent_ = 0;
+    uint64_t nextOnset_ = 0;
+};
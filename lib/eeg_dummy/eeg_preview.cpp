@@ -0,0 +1,174 @@
+#include "eeg_preview.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+
+constexpr float PREVIEW_PI = 3.14159265358979f;
+
+} // namespace
+
+bool PreviewDecimator::configure(uint8_t factor, uint8_t channelMask)
+{
+    factor_ = 0;
+    if (factor < 2 || factor > PREVIEW_MAX_FACTOR || (factor & (factor - 1)) != 0 || channelMask == 0)
+    {
+        return false;
+    }
+    channelMask_ = channelMask;
+    channels_ = 0;
+    for (uint8_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        if (channelMask & (1u << ch))
+        {
+            channelIndex_[channels_++] = ch;
+        }
+    }
+    cicRatio_ = factor / 2;
+    cicShift_ = 0;
+    while ((1u << cicShift_) < cicRatio_)
+    {
+        cicShift_++;
+    }
+    cicShift_ *= PREVIEW_CIC_ORDER; // 利得 R^N
+    designFir();
+    factor_ = factor;
+    reset();
+    return true;
+}
+
+void PreviewDecimator::reset()
+{
+    memset(integrator_, 0, sizeof(integrator_));
+    memset(combDelay_, 0, sizeof(combDelay_));
+    memset(history_, 0, sizeof(history_));
+    historyPos_ = 0;
+    cicPhase_ = 0;
+    firPhase_ = false;
+}
+
+// ハミング窓のローパス (31 タップ) に CIC 補償 [-A, 1+2A, -A] を畳み込む。
+// N 段 CIC の通過域は ≒ 1 - N(πf)^2/6 なので A = N/24 で 2 次まで打ち消せる (R = 1 なら補償なし)
+void PreviewDecimator::designFir()
+{
+    constexpr size_t LOWPASS_TAPS = PREVIEW_FIR_TAPS - 2;
+    float lowpass[LOWPASS_TAPS];
+    const float mid = (LOWPASS_TAPS - 1) * 0.5f;
+    for (size_t i = 0; i < LOWPASS_TAPS; ++i)
+    {
+        const float x = i - mid;
+        const float sinc = x == 0.0f ? 2.0f * PREVIEW_FIR_CUTOFF : sinf(2.0f * PREVIEW_PI * PREVIEW_FIR_CUTOFF * x) / (PREVIEW_PI * x);
+        lowpass[i] = sinc * (0.54f - 0.46f * cosf(2.0f * PREVIEW_PI * i / (LOWPASS_TAPS - 1)));
+    }
+    const float a = cicRatio_ > 1 ? PREVIEW_CIC_ORDER / 24.0f : 0.0f;
+    const float comp[3] = {-a, 1.0f + 2.0f * a, -a};
+    float taps[PREVIEW_FIR_TAPS] = {};
+    float sum = 0.0f;
+    for (size_t i = 0; i < LOWPASS_TAPS; ++i)
+    {
+        for (size_t k = 0; k < 3; ++k)
+        {
+            taps[i + k] += lowpass[i] * comp[k];
+        }
+        sum += lowpass[i];
+    }
+    // Q15 に量子化し、直流利得がちょうど 1 になるよう中央タップで丸め誤差を吸収する
+    int32_t total = 0;
+    for (size_t i = 0; i < PREVIEW_FIR_TAPS; ++i)
+    {
+        taps_[i] = static_cast<int16_t>(lrintf(taps[i] / sum * 32768.0f));
+        total += taps_[i];
+    }
+    taps_[PREVIEW_FIR_TAPS / 2] = static_cast<int16_t>(taps_[PREVIEW_FIR_TAPS / 2] + (32768 - total));
+}
+
+bool PreviewDecimator::push(const int16_t *signals, int16_t *out)
+{
+    if (factor_ == 0)
+    {
+        return false;
+    }
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        uint32_t acc = static_cast<uint32_t>(static_cast<int32_t>(signals[channelIndex_[c]]));
+        for (size_t s = 0; s < PREVIEW_CIC_ORDER; ++s)
+        {
+            integrator_[s][c] += acc;
+            acc = integrator_[s][c];
+        }
+    }
+    if (++cicPhase_ < cicRatio_)
+    {
+        return false;
+    }
+    cicPhase_ = 0;
+
+    // comb (CIC 出力レート) → 正規化して FIR の履歴へ
+    int16_t *slot = history_[historyPos_];
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        uint32_t acc = integrator_[PREVIEW_CIC_ORDER - 1][c];
+        for (size_t s = 0; s < PREVIEW_CIC_ORDER; ++s)
+        {
+            const uint32_t delayed = combDelay_[s][c];
+            combDelay_[s][c] = acc;
+            acc -= delayed;
+        }
+        slot[c] = static_cast<int16_t>(static_cast<int32_t>(acc) >> cicShift_);
+    }
+    historyPos_ = historyPos_ + 1 == PREVIEW_FIR_TAPS ? 0 : historyPos_ + 1;
+
+    firPhase_ = !firPhase_;
+    if (firPhase_)
+    {
+        return false;
+    }
+    // 対称タップなので両端を足してから掛ける (historyPos_ が最古)
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        int64_t acc = 0;
+        size_t oldest = historyPos_;
+        size_t newest = historyPos_ == 0 ? PREVIEW_FIR_TAPS - 1 : historyPos_ - 1;
+        for (size_t k = 0; k < PREVIEW_FIR_TAPS / 2; ++k)
+        {
+            acc += static_cast<int32_t>(taps_[k]) * (history_[oldest][c] + history_[newest][c]);
+            oldest = oldest + 1 == PREVIEW_FIR_TAPS ? 0 : oldest + 1;
+            newest = newest == 0 ? PREVIEW_FIR_TAPS - 1 : newest - 1;
+        }
+        acc += static_cast<int32_t>(taps_[PREVIEW_FIR_TAPS / 2]) * history_[oldest][c];
+        acc = (acc + (1 << 14)) >> 15;
+        out[c] = static_cast<int16_t>(acc > 32767 ? 32767 : (acc < -32768 ? -32768 : acc));
+    }
+    return true;
+}
+
+void PreviewPacketizer::reset(const PreviewDecimator &decimator)
+{
+    channels_ = decimator.channels();
+    const size_t byValues = channels_ > 0 ? PREVIEW_MAX_VALUES / channels_ : 1;
+    const size_t byLatency = decimator.factor() > 0 ? SAMPLE_RATE_HZ / decimator.factor() / 4 : 1;
+    framesPerPacket_ = byValues < byLatency ? byValues : byLatency;
+    framesPerPacket_ = framesPerPacket_ > 0 ? framesPerPacket_ : 1;
+    packet_.packet_type = PKT_TYPE_PREVIEW;
+    packet_.factor = decimator.factor();
+    packet_.channel_mask = decimator.channelMask();
+    fill_ = 0;
+    nextIndex_ = 0;
+}
+
+bool PreviewPacketizer::push(const int16_t *frame)
+{
+    memcpy(&packet_.values[fill_ * channels_], frame, channels_ * sizeof(int16_t));
+    fill_++;
+    nextIndex_++;
+    if (fill_ < framesPerPacket_)
+    {
+        return false;
+    }
+    packet_.num_frames = static_cast<uint8_t>(fill_);
+    packet_.start_index = static_cast<uint16_t>(nextIndex_ - fill_);
+    fill_ = 0;
+    return true;
+}
@@ -0,0 +1,74 @@
+// 低帯域プレビュー用の間引き (CIC + 補償 FIR, 固定小数点)
+//
+// factor = 2 x R。3 段 CIC で 1/R に落とし (R が 2 の冪なので利得はシフトで正規化)、
+// CIC のドループを打ち消す補償付きローパス FIR (Q15, PREVIEW_FIR_TAPS タップ) で更に 1/2 にする。
+// 選んだチャンネルだけを処理し、PreviewPacketizer で PreviewPacket にまとめる。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+
+constexpr size_t PREVIEW_CIC_ORDER = 3;
+constexpr size_t PREVIEW_FIR_TAPS = 33;  // 31 タップのローパス * 3 タップの補償
+constexpr float PREVIEW_FIR_CUTOFF = 0.2f; // CIC 出力レートに対する比 (FIR 出力のナイキストは 0.25)
+constexpr uint8_t PREVIEW_MAX_FACTOR = 32;
+
+class PreviewDecimator
+{
+public:
+    // factor は 2..32 の 2 の冪、channelMask は 1 ビット以上。不正なら false で無効のまま
+    bool configure(uint8_t factor, uint8_t channelMask);
+    void disable() { factor_ = 0; }
+    void reset();
+
+    // 1 サンプル入力する。間引き後のフレームが出たら out[channels()] に書いて true
+    bool push(const int16_t *signals, int16_t *out);
+
+    bool enabled() const { return factor_ != 0; }
+    uint8_t factor() const { return factor_; }
+    uint8_t channelMask() const { return channelMask_; }
+    size_t channels() const { return channels_; }
+    const int16_t *taps() const { return taps_; }
+
+private:
+    void designFir();
+
+    uint8_t factor_ = 0;
+    uint8_t channelMask_ = 0;
+    uint8_t channelIndex_[CH_MAX] = {};
+    size_t channels_ = 0;
+    uint32_t cicRatio_ = 1;
+    uint32_t cicShift_ = 0;
+    uint32_t cicPhase_ = 0;
+    bool firPhase_ = false;
+
+    // CIC は 2 の補数の桁あふれを前提にするので符号なしで持つ
+    uint32_t integrator_[PREVIEW_CIC_ORDER][CH_MAX] = {};
+    uint32_t combDelay_[PREVIEW_CIC_ORDER][CH_MAX] = {};
+
+    int16_t taps_[PREVIEW_FIR_TAPS] = {};
+    int16_t history_[PREVIEW_FIR_TAPS][CH_MAX] = {};
+    size_t historyPos_ = 0;
+};
+
+class PreviewPacketizer
+{
+public:
+    // 1 パケットのフレーム数は最大 PREVIEW_MAX_VALUES まで、かつ約 250ms 分で区切る
+    void reset(const PreviewDecimator &decimator);
+
+    // 1 フレーム追加し、パケットが埋まったら true (packet() / packetSize() が有効)
+    bool push(const int16_t *frame);
+
+    const PreviewPacket &packet() const { return packet_; }
+    size_t packetSize() const { return PREVIEW_PACKET_HEADER_BYTES + packet_.num_frames * channels_ * sizeof(int16_t); }
+
+private:
+    PreviewPacket packet_{};
+    size_t channels_ = 0;
+    size_t framesPerPacket_ = 1;
+    size_t fill_ = 0;
+    uint16_t nextIndex_ = 0;
+};
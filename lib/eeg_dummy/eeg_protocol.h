@@ -0,0 +1,225 @@
+// ADS1299 実装と互換のパケット定義 (ファームウェア / ホストツール共通)
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ========= ADS1299 実装と互換の設定 =========
+#define CH_MAX 8
+#define SAMPLE_RATE_HZ 250
+#define SAMPLES_PER_CHUNK 25 // 250SPS / 10Hz = 25
+
+// ========= パケット種別 (ADS1299 実装と同一) =========
+#define PKT_TYPE_DATA_CHUNK 0x66
+#define PKT_TYPE_DEVICE_CFG 0xDD
+#define PKT_TYPE_COMMAND_LOG 0xCA
+#define PKT_TYPE_TELEMETRY 0xE1
+#define PKT_TYPE_STREAM_DIGEST 0xD6
+#define PKT_TYPE_PREVIEW 0xA7
+#define PKT_TYPE_BAND_POWER 0xB9
+#define PKT_TYPE_SPECTRUM 0xF5
+#define PKT_TYPE_ERP_AVERAGE 0xE7
+
+// ========= 制御コマンド (ADS1299 実装と同一) =========
+#define CMD_START_STREAMING 0xAA
+#define CMD_STOP_STREAMING 0x5B
+#define CMD_TRIGGER_PULSE 0xC1
+// CMD_TRIGGER_PULSE [value][phase]: phase (ダミー専用、省略可) はトリガーを載せたサンプルの reserved[2] に出る。
+// 外部トリガー入力ではエッジの位置 = そのサンプル - 1 + phase/256 (eeg_trigger_input.h)
+
+// ========= 拡張コマンド (ダミー専用) =========
+#define CMD_SET_STIM_MODE 0xC2 // [mode] 0=P300, 1=SSVEP
+#define CMD_SSVEP_CONFIG 0xC3  // [slot][freq_centiHz LE16][harmonics][duration_ms LE16]
+#define CMD_DUMP_COMMAND_LOG 0xC4 // [flags] bit0: 送信後にログをクリア
+#define CMD_SET_CLOCK_PROFILE 0xC5 // [offset_centippm i16 LE][wander_centippm u16 LE][wander_tau_s u16 LE]
+#define CMD_SET_TELEMETRY 0xC6     // [interval_chunks] 0=送信しない
+#define CMD_SET_PACKET_CRC 0xC7    // [mode] 0=なし, 1=CRC-32C トレーラ (次の DeviceConfigPacket から有効)
+#define CMD_SET_STREAM_DIGEST 0xC8 // [interval_chunks] 0=送信しない
+#define CMD_SET_PREVIEW 0xC9       // [factor 0/2/4/8/16/32][channel_mask][flags] 0=無効, flags bit0: プレビューのみ送る
+#define CMD_SET_FILTER 0xCA        // [notch_hz][highpass_centiHz LE16][lowpass_hz][notch_harmonics] 0=その段なし (eeg_biquad.h)
+#define CMD_SET_BAND_POWER 0xCB    // [rate_hz][channel_mask][flags][lo0 hi0 .. lo3 hi3] rate 0=無効, 帯域なし=α/β, flags bit0: 特徴量のみ送る
+#define CMD_SET_SPECTRUM 0xCC      // [fft_log2 6..9][channel_mask][overlap 0/1/2][max_hz][flags] fft_log2 0=無効, flags bit0: スペクトルのみ送る
+#define CMD_SET_ERP 0xCD           // [pre_ms LE16][post_ms LE16][report_s][channel_mask][flags] report_s 0=無効, flags bit0: 平均のみ送る, bit1: 送信ごとに平均をやり直す
+#define CMD_SET_STORE_FORWARD 0xCE // [max_seconds LE16] 0=無効。切断中も生成を続けて貯め、次の START で同じセッションを再開して追送する
+#define CMD_RESUME_STREAMING 0xCF  // [session_token LE32][last_start_index LE16] トークンが今のセッションと一致すれば設定パケットなしで続きから送る。違えば START と同じ
+#define CMD_SET_TRIGGER_INPUT 0xD0 // [edge][value] edge 0=無効, 1=立ち上がり, 2=立ち下がり。GPIO のエッジを value のトリガーとしてサンプル位置に合わせて載せる
+#define CMD_SET_QUALITY 0xD1       // [level] 内部用 (BLE では受け付けない)。デッドライン監視が品質の段階 (DegradeLevel) を変えた位置をコマンドログに残す
+
+// ========= データ構造 (ADS1299 実装と同一) =========
+struct __attribute__((packed)) ElectrodeConfig
+{
+    char name[8];
+    uint8_t type;
+    uint8_t reserved;
+};
+
+// IMU なし、符号付き 16bit 信号に修正
+struct __attribute__((packed)) SampleData
+{
+    int16_t signals[CH_MAX]; // 符号付き 16bit, little-endian
+    uint8_t trigger_state;   // GPIO 下位 4bit を模倣 (0..15)
+    uint8_t reserved[3];     // 予約領域
+};
+
+struct __attribute__((packed)) ChunkedSamplePacket
+{
+    uint8_t packet_type;  // 0x66
+    uint16_t start_index; // LE
+    uint8_t num_samples;  // 25
+    SampleData samples[SAMPLES_PER_CHUNK];
+};
+
+struct __attribute__((packed)) DeviceConfigPacket
+{
+    uint8_t packet_type;  // 0xDD
+    uint8_t num_channels; // 実使用 ch 数（今回は 8ch 固定のダミー）
+    uint8_t flags;        // DEVICE_CFG_FLAG_* (ADS1299 実装では 0)
+    uint8_t reserved[5];
+    ElectrodeConfig configs[CH_MAX];
+};
+
+// この設定パケット自身を含め、以降の全パケットの末尾に CRC-32C (LE32, eeg_crc.h) が付く。
+// 次の設定パケットまで有効
+#define DEVICE_CFG_FLAG_CRC32C 0x01
+constexpr size_t PACKET_CRC_BYTES = 4;
+// reserved[0..3] にセッショントークン (LE32) が入っている。CMD_RESUME_STREAMING で使う
+#define DEVICE_CFG_FLAG_SESSION_TOKEN 0x02
+
+// コマンドログ (eeg_command_log.h の形式) を分割して送る
+#define COMMAND_LOG_FLAG_LAST 0x01
+#define COMMAND_LOG_FLAG_OVERFLOW 0x02
+
+struct __attribute__((packed)) CommandLogPacket
+{
+    uint8_t packet_type; // 0xCA
+    uint8_t sequence;    // 0 から連番
+    uint8_t flags;       // COMMAND_LOG_FLAG_*
+    uint8_t length;      // data の有効バイト数
+    uint8_t data[240];
+};
+
+constexpr size_t COMMAND_LOG_PACKET_HEADER_BYTES = 4;
+
+// デバイス状態の定期報告 (CMD_SET_TELEMETRY で有効化)
+struct __attribute__((packed)) DeviceTelemetryPacket
+{
+    uint8_t packet_type;         // 0xE1
+    uint8_t version;             // 2
+    uint16_t sample_index;       // 次に送るチャンクの start_index (LE)
+    uint32_t uptime_ms;          // LE
+    int32_t clock_offset_ppb;    // エミュレート中のクロックずれ (offset + wander)
+    uint32_t effective_rate_mhz; // 前回報告からの実測サンプルレート (mHz)
+    uint32_t samples_generated;  // 起動からの累計
+    // version 2: デッドライン監視 (eeg_deadline_monitor.h)。段階が変わったときは間隔によらずすぐ送る
+    uint8_t degrade_level;       // DEGRADE_* (0 = 全機能)
+    uint8_t degrade_changes;     // 段階の変更回数 (下位 8 ビット)
+    int16_t min_slack_permille;  // 前回報告からのブロック処理の余裕の最小値 (予算に対する ‰、負なら超過)
+    uint32_t lost_ticks;         // 起動から取りこぼしたサンプル tick の累計
+};
+
+// ストリームのダイジェスト (CMD_SET_STREAM_DIGEST で有効化)
+// セッション開始から送った全チャンクパケット (トレーラを除く) を順に CRC-32C で畳み込んだ値。
+// interval_chunks ごとに、区切りとなるチャンクの直後に送る
+struct __attribute__((packed)) StreamDigestPacket
+{
+    uint8_t packet_type;  // 0xD6
+    uint8_t version;      // 1
+    uint16_t start_index; // 最後に畳み込んだチャンクの start_index (LE)
+    uint32_t chunk_count; // セッション開始からのチャンク数 (LE)
+    uint32_t digest;      // LE
+};
+
+// 間引きプレビュー (CMD_SET_PREVIEW で有効化, eeg_preview.h)
+// values は frame 順、各フレーム内は channel_mask の下位ビットから。長さは num_frames x popcount(channel_mask)
+#define PREVIEW_FLAG_ONLY 0x01
+constexpr size_t PREVIEW_MAX_VALUES = 96;
+
+struct __attribute__((packed)) PreviewPacket
+{
+    uint8_t packet_type;  // 0xA7
+    uint8_t factor;       // 250Hz に対する間引き率
+    uint8_t channel_mask; // bit n = ch n
+    uint8_t num_frames;
+    uint16_t start_index; // 間引き後のサンプル番号 (LE, セッション開始で 0)
+    int16_t values[PREVIEW_MAX_VALUES];
+};
+
+constexpr size_t PREVIEW_PACKET_HEADER_BYTES = 6;
+
+// 帯域パワー (CMD_SET_BAND_POWER で有効化, eeg_band_power.h)
+// power は帯域順、各帯域内は channel_mask の下位ビットから。長さは num_bands x popcount(channel_mask)。
+// 値は 1 ブロック (1/rate_hz 秒) の平均二乗 (counts^2) を dB にして 256 倍したもの (符号付き, ±128dB で飽和)
+#define BAND_POWER_FLAG_ONLY 0x01
+constexpr size_t BAND_POWER_MAX_BANDS = 4;
+constexpr size_t BAND_POWER_MAX_VALUES = BAND_POWER_MAX_BANDS * CH_MAX;
+
+struct __attribute__((packed)) BandPowerPacket
+{
+    uint8_t packet_type;  // 0xB9
+    uint8_t rate_hz;      // 1 秒あたりのパケット数 (= 周波数分解能 Hz)
+    uint8_t channel_mask; // bit n = ch n
+    uint8_t num_bands;
+    uint16_t block_index; // セッション開始からのブロック番号 (LE)
+    uint8_t band_edges[BAND_POWER_MAX_BANDS * 2]; // [lo_hz, hi_hz] x num_bands (残りは 0)
+    int16_t power[BAND_POWER_MAX_VALUES];
+};
+
+constexpr size_t BAND_POWER_PACKET_HEADER_BYTES = 14;
+
+// 対数振幅スペクトル (CMD_SET_SPECTRUM で有効化, eeg_spectrum.h)
+// 1 ブロックにつきチャンネルごとに 1 パケット。magnitude[k] は bin k (k x 250 / 2^fft_log2 Hz) の
+// 正弦波振幅 (counts) を dB にし、(dB + SPECTRUM_DB_OFFSET) x 2 を 0..255 に丸めたもの (0.5dB 刻み)
+#define SPECTRUM_FLAG_ONLY 0x01
+constexpr size_t SPECTRUM_MAX_BINS = 255;
+constexpr float SPECTRUM_DB_OFFSET = 40.0f;
+
+struct __attribute__((packed)) SpectrumPacket
+{
+    uint8_t packet_type;  // 0xF5
+    uint8_t fft_log2;     // FFT 長 = 2^fft_log2
+    uint8_t channel;      // 0..CH_MAX-1
+    uint8_t num_bins;     // bin 0 から
+    uint16_t frame_index; // セッション開始からのブロック番号 (LE)
+    uint8_t magnitude[SPECTRUM_MAX_BINS];
+};
+
+constexpr size_t SPECTRUM_PACKET_HEADER_BYTES = 6;
+
+// トリガー同期の加算平均 ERP (CMD_SET_ERP で有効化, eeg_erp.h)
+// 条件 (トリガー値) x チャンネルごとに 1 パケット。values[i] はトリガー立ち上がりから (i - pre_samples)
+// サンプル目の平均で、単位は 2^-frac_bits counts
+#define ERP_FLAG_ONLY 0x01
+#define ERP_FLAG_RESET_AFTER_REPORT 0x02
+constexpr size_t ERP_MAX_EPOCH_SAMPLES = 240; // 960ms
+
+struct __attribute__((packed)) ErpAveragePacket
+{
+    uint8_t packet_type;   // 0xE7
+    uint8_t condition;     // トリガー値 1..15
+    uint8_t channel;       // 0..CH_MAX-1
+    uint8_t frac_bits;     // values の小数ビット数
+    uint8_t pre_samples;   // トリガー前のサンプル数
+    uint8_t num_samples;   // エポック長
+    uint16_t epoch_count;  // 平均したエポック数 (LE)
+    uint16_t report_index; // セッション開始からの送信回数 (LE)
+    int16_t values[ERP_MAX_EPOCH_SAMPLES];
+};
+
+constexpr size_t ERP_PACKET_HEADER_BYTES = 10;
+
+static_assert(sizeof(SampleData) == 20, "SampleData must be 20 bytes");
+static_assert(sizeof(ChunkedSamplePacket) <= 512, "Chunk packet exceeds BLE payload expectations");
+
+constexpr size_t SAMPLE_DATA_BYTES = sizeof(SampleData);
+constexpr size_t CHUNK_HEADER_BYTES = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t);
+
+// ADS1299 互換の電極設定
+constexpr ElectrodeConfig DEFAULT_ELECTRODES[CH_MAX] = {
+    {"FP1", 0, 0},
+    {"FP2", 0, 0},
+    {"C3", 0, 0},
+    {"C4", 0, 0},
+    {"P3", 0, 0},
+    {"P4", 0, 0},
+    {"O1", 0, 0},
+    {"O2", 0, 0}};
@@ -0,0 +1,71 @@
+// 再現性のある軽量乱数 (PCG32 XSH-RR)
+#pragma once
+
+#include <stdint.h>
+
+class Pcg32
+{
+public:
+    explicit Pcg32(uint64_t seed = 1, uint64_t stream = 0x5851F42D4C957F2DULL) { reseed(seed, stream); }
+
+    void reseed(uint64_t seed, uint64_t stream = 0x5851F42D4C957F2DULL)
+    {
+        state_ = 0;
+        inc_ = (stream << 1u) | 1u;
+        next();
+        state_ += seed;
+        next();
+    }
+
+    uint32_t next()
+    {
+        const uint64_t old = state_;
+        state_ = old * MULTIPLIER + inc_;
+        const uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        const uint32_t rot = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31u));
+    }
+
+    // 系列を delta ステップ先へ O(log delta) で進める (並列生成時のシーク用)
+    void advance(uint64_t delta)
+    {
+        uint64_t curMult = MULTIPLIER;
+        uint64_t curPlus = inc_;
+        uint64_t accMult = 1u;
+        uint64_t accPlus = 0u;
+        while (delta > 0)
+        {
+            if (delta & 1u)
+            {
+                accMult *= curMult;
+                accPlus = accPlus * curMult + curPlus;
+            }
+            curPlus = (curMult + 1u) * curPlus;
+            curMult *= curMult;
+            delta >>= 1u;
+        }
+        state_ = accMult * state_ + accPlus;
+    }
+
+    // [0, 1) の一様乱数
+    float nextUniform() { return static_cast<float>(next() >> 8) * (1.0f / 16777216.0f); }
+
+private:
+    static constexpr uint64_t MULTIPLIER = 6364136223846793005ULL;
+    uint64_t state_;
+    uint64_t inc_;
+};
+
+// カウンタベースのハッシュ (splitmix64)。状態を持たないので任意の添字から直接引ける
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline float hashUniform(uint64_t seed, uint64_t counter)
+{
+    return static_cast<float>(splitmix64(seed ^ splitmix64(counter)) >> 40) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,360 @@
+#include "eeg_signal_generator.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+
+// ========= P300 の整数再生 =========
+// テンプレート値 (LSB) x ゲイン >> P300_GAIN_SHIFT = カウント。ゲインはイベントの強さ x チャネルゲインを
+// 含めてコンパイル時に求めておくので、再生中の P300 は int32 の積和だけで済む。
+// 最大の積は P300_TEMPLATE_MAX_CODE x ゲイン ≒ ピーク µV x MICROVOLT_TO_COUNT x 2^29 なので int32 に収まる
+constexpr int P300_GAIN_SHIFT = 29;
+
+enum P300EventKind : uint8_t
+{
+    P300_EVENT_TARGET = 0,
+    P300_EVENT_NONTARGET = 1,
+    P300_EVENT_DEFAULT = 2,
+};
+
+constexpr int32_t p300GainQ(float eventScale, float channelGain)
+{
+    return p300Round(static_cast<double>(eventScale) * channelGain * P300_TEMPLATE_LSB_UV * MICROVOLT_TO_COUNT *
+                     static_cast<double>(1L << P300_GAIN_SHIFT));
+}
+
+template <class>
+struct P300EventGains;
+
+template <size_t... C>
+struct P300EventGains<P300IndexList<C...>>
+{
+    static constexpr int32_t rows[3][sizeof...(C)] = {
+        {p300GainQ(TARGET_EVENT_SCALE, CHANNEL_GAIN[C])...},
+        {p300GainQ(NONTARGET_EVENT_SCALE, CHANNEL_GAIN[C])...},
+        {p300GainQ(DEFAULT_EVENT_SCALE, CHANNEL_GAIN[C])...}};
+};
+
+template <size_t... C>
+constexpr int32_t P300EventGains<P300IndexList<C...>>::rows[3][sizeof...(C)];
+
+typedef P300EventGains<P300MakeIndex<CH_MAX>::type> P300Gains;
+
+static_assert(static_cast<double>(P300_TEMPLATE_MAX_CODE) * P300Gains::rows[P300_EVENT_TARGET][0] < 2147483647.0,
+              "P300 gain overflows int32");
+
+// eventAmplitudeScale() と同じ割り当て
+P300EventKind p300EventKind(uint8_t triggerValue)
+{
+    return triggerValue == 1 ? P300_EVENT_TARGET : (triggerValue == 2 ? P300_EVENT_NONTARGET : P300_EVENT_DEFAULT);
+}
+
+// P300 は 1 カウント (≈5.7µV) より小さいことが多いので、背景と足してから 1 回だけ丸める。
+// 足し合わせは 1/256 カウント単位 (Q8) で行う
+constexpr int COUNTS_FRACTION_BITS = 8;
+
+int16_t countsWithP300(float backgroundUv, int32_t p300Code, int32_t gainQ)
+{
+    const float raw = std::max(-32768.0f, std::min(32767.0f, backgroundUv * MICROVOLT_TO_COUNT));
+    int32_t q = static_cast<int32_t>(::lrintf(raw * (1 << COUNTS_FRACTION_BITS)));
+    q += (p300Code * gainQ + (1 << (P300_GAIN_SHIFT - COUNTS_FRACTION_BITS - 1))) >> (P300_GAIN_SHIFT - COUNTS_FRACTION_BITS);
+    const int32_t counts = (q + (1 << (COUNTS_FRACTION_BITS - 1))) >> COUNTS_FRACTION_BITS;
+    return static_cast<int16_t>(std::max<int32_t>(-32768, std::min<int32_t>(32767, counts)));
+}
+
+} // namespace
+
+int16_t microvoltToCounts(float microvolt)
+{
+    const float raw = microvolt * MICROVOLT_TO_COUNT;
+    const float clamped = std::max(-32768.0f, std::min(32767.0f, raw));
+    return static_cast<int16_t>(::lrintf(clamped));
+}
+
+float eventAmplitudeScale(uint8_t triggerValue)
+{
+    if (triggerValue == 1)
+    {
+        return TARGET_EVENT_SCALE;
+    }
+    if (triggerValue == 2)
+    {
+        return NONTARGET_EVENT_SCALE;
+    }
+    return DEFAULT_EVENT_SCALE;
+}
+
+EegSignalGenerator::EegSignalGenerator(uint64_t seed)
+    : rng_(seed),
+      seed_(seed),
+      ssvepTags_{
+          {7.5f, 3, 750},
+          {8.57f, 3, 750},
+          {10.0f, 3, 750},
+          {12.0f, 3, 750}}
+{
+    reset();
+}
+
+void EegSignalGenerator::reset()
+{
+    sampleIndex_ = 0;
+    p300Active_ = false;
+    p300Cursor_ = 0;
+    currentTriggerValue_ = 0;
+    triggerSamplesRemaining_ = 0;
+    triggerPhase_ = 0;
+    memset(ssvepVoices_, 0, sizeof(ssvepVoices_));
+}
+
+void EegSignalGenerator::reseed(uint64_t seed)
+{
+    seed_ = seed;
+    rng_.reseed(seed);
+}
+
+void EegSignalGenerator::seek(uint64_t sampleIndex)
+{
+    reset();
+    rng_.reseed(seed_);
+    rng_.advance(sampleIndex * CH_MAX);
+    sampleIndex_ = static_cast<uint32_t>(sampleIndex);
+}
+
+void EegSignalGenerator::startStimulusEvent(uint8_t triggerValue, uint8_t phase)
+{
+    const uint8_t value = triggerValue & 0x0F;
+    if (stimulusMode_ == STIM_MODE_SSVEP)
+    {
+        // トリガー値 0 は全タグ停止、1..N は対応するタグの応答を開始
+        if (value == 0)
+        {
+            releaseSsvepVoices();
+        }
+        else
+        {
+            spawnSsvepVoice(ssvepTags_[(value - 1) % SSVEP_MAX_TAGS]);
+        }
+    }
+    else
+    {
+        p300Active_ = true;
+        p300Cursor_ = std::min<std::size_t>(P300_TRIGGER_OFFSET_SAMPLES, P300_CYCLE_SAMPLES - 1);
+        p300Template_.seek(p300Cursor_);
+    }
+    currentTriggerValue_ = value;
+    triggerSamplesRemaining_ = TRIGGER_PULSE_WIDTH_SAMPLES;
+    triggerPhase_ = phase;
+}
+
+void EegSignalGenerator::setStimulusMode(StimulusMode mode)
+{
+    stimulusMode_ = (mode == STIM_MODE_SSVEP) ? STIM_MODE_SSVEP : STIM_MODE_P300;
+    p300Active_ = false;
+    p300Cursor_ = 0;
+    releaseSsvepVoices();
+}
+
+bool EegSignalGenerator::configureSsvepTag(size_t slot, const SsvepTagConfig &cfg)
+{
+    if (slot >= SSVEP_MAX_TAGS || cfg.freqHz <= 0.0f || cfg.freqHz * SSVEP_MAX_HARMONICS >= SAMPLE_RATE_HZ / 2.0f)
+    {
+        return false;
+    }
+    ssvepTags_[slot] = cfg;
+    ssvepTags_[slot].harmonics = static_cast<uint8_t>(std::max<int>(1, std::min<int>(cfg.harmonics, SSVEP_MAX_HARMONICS)));
+    return true;
+}
+
+// 新しい応答を空きボイスに割り当てる (空きがないか上限に達していれば最も古いものを奪う)
+void EegSignalGenerator::spawnSsvepVoice(const SsvepTagConfig &cfg)
+{
+    SsvepVoice *freeSlot = nullptr;
+    SsvepVoice *oldest = nullptr;
+    size_t active = 0;
+    for (size_t i = 0; i < SSVEP_MAX_VOICES; ++i)
+    {
+        SsvepVoice &v = ssvepVoices_[i];
+        if (!v.active)
+        {
+            freeSlot = freeSlot != nullptr ? freeSlot : &v;
+            continue;
+        }
+        active++;
+        if (oldest == nullptr || v.elapsed > oldest->elapsed)
+        {
+            oldest = &v;
+        }
+    }
+    SsvepVoice *slot = (freeSlot != nullptr && active < ssvepVoiceLimit_) ? freeSlot : oldest;
+    const float w = 2.0f * EEG_PI * cfg.freqHz / static_cast<float>(SAMPLE_RATE_HZ);
+    slot->active = true;
+    slot->releasing = false;
+    slot->re = 1.0f;
+    slot->im = 0.0f;
+    slot->stepRe = cosf(w);
+    slot->stepIm = sinf(w);
+    slot->harmonics = cfg.harmonics;
+    slot->elapsed = 0;
+    slot->durationSamples = cfg.durationSamples;
+    slot->releaseElapsed = 0;
+}
+
+void EegSignalGenerator::releaseSsvepVoices()
+{
+    for (size_t i = 0; i < SSVEP_MAX_VOICES; ++i)
+    {
+        ssvepVoices_[i].releasing = ssvepVoices_[i].active;
+    }
+}
+
+// 全ボイスを 1 サンプル進め、チャネル共通の応答振幅 (µV) を返す。
+// 各ボイスは複素回転子で進めるので、周波数ごとの三角関数呼び出しは開始時の 1 回だけ。
+float EegSignalGenerator::advanceSsvepVoices()
+{
+    // 上限が下げられたら、超えた分を古いものから止める
+    while (ssvepVoiceLimit_ < SSVEP_MAX_VOICES)
+    {
+        SsvepVoice *oldest = nullptr;
+        size_t active = 0;
+        for (size_t i = 0; i < SSVEP_MAX_VOICES; ++i)
+        {
+            if (ssvepVoices_[i].active)
+            {
+                active++;
+                oldest = (oldest == nullptr || ssvepVoices_[i].elapsed > oldest->elapsed) ? &ssvepVoices_[i] : oldest;
+            }
+        }
+        if (active <= ssvepVoiceLimit_)
+        {
+            break;
+        }
+        oldest->active = false;
+    }
+
+    float sumUv = 0.0f;
+    for (size_t i = 0; i < SSVEP_MAX_VOICES; ++i)
+    {
+        SsvepVoice &v = ssvepVoices_[i];
+        if (!v.active)
+        {
+            continue;
+        }
+
+        if (!v.releasing && v.durationSamples > 0 && v.elapsed >= v.durationSamples)
+        {
+            v.releasing = true;
+        }
+        float envelope = 1.0f;
+        if (v.releasing)
+        {
+            if (v.releaseElapsed >= SSVEP_RAMP_SAMPLES)
+            {
+                v.active = false;
+                continue;
+            }
+            envelope = 1.0f - static_cast<float>(v.releaseElapsed) / SSVEP_RAMP_SAMPLES;
+            v.releaseElapsed++;
+        }
+        if (v.elapsed < SSVEP_RAMP_SAMPLES)
+        {
+            envelope = std::min(envelope, static_cast<float>(v.elapsed) / SSVEP_RAMP_SAMPLES);
+        }
+
+        // 高調波は基本波回転子のべき乗で求める: z^k = z^(k-1) * z
+        float hRe = v.re;
+        float hIm = v.im;
+        float amplitude = SSVEP_FUNDAMENTAL_UV;
+        float voiceUv = 0.0f;
+        for (uint8_t h = 0; h < v.harmonics; ++h)
+        {
+            voiceUv += amplitude * hIm;
+            const float nextRe = hRe * v.re - hIm * v.im;
+            hIm = hRe * v.im + hIm * v.re;
+            hRe = nextRe;
+            amplitude *= SSVEP_HARMONIC_DECAY;
+        }
+        sumUv += voiceUv * envelope;
+
+        // 回転子を進め、ニュートン法 1 ステップで振幅を 1 に戻す
+        const float re = v.re * v.stepRe - v.im * v.stepIm;
+        const float im = v.re * v.stepIm + v.im * v.stepRe;
+        const float norm = 1.5f - 0.5f * (re * re + im * im);
+        v.re = re * norm;
+        v.im = im * norm;
+        v.elapsed++;
+    }
+    return sumUv;
+}
+
+// ========= ダミーデータ生成 (ADS1299 互換) =========
+void EegSignalGenerator::generate(SampleData &outSample)
+{
+    int32_t p300Code = 0;
+    const bool wasActive = p300Active_;
+
+    if (p300Active_ && p300Cursor_ < P300_CYCLE_SAMPLES)
+    {
+        p300Code = p300Template_.next();
+        p300Cursor_++;
+        if (p300Cursor_ >= P300_CYCLE_SAMPLES)
+        {
+            p300Active_ = false;
+            p300Cursor_ = 0;
+        }
+    }
+    else
+    {
+        p300Active_ = false;
+        p300Cursor_ = 0;
+    }
+
+    const float ssvepUv = advanceSsvepVoices();
+
+    // alpha/beta はともに 1 秒で整数周期なので、位相は 1 秒で折り返して精度を保つ
+    const float timeSec = static_cast<float>(sampleIndex_ % SAMPLE_RATE_HZ) / static_cast<float>(SAMPLE_RATE_HZ);
+    const int32_t *eventGain = wasActive ? P300Gains::rows[p300EventKind(currentTriggerValue_)] : nullptr;
+    if (!backgroundNoise_)
+    {
+        rng_.advance(CH_MAX);
+    }
+
+    for (int ch = 0; ch < CH_MAX; ++ch)
+    {
+        const float gain = CHANNEL_GAIN[ch];
+        const float phase = CHANNEL_PHASE[ch];
+
+        const float alpha = ALPHA_AMPLITUDE_UV * sinf(2.0f * EEG_PI * ALPHA_FREQ_HZ * timeSec + phase);
+        const float beta = BETA_AMPLITUDE_UV * sinf(2.0f * EEG_PI * BETA_FREQ_HZ * timeSec + phase * 0.7f);
+        float channelUv = (alpha + beta) * gain;
+        if (backgroundNoise_)
+        {
+            channelUv += (rng_.nextUniform() * 2.0f - 1.0f) * BACKGROUND_NOISE_UV * gain;
+        }
+        channelUv += ssvepUv * SSVEP_CHANNEL_GAIN[ch];
+        outSample.signals[ch] = eventGain != nullptr ? countsWithP300(channelUv, p300Code, eventGain[ch]) : microvoltToCounts(channelUv);
+    }
+
+    uint8_t triggerState = 0;
+    if (triggerSamplesRemaining_ > 0)
+    {
+        triggerState = static_cast<uint8_t>(currentTriggerValue_ & 0x0F);
+        triggerSamplesRemaining_--;
+    }
+    outSample.trigger_state = triggerState;
+
+    outSample.reserved[0] = triggerState;
+    outSample.reserved[1] = triggerState ? 0xA5 : 0x00;
+    outSample.reserved[2] = triggerPhase_;
+    triggerPhase_ = 0;
+
+    // SSVEP モードでは P300 再生がなくてもパルス幅の間はトリガー値を保持する
+    if (!p300Active_ && triggerSamplesRemaining_ == 0)
+    {
+        currentTriggerValue_ = 0;
+    }
+    sampleIndex_++;
+}
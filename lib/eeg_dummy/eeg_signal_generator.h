@@ -0,0 +1,159 @@
+// ADS1299 互換ダミー EEG 信号の生成器 (ファームウェア / ホストツール共通)
+//
+// 排他制御は持たない。ファームウェアでは BLE コールバックからのコマンドを
+// メインループ側でまとめて適用し、生成と同じコンテキストからのみ呼び出す。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_p300_template.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+
+// ========= P300 波形再生用の設定 =========
+constexpr float ADS1299_VREF = 4.5f;
+constexpr float ADS1299_GAIN = 24.0f;
+constexpr float ADC_MAX_COUNTS = 32768.0f;                                                     // using 16-bit signed dummy output
+constexpr float MICROVOLT_PER_COUNT = (ADS1299_VREF / ADS1299_GAIN) / ADC_MAX_COUNTS * 1.0e6f; // ≈5.72µV
+constexpr float MICROVOLT_TO_COUNT = 1.0f / MICROVOLT_PER_COUNT;
+constexpr size_t TRIGGER_PULSE_WIDTH_SAMPLES = 6; // ≒24ms
+constexpr float BACKGROUND_NOISE_UV = 1.2f;
+constexpr float TARGET_EVENT_SCALE = 1.0f;
+constexpr float NONTARGET_EVENT_SCALE = 0.10f;
+constexpr float DEFAULT_EVENT_SCALE = 0.05f;
+constexpr float CHANNEL_GAIN[CH_MAX] = {1.0f, 0.65f, 0.55f, 0.5f, 0.45f, 0.4f, 0.35f, 0.3f};
+constexpr float CHANNEL_PHASE[CH_MAX] = {0.0f, 0.7f, 1.4f, 2.1f, 0.5f, 1.2f, 1.9f, 2.6f};
+constexpr float ALPHA_FREQ_HZ = 10.0f;
+constexpr float BETA_FREQ_HZ = 20.0f;
+constexpr float ALPHA_AMPLITUDE_UV = 8.0f;
+constexpr float BETA_AMPLITUDE_UV = 3.0f;
+constexpr float EEG_PI = 3.14159265358979f;
+
+// ========= SSVEP (周波数タグ) 応答の設定 =========
+enum StimulusMode : uint8_t
+{
+    STIM_MODE_P300 = 0,
+    STIM_MODE_SSVEP = 1,
+};
+
+constexpr size_t SSVEP_MAX_TAGS = 4;      // トリガー値 1..4 がタグ 0..3 に対応
+constexpr size_t SSVEP_MAX_VOICES = 8;    // 同時に鳴らせる応答数
+constexpr size_t SSVEP_MAX_HARMONICS = 4; // 基本波を含む
+constexpr size_t SSVEP_RAMP_SAMPLES = 50; // 200ms の onset/offset ランプ
+constexpr float SSVEP_FUNDAMENTAL_UV = 4.0f;
+constexpr float SSVEP_HARMONIC_DECAY = 0.5f; // 高調波ごとの振幅比
+constexpr float SSVEP_CHANNEL_GAIN[CH_MAX] = {0.15f, 0.15f, 0.3f, 0.3f, 0.6f, 0.6f, 1.0f, 1.0f}; // 後頭部優位
+
+struct SsvepTagConfig
+{
+    float freqHz;
+    uint8_t harmonics;        // 1..SSVEP_MAX_HARMONICS
+    uint32_t durationSamples; // 0 = 停止まで継続
+};
+
+struct SsvepVoice
+{
+    bool active;
+    bool releasing;
+    float re; // 基本波の回転子 (cos)
+    float im; // 基本波の回転子 (sin)
+    float stepRe;
+    float stepIm;
+    uint8_t harmonics;
+    uint32_t elapsed;
+    uint32_t durationSamples;
+    uint32_t releaseElapsed;
+};
+
+int16_t microvoltToCounts(float microvolt);
+float eventAmplitudeScale(uint8_t triggerValue);
+
+class EegSignalGenerator
+{
+public:
+    explicit EegSignalGenerator(uint64_t seed = 1);
+
+    // 刺激再生状態とサンプルクロックを初期化する (乱数系列はそのまま続ける)
+    void reset();
+    void reseed(uint64_t seed);
+
+    // 状態を初期化し、サンプルクロックとノイズ系列を sampleIndex の位置へ合わせる。
+    // 1 サンプルあたりの乱数消費は CH_MAX 個で一定なので、途中からでも同じ系列になる。
+    void seek(uint64_t sampleIndex);
+
+    // phase: トリガーを載せる最初のサンプルの reserved[2] に出す値 (外部トリガーのサンプル内位置, eeg_trigger_input.h)
+    void startStimulusEvent(uint8_t triggerValue, uint8_t phase = 0);
+    void setStimulusMode(StimulusMode mode);
+    StimulusMode stimulusMode() const { return stimulusMode_; }
+    bool configureSsvepTag(size_t slot, const SsvepTagConfig &cfg);
+    const SsvepTagConfig &ssvepTag(size_t slot) const { return ssvepTags_[slot]; }
+
+    // 処理が間に合わないときの切り下げ用 (eeg_deadline_monitor.h)。
+    // ノイズを止めても乱数は同じ数だけ進めるので、seek() の位置関係は変わらない
+    void setBackgroundNoise(bool enabled) { backgroundNoise_ = enabled; }
+    // 同時に鳴らす SSVEP 応答の上限。超えた分は古いものから止める
+    void setSsvepVoiceLimit(size_t voices) { ssvepVoiceLimit_ = voices < 1 ? 1 : (voices > SSVEP_MAX_VOICES ? SSVEP_MAX_VOICES : voices); }
+
+    // 1 サンプル生成してサンプルクロックを進める
+    void generate(SampleData &outSample);
+    uint32_t sampleIndex() const { return sampleIndex_; }
+
+private:
+    void spawnSsvepVoice(const SsvepTagConfig &cfg);
+    void releaseSsvepVoices();
+    float advanceSsvepVoices();
+
+    Pcg32 rng_;
+    uint64_t seed_;
+    uint32_t sampleIndex_ = 0;
+
+    bool p300Active_ = false;
+    size_t p300Cursor_ = 0;
+    P300TemplateReader p300Template_;
+    uint8_t currentTriggerValue_ = 0;
+    size_t triggerSamplesRemaining_ = 0;
+    uint8_t triggerPhase_ = 0;
+
+    StimulusMode stimulusMode_ = STIM_MODE_P300;
+    SsvepTagConfig ssvepTags_[SSVEP_MAX_TAGS];
+    SsvepVoice ssvepVoices_[SSVEP_MAX_VOICES];
+
+    bool backgroundNoise_ = true;
+    size_t ssvepVoiceLimit_ = SSVEP_MAX_VOICES;
+};
+
+// SampleData を ChunkedSamplePacket にまとめる
+class ChunkPacketizer
+{
+public:
+    void reset(uint16_t startIndex = 0)
+    {
+        fill_ = 0;
+        nextIndex_ = startIndex;
+    }
+
+    // 1 サンプル追加し、チャンクが埋まったら true を返す (packet() が有効になる)
+    bool push(const SampleData &sample)
+    {
+        packet_.samples[fill_++] = sample;
+        nextIndex_++;
+        if (fill_ < SAMPLES_PER_CHUNK)
+        {
+            return false;
+        }
+        packet_.packet_type = PKT_TYPE_DATA_CHUNK;
+        packet_.start_index = static_cast<uint16_t>(nextIndex_ - SAMPLES_PER_CHUNK);
+        packet_.num_samples = SAMPLES_PER_CHUNK;
+        fill_ = 0;
+        return true;
+    }
+
+    const ChunkedSamplePacket &packet() const { return packet_; }
+    size_t pending() const { return fill_; }
+
+private:
+    ChunkedSamplePacket packet_{};
+    size_t fill_ = 0;
+    uint16_t nextIndex_ = 0;
+};
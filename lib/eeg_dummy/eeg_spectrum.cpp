@@ -0,0 +1,120 @@
+#include "eeg_spectrum.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+
+// |X/N| (1 count = 2^15) から正弦波振幅 (Hann の平均 0.5 なので 4|X/N|) の dB へ: -20log10(2^15 / 4)
+constexpr float SPECTRUM_Q31_TO_DB = -78.2678f;
+
+} // namespace
+
+bool SpectrumAnalyzer::configure(uint8_t fftLog2, uint8_t channelMask, uint8_t overlap, uint8_t maxHz)
+{
+    fftLog2_ = 0;
+    if (fftLog2 < FFT_MIN_LOG2 || fftLog2 > FFT_MAX_LOG2 || channelMask == 0 || overlap > 2 || maxHz * 2 >= SAMPLE_RATE_HZ)
+    {
+        return false;
+    }
+    channels_ = 0;
+    for (uint8_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        if (channelMask & (1u << ch))
+        {
+            channelIndex_[channels_++] = ch;
+        }
+    }
+    const size_t n = size_t(1) << fftLog2;
+    hop_ = n >> overlap;
+    size_t bins = n / 2;
+    if (maxHz > 0)
+    {
+        const size_t limit = static_cast<size_t>(maxHz) * n / SAMPLE_RATE_HZ + 1;
+        bins = limit < bins ? limit : bins;
+    }
+    bins_ = bins < SPECTRUM_MAX_BINS ? bins : SPECTRUM_MAX_BINS;
+    ringSize_ = n + channels_;
+    fftLog2_ = fftLog2;
+
+    packet_.packet_type = PKT_TYPE_SPECTRUM;
+    packet_.fft_log2 = fftLog2;
+    packet_.num_bins = static_cast<uint8_t>(bins_);
+    reset();
+    return true;
+}
+
+void SpectrumAnalyzer::reset()
+{
+    memset(ring_, 0, sizeof(ring_));
+    writePos_ = 0;
+    filled_ = 0;
+    sinceBlock_ = 0;
+    blockEnd_ = 0;
+    nextChannel_ = channels_;
+    frameIndex_ = 0;
+}
+
+bool SpectrumAnalyzer::push(const int16_t *signals)
+{
+    if (fftLog2_ == 0)
+    {
+        return false;
+    }
+    for (size_t c = 0; c < channels_; ++c)
+    {
+        ring_[c][writePos_] = signals[channelIndex_[c]];
+    }
+    writePos_ = writePos_ + 1 == ringSize_ ? 0 : writePos_ + 1;
+
+    bool due = false;
+    if (filled_ < fftSize())
+    {
+        due = ++filled_ == fftSize();
+    }
+    else if (++sinceBlock_ == hop_)
+    {
+        due = true;
+    }
+    if (due)
+    {
+        // hop >= 16 > チャンネル数なので、前のブロックは必ず計算し終わっている
+        sinceBlock_ = 0;
+        blockEnd_ = writePos_;
+        nextChannel_ = 0;
+        packet_.frame_index = frameIndex_++;
+    }
+    if (nextChannel_ >= channels_)
+    {
+        return false;
+    }
+    computeChannel(nextChannel_++);
+    return true;
+}
+
+void SpectrumAnalyzer::computeChannel(size_t c)
+{
+    const size_t n = fftSize();
+    const int16_t *ring = ring_[c];
+    size_t pos = blockEnd_ >= n ? blockEnd_ - n : blockEnd_ + ringSize_ - n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        // Q31 の 1/2 スケール (x << 15) にして FFT の桁あふれを避ける
+        const int64_t x = static_cast<int64_t>(ring[pos]) << 15;
+        work_[i] = static_cast<int32_t>((x * fftHannQ31(i, fftLog2_)) >> 31);
+        pos = pos + 1 == ringSize_ ? 0 : pos + 1;
+    }
+    fftRealQ31(work_, fftLog2_);
+
+    packet_.channel = channelIndex_[c];
+    for (size_t k = 0; k < bins_; ++k)
+    {
+        const float re = static_cast<float>(work_[2 * k]);
+        const float im = k == 0 ? 0.0f : static_cast<float>(work_[2 * k + 1]);
+        const float power = re * re + im * im;
+        const float db = power > 0.0f ? 10.0f * log10f(power) + SPECTRUM_Q31_TO_DB : -SPECTRUM_DB_OFFSET;
+        const float q = (db + SPECTRUM_DB_OFFSET) * 2.0f + 0.5f;
+        packet_.magnitude[k] = static_cast<uint8_t>(q <= 0.0f ? 0 : (q >= 255.0f ? 255 : static_cast<int>(q)));
+    }
+}
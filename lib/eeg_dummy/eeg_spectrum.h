@@ -0,0 +1,56 @@
+// 窓付き実 FFT による対数振幅スペクトル (固定小数点, eeg_fft.h)
+//
+// 選んだチャンネルの直近 N サンプルを保持し、hop サンプルごとに Hann 窓を掛けて FFT する。
+// 1 回の push() で FFT は高々 1 チャンネル分だけ行い、ブロックの計算を次のサンプル以降へ分散させる
+// (そのためリングはチャンネル数ぶん長く持つ)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_fft.h"
+#include "eeg_protocol.h"
+
+class SpectrumAnalyzer
+{
+public:
+    // fftLog2 は FFT_MIN_LOG2..FFT_MAX_LOG2、overlap は 0/1/2 (hop = N, N/2, N/4)、
+    // maxHz は 0 (全 bin) または 1..124。不正なら false で無効のまま
+    bool configure(uint8_t fftLog2, uint8_t channelMask, uint8_t overlap, uint8_t maxHz);
+    void disable() { fftLog2_ = 0; }
+    void reset();
+
+    // 1 サンプル入力する。このサンプルで 1 チャンネル分のスペクトルを計算したら true (packet() が有効)
+    bool push(const int16_t *signals);
+
+    bool enabled() const { return fftLog2_ != 0; }
+    size_t fftSize() const { return size_t(1) << fftLog2_; }
+    size_t hop() const { return hop_; }
+    size_t channels() const { return channels_; }
+    size_t bins() const { return bins_; }
+    const SpectrumPacket &packet() const { return packet_; }
+    size_t packetSize() const { return SPECTRUM_PACKET_HEADER_BYTES + bins_; }
+
+private:
+    static constexpr size_t RING_SIZE = FFT_MAX_SIZE + CH_MAX;
+
+    void computeChannel(size_t c);
+
+    uint8_t fftLog2_ = 0;
+    uint8_t channelIndex_[CH_MAX] = {};
+    size_t channels_ = 0;
+    size_t hop_ = 0;
+    size_t bins_ = 0;
+    size_t ringSize_ = 0;
+
+    size_t writePos_ = 0;
+    size_t filled_ = 0;
+    size_t sinceBlock_ = 0;
+    size_t blockEnd_ = 0;     // ブロック最後のサンプルの次の位置
+    size_t nextChannel_ = 0;  // 計算待ちの先頭 (channels_ なら待ちなし)
+    uint16_t frameIndex_ = 0;
+
+    int16_t ring_[CH_MAX][RING_SIZE] = {};
+    int32_t work_[FFT_MAX_SIZE] = {};
+    SpectrumPacket packet_{};
+};
@@ -0,0 +1,50 @@
+// ストリームのローリングダイジェスト (送信側 / 受信側で共通)
+//
+// チャンクパケットを送った順に CRC-32C で畳み込むだけなので、状態は 8 バイトで一定。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_crc.h"
+#include "eeg_protocol.h"
+
+class StreamDigest
+{
+public:
+    void reset()
+    {
+        digest_ = 0;
+        chunks_ = 0;
+    }
+
+    // 受信側が途中から検証を始めるときに送信側の値へ合わせる
+    void assign(uint32_t digest, uint32_t chunks)
+    {
+        digest_ = digest;
+        chunks_ = chunks;
+    }
+
+    // チャンクパケット 1 つぶんのバイト列 (トレーラを除く) を畳み込む
+    void update(const void *packet, size_t size)
+    {
+        digest_ = crc32c(packet, size, digest_);
+        chunks_++;
+    }
+
+    void fill(StreamDigestPacket &out, uint16_t lastStartIndex) const
+    {
+        out.packet_type = PKT_TYPE_STREAM_DIGEST;
+        out.version = 1;
+        out.start_index = lastStartIndex;
+        out.chunk_count = chunks_;
+        out.digest = digest_;
+    }
+
+    uint32_t digest() const { return digest_; }
+    uint32_t chunks() const { return chunks_; }
+
+private:
+    uint32_t digest_ = 0;
+    uint32_t chunks_ = 0;
+};
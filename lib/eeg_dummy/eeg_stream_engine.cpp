@@ -0,0 +1,152 @@
+#include "eeg_stream_engine.h"
+
+#include <string.h>
+
+void DummyStreamEngine::startSession(uint32_t sessionSeed)
+{
+    if (sessionActive_)
+    {
+        stopSession();
+    }
+    // 刺激モードや SSVEP タグ設定も既定値に戻し、セッション単体で再生できるようにする
+    generator_ = EegSignalGenerator(sessionSeed);
+    packetizer_.reset(0);
+    filter_.disable();
+    filterBypass_ = false;
+    digest_.reset();
+    sessionActive_ = true;
+    sessionSeed_ = sessionSeed;
+
+    const uint8_t seedBytes[4] = {
+        static_cast<uint8_t>(sessionSeed),
+        static_cast<uint8_t>(sessionSeed >> 8),
+        static_cast<uint8_t>(sessionSeed >> 16),
+        static_cast<uint8_t>(sessionSeed >> 24)};
+    logCommand(CMD_START_STREAMING, seedBytes, sizeof(seedBytes));
+}
+
+void DummyStreamEngine::stopSession()
+{
+    if (!sessionActive_)
+    {
+        return;
+    }
+    logCommand(CMD_STOP_STREAMING, nullptr, 0);
+    sessionActive_ = false;
+}
+
+void DummyStreamEngine::fillConfigPacket(DeviceConfigPacket &out, bool crc) const
+{
+    out.packet_type = PKT_TYPE_DEVICE_CFG;
+    out.num_channels = CH_MAX; // 8ch のダミーデバイスとして通知
+    out.flags = (crc ? DEVICE_CFG_FLAG_CRC32C : 0) | DEVICE_CFG_FLAG_SESSION_TOKEN;
+    memset(out.reserved, 0, sizeof(out.reserved));
+    out.reserved[0] = static_cast<uint8_t>(sessionSeed_);
+    out.reserved[1] = static_cast<uint8_t>(sessionSeed_ >> 8);
+    out.reserved[2] = static_cast<uint8_t>(sessionSeed_ >> 16);
+    out.reserved[3] = static_cast<uint8_t>(sessionSeed_ >> 24);
+    memcpy(out.configs, DEFAULT_ELECTRODES, sizeof(DEFAULT_ELECTRODES));
+}
+
+bool DummyStreamEngine::applyCommand(const uint8_t *bytes, size_t length)
+{
+    if (length == 0)
+    {
+        return false;
+    }
+    const uint8_t cmd = bytes[0];
+    if (cmd == CMD_TRIGGER_PULSE)
+    {
+        generator_.startStimulusEvent(length >= 2 ? bytes[1] : 1, length >= 3 ? bytes[2] : 0);
+    }
+    else if (cmd == CMD_SET_STIM_MODE)
+    {
+        generator_.setStimulusMode((length >= 2 && bytes[1] == STIM_MODE_SSVEP) ? STIM_MODE_SSVEP : STIM_MODE_P300);
+    }
+    else if (cmd == CMD_SSVEP_CONFIG)
+    {
+        if (length < 7)
+        {
+            return false;
+        }
+        const uint16_t freqCentiHz = bytes[2] | (bytes[3] << 8);
+        const uint16_t durationMs = bytes[5] | (bytes[6] << 8);
+        SsvepTagConfig cfg;
+        cfg.freqHz = freqCentiHz / 100.0f;
+        cfg.harmonics = bytes[4];
+        cfg.durationSamples = static_cast<uint32_t>(durationMs) * SAMPLE_RATE_HZ / 1000u;
+        if (!generator_.configureSsvepTag(bytes[1], cfg))
+        {
+            return false;
+        }
+    }
+    else if (cmd == CMD_SET_FILTER)
+    {
+        if (length < 6)
+        {
+            return false;
+        }
+        FilterSpec spec;
+        spec.notchHz = bytes[1];
+        spec.highpassCentiHz = bytes[2] | (bytes[3] << 8);
+        spec.lowpassHz = bytes[4];
+        spec.notchHarmonics = bytes[5];
+        if (!filter_.configure(spec))
+        {
+            return false;
+        }
+    }
+    else if (cmd == CMD_SET_QUALITY)
+    {
+        if (length < 2 || bytes[1] > DEGRADE_MAX)
+        {
+            return false;
+        }
+        const uint8_t level = bytes[1];
+        generator_.setBackgroundNoise(level < DEGRADE_NO_NOISE);
+        setFilterBypass(level >= DEGRADE_NO_FILTER);
+        generator_.setSsvepVoiceLimit(level >= DEGRADE_FEW_VOICES ? DEGRADED_SSVEP_VOICES : SSVEP_MAX_VOICES);
+    }
+    else
+    {
+        return false;
+    }
+    logCommand(cmd, bytes + 1, length - 1);
+    return true;
+}
+
+void DummyStreamEngine::setFilterBypass(bool bypass)
+{
+    if (filterBypass_ && !bypass)
+    {
+        filter_.reset();
+    }
+    filterBypass_ = bypass;
+}
+
+bool DummyStreamEngine::step()
+{
+    generator_.generate(lastSample_);
+    if (filter_.enabled() && !filterBypass_)
+    {
+        // SampleData は packed なのでメンバへのポインタを渡さずコピーして処理する
+        int16_t signals[CH_MAX];
+        memcpy(signals, lastSample_.signals, sizeof(signals));
+        filter_.process(signals);
+        memcpy(lastSample_.signals, signals, sizeof(signals));
+    }
+    if (!packetizer_.push(lastSample_))
+    {
+        return false;
+    }
+    digest_.update(&packetizer_.packet(), sizeof(ChunkedSamplePacket));
+    return true;
+}
+
+void DummyStreamEngine::logCommand(uint8_t cmd, const uint8_t *payload, size_t length)
+{
+    if (log_ != nullptr)
+    {
+        log_->record(generator_.sampleIndex(), cmd, payload, length);
+    }
+}
@@ -0,0 +1,63 @@
+// ストリーミングセッションの進行 (コマンド適用 → サンプル生成 → チャンク化)
+//
+// ファームウェアとホストシミュレータが同じ手順でコマンドを適用するための共通部。
+// コマンドは常に「次のサンプルを生成する直前」に適用され、その位置を CommandLog に残す。
+// セッション開始時に生成器を sessionSeed で初期化するので、セッションごとに独立して再生できる。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_biquad.h"
+#include "eeg_command_log.h"
+#include "eeg_deadline_monitor.h"
+#include "eeg_protocol.h"
+#include "eeg_signal_generator.h"
+#include "eeg_stream_digest.h"
+
+class DummyStreamEngine
+{
+public:
+    explicit DummyStreamEngine(CommandLog *log = nullptr) : log_(log) {}
+
+    // 新しいセッションを始める。前のセッションが続いていれば先に終了を記録する
+    void startSession(uint32_t sessionSeed);
+    void stopSession();
+    bool sessionActive() const { return sessionActive_; }
+    uint32_t sessionSeed() const { return sessionSeed_; }
+    // セッション開始時の設定パケット。セッショントークン (= seed) を載せ、crc なら以降の CRC トレーラを予告する
+    void fillConfigPacket(DeviceConfigPacket &out, bool crc) const;
+
+    // 刺激系コマンド (CMD_TRIGGER_PULSE / CMD_SET_STIM_MODE / CMD_SSVEP_CONFIG) と
+    // ストリームに効くフィルタ設定 (CMD_SET_FILTER)、品質の段階 (CMD_SET_QUALITY) を適用する。
+    // bytes[0] がコマンド。受理したら true
+    bool applyCommand(const uint8_t *bytes, size_t length);
+
+    // 1 サンプル生成し (フィルタが有効なら通して) チャンクに積む。チャンクが埋まったら true (packet() が有効)
+    bool step();
+    const ChunkedSamplePacket &packet() const { return packetizer_.packet(); }
+    const SampleData &lastSample() const { return lastSample_; }
+    // セッション開始から step() で完成した全チャンクのダイジェスト
+    const StreamDigest &digest() const { return digest_; }
+
+    uint32_t sampleIndex() const { return generator_.sampleIndex(); }
+    EegSignalGenerator &generator() { return generator_; }
+    const BiquadChain &filter() const { return filter_; }
+    bool filterBypassed() const { return filterBypass_; }
+    CommandLog *log() const { return log_; }
+
+private:
+    void logCommand(uint8_t cmd, const uint8_t *payload, size_t length);
+    // 処理が間に合わないときにフィルタを素通しにする (設定は残す)。戻すときは状態を 0 からやり直す
+    void setFilterBypass(bool bypass);
+
+    EegSignalGenerator generator_;
+    ChunkPacketizer packetizer_;
+    BiquadChain filter_;
+    StreamDigest digest_;
+    SampleData lastSample_{};
+    CommandLog *log_;
+    bool sessionActive_ = false;
+    uint32_t sessionSeed_ = 0;
+    bool filterBypass_ = false;
+};
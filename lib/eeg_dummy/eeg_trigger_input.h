@@ -0,0 +1,105 @@
+// 外部トリガー入力 (GPIO のエッジ) をサンプルクロック上の位置に直して注入する
+//
+// エッジの時刻は「それまでにキューへ積まれたサンプル tick の数」と「直前の tick からの位相 (Q32)」で表す。
+// tick 数が n のときのエッジは、n 番目 (0 始まり) に生成されるサンプル、つまりエッジ以降で最初のサンプルに載せる。
+// 位相は 1/256 サンプル単位に丸めて CMD_TRIGGER_PULSE の 3 バイト目に入れ、そのサンプルの reserved[2] に出す
+// (エッジの時刻 = 印を付けたサンプル - 1 + phase/256)。
+//
+// ファームウェアでは割り込みで stamp して積み、メインループがサンプルを生成する直前に取り出す。
+// ホストでは src/host/trigger_sim.cpp がファイルやソケットからのエッジで同じ経路を通す。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+
+constexpr size_t TRIGGER_EDGE_QUEUE_LEN = 16;
+// パルス幅より短い間隔の再エッジ (チャタリング) は捨てる
+constexpr uint32_t TRIGGER_EDGE_HOLDOFF_TICKS = 6;
+
+struct TriggerEdge
+{
+    uint32_t tick;  // エッジまでに積まれたサンプル tick 数 = 印を付けるサンプルの tick 番号
+    uint8_t phase;  // 直前の tick からの位相 (1/256 サンプル)
+    uint8_t value;  // trigger_state に出す値 (1..15)
+};
+
+// 位相 (Q32) を 1/256 サンプルに丸める。繰り上がって 1 サンプルになるときは次の tick の 0 とする
+inline TriggerEdge stampTriggerEdge(uint32_t ticks, uint32_t phaseQ32, uint8_t value)
+{
+    TriggerEdge edge;
+    const uint32_t rounded = (phaseQ32 >> 24) + ((phaseQ32 >> 23) & 1u);
+    edge.tick = rounded >= 256 ? ticks + 1 : ticks;
+    edge.phase = static_cast<uint8_t>(rounded & 0xFF);
+    edge.value = value;
+    return edge;
+}
+
+// 割り込み → メインループの固定長キュー。排他は呼び出し側が持つ (ファームウェアでは portMUX)
+class TriggerEdgeQueue
+{
+public:
+    void clear()
+    {
+        head_ = 0;
+        count_ = 0;
+        lastTick_ = 0;
+        haveLast_ = false;
+    }
+
+    // 受理したら true。満杯とチャタリングは捨てて数える
+    bool push(const TriggerEdge &edge)
+    {
+        if (haveLast_ && edge.tick - lastTick_ < TRIGGER_EDGE_HOLDOFF_TICKS)
+        {
+            bounced_++;
+            return false;
+        }
+        if (count_ == TRIGGER_EDGE_QUEUE_LEN)
+        {
+            overflowed_++;
+            return false;
+        }
+        edges_[(head_ + count_) % TRIGGER_EDGE_QUEUE_LEN] = edge;
+        count_++;
+        lastTick_ = edge.tick;
+        haveLast_ = true;
+        return true;
+    }
+
+    // tick 番号 consumedTick のサンプルを生成する直前に呼ぶ。載せるエッジがあれば取り出して true
+    bool popDue(uint32_t consumedTick, TriggerEdge &out)
+    {
+        if (count_ == 0 || static_cast<int32_t>(edges_[head_].tick - consumedTick) > 0)
+        {
+            return false;
+        }
+        out = edges_[head_];
+        head_ = (head_ + 1) % TRIGGER_EDGE_QUEUE_LEN;
+        count_--;
+        return true;
+    }
+
+    size_t size() const { return count_; }
+    uint32_t bounced() const { return bounced_; }
+    uint32_t overflowed() const { return overflowed_; }
+
+private:
+    TriggerEdge edges_[TRIGGER_EDGE_QUEUE_LEN];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint32_t lastTick_ = 0;
+    bool haveLast_ = false;
+    uint32_t bounced_ = 0;
+    uint32_t overflowed_ = 0;
+};
+
+// エッジを CMD_TRIGGER_PULSE [value][phase] にする (エンジンに通すとコマンドログにも残り、再生で同じになる)
+inline size_t triggerEdgeCommand(const TriggerEdge &edge, uint8_t (&bytes)[3])
+{
+    bytes[0] = CMD_TRIGGER_PULSE;
+    bytes[1] = edge.value;
+    bytes[2] = edge.phase;
+    return sizeof(bytes);
+}
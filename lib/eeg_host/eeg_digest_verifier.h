@@ -0,0 +1,75 @@
+// ストリームダイジェスト (0xD6) の逐次検証
+//
+// 受信したチャンクを送信側と同じ順に畳み込み、チェックポイントごとに比較する。
+// 比較後は送信側の値に合わせ直すので、不一致は区間ごとに独立して数えられ、
+// 何時間のセッションでも状態は一定 (数十バイト)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_protocol.h"
+#include "eeg_stream_digest.h"
+
+class StreamDigestVerifier
+{
+public:
+    // 設定パケット (= セッション開始) を受けたら呼ぶ
+    void startSession()
+    {
+        local_.reset();
+        checkpointChunks_ = 0;
+        synced_ = true;
+    }
+
+    void onChunk(const uint8_t *data, size_t size) { local_.update(data, size); }
+
+    // 一致すれば true。セッションの途中から受信した場合、最初のチェックポイントは合わせるだけ
+    bool onCheckpoint(const StreamDigestPacket &packet)
+    {
+        checkpoints_++;
+        bool ok = true;
+        if (!synced_)
+        {
+            unverified_++;
+        }
+        else if (packet.chunk_count != local_.chunks() || packet.digest != local_.digest())
+        {
+            ok = false;
+            mismatches_++;
+            if (packet.chunk_count > local_.chunks())
+            {
+                missingChunks_ += packet.chunk_count - local_.chunks();
+            }
+        }
+        else
+        {
+            verified_++;
+            verifiedChunks_ += packet.chunk_count - checkpointChunks_;
+        }
+        local_.assign(packet.digest, packet.chunk_count);
+        checkpointChunks_ = packet.chunk_count;
+        synced_ = true;
+        return ok;
+    }
+
+    uint64_t checkpoints() const { return checkpoints_; }
+    uint64_t verified() const { return verified_; }
+    uint64_t mismatches() const { return mismatches_; }
+    uint64_t unverified() const { return unverified_; }
+    uint64_t verifiedChunks() const { return verifiedChunks_; }
+    uint64_t missingChunks() const { return missingChunks_; }
+    // 最後のチェックポイント以降に受けた (まだ検証されていない) チャンク数
+    uint32_t pendingChunks() const { return local_.chunks() - checkpointChunks_; }
+
+private:
+    StreamDigest local_;
+    uint32_t checkpointChunks_ = 0;
+    bool synced_ = false;
+    uint64_t checkpoints_ = 0;
+    uint64_t verified_ = 0;
+    uint64_t mismatches_ = 0;
+    uint64_t unverified_ = 0;
+    uint64_t verifiedChunks_ = 0;
+    uint64_t missingChunks_ = 0;
+};
@@ -0,0 +1,558 @@
+#include "eeg_ingest_pipeline.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "eeg_host_clock.h"
+
+namespace
+{
+
+// 空振りが続いたら段階的に休む (スピン → yield → 短い sleep)
+void backoff(size_t idleRounds)
+{
+    if (idleRounds < 64)
+    {
+        return;
+    }
+    if (idleRounds < 256)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+uint64_t xorshift(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+} // namespace
+
+// ========= LatencyHistogram =========
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns < (uint64_t(1) << SUB_BITS))
+    {
+        return static_cast<size_t>(ns);
+    }
+    const size_t msb = 63 - __builtin_clzll(ns);
+    const size_t sub = static_cast<size_t>((ns >> (msb - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+    return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+int64_t LatencyHistogram::upperBound(size_t bucket)
+{
+    if (bucket < (size_t(1) << SUB_BITS))
+    {
+        return static_cast<int64_t>(bucket);
+    }
+    const size_t msb = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    const uint64_t sub = bucket & ((1u << SUB_BITS) - 1);
+    return static_cast<int64_t>(((uint64_t(1) << SUB_BITS) + sub + 1) << (msb - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::add(int64_t ns)
+{
+    const uint64_t v = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    buckets_[std::min(bucketOf(v), BUCKETS - 1)]++;
+    count_++;
+    max_ = ns > max_ ? ns : max_;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+}
+
+int64_t LatencyHistogram::quantile(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(q * count_ + 0.5);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets_[i];
+        if (seen >= std::max<uint64_t>(rank, 1))
+        {
+            return std::min(upperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+void IngestCounters::add(const IngestCounters &o)
+{
+    datagrams += o.datagrams;
+    packets += o.packets;
+    blocks += o.blocks;
+    samples += o.samples;
+    configPackets += o.configPackets;
+    otherPackets += o.otherPackets;
+    crcErrors += o.crcErrors;
+    resyncs += o.resyncs;
+    gaps += o.gaps;
+    missingSamples += o.missingSamples;
+    tasks += o.tasks;
+    steals += o.steals;
+    for (size_t s = 0; s < INGEST_MAX_SINKS; ++s)
+    {
+        sinkStalls[s] += o.sinkStalls[s];
+    }
+}
+
+// ========= Device (ワーカーのスレッドで呼ばれる) =========
+IngestPipeline::Device::Device(size_t inboundDepth) : inbound(inboundDepth), framer(*this) {}
+
+void IngestPipeline::Device::onResync(size_t skippedBytes)
+{
+    (void)skippedBytes;
+    worker->counters.resyncs++;
+}
+
+void IngestPipeline::Device::onCrcError(uint8_t type)
+{
+    (void)type;
+    worker->counters.crcErrors++;
+}
+
+void IngestPipeline::Device::onPacket(uint8_t type, const uint8_t *data, size_t size)
+{
+    IngestCounters &counters = worker->counters;
+    counters.packets++;
+    if (type == PKT_TYPE_DEVICE_CFG)
+    {
+        // 新しいセッション: インデックスとフィルタ状態を捨てる
+        counters.configPackets++;
+        haveIndex = false;
+        filter.reset();
+        return;
+    }
+    if (type != PKT_TYPE_DATA_CHUNK || size != sizeof(ChunkedSamplePacket))
+    {
+        counters.otherPackets++;
+        return;
+    }
+
+    ChunkedSamplePacket chunk;
+    memcpy(&chunk, data, sizeof(chunk));
+    const size_t frames = std::min<size_t>(chunk.num_samples, SAMPLES_PER_CHUNK);
+    IngestBlock block;
+    block.device = id;
+    block.startIndex = chunk.start_index;
+    block.frames = static_cast<uint8_t>(frames);
+    block.gapBefore = haveIndex && chunk.start_index != expectedIndex;
+    if (block.gapBefore)
+    {
+        counters.gaps++;
+        const uint16_t ahead = static_cast<uint16_t>(chunk.start_index - expectedIndex);
+        counters.missingSamples += ahead < 0x8000 ? ahead : 0;
+    }
+    haveIndex = true;
+    expectedIndex = static_cast<uint16_t>(chunk.start_index + frames);
+    for (size_t i = 0; i < frames; ++i)
+    {
+        memcpy(block.samples + i * CH_MAX, chunk.samples[i].signals, CH_MAX * sizeof(int16_t));
+        block.triggers[i] = chunk.samples[i].trigger_state;
+    }
+    block.recvNs = current->recvNs;
+    block.workerNs = workerNs;
+    block.decodedNs = monotonicNs();
+    if (filter.enabled())
+    {
+        for (size_t i = 0; i < frames; ++i)
+        {
+            filter.process(block.samples + i * CH_MAX);
+        }
+    }
+    block.filteredNs = filter.enabled() ? monotonicNs() : block.decodedNs;
+    worker->stages[INGEST_STAGE_DECODE].add(block.decodedNs - workerNs);
+    if (filter.enabled())
+    {
+        worker->stages[INGEST_STAGE_FILTER].add(block.filteredNs - block.decodedNs);
+    }
+
+    // 空きは runDevice で確かめてあるので失敗しない
+    for (size_t s = 0; s < pipeline->sinks_.size(); ++s)
+    {
+        sinkQueues[s]->tryPush(block);
+    }
+    counters.blocks++;
+    counters.samples += frames;
+}
+
+// ========= IngestPipeline =========
+IngestPipeline::IngestPipeline(const IngestConfig &config)
+    : config_(config), injection_(config.devices)
+{
+    if (config_.workers == 0)
+    {
+        config_.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    devices_.reserve(config_.devices);
+    for (size_t i = 0; i < config_.devices; ++i)
+    {
+        devices_.emplace_back(new Device(config_.inboundDepth));
+        Device &d = *devices_.back();
+        d.id = static_cast<uint32_t>(i);
+        d.pipeline = this;
+        if (config_.filter)
+        {
+            d.filter.configure(config_.filterSpec);
+        }
+    }
+    for (size_t w = 0; w < config_.workers; ++w)
+    {
+        workers_.emplace_back(new Worker(config_.devices));
+        workers_.back()->index = w;
+        workers_.back()->rng = 0x9E3779B97F4A7C15ull * (w + 1);
+    }
+}
+
+IngestPipeline::~IngestPipeline()
+{
+    stop();
+}
+
+void IngestPipeline::addSink(IngestSink *sink)
+{
+    if (started_ || sinks_.size() == INGEST_MAX_SINKS)
+    {
+        return;
+    }
+    sinks_.push_back(sink);
+}
+
+void IngestPipeline::start()
+{
+    if (started_)
+    {
+        return;
+    }
+    started_ = true;
+    for (auto &d : devices_)
+    {
+        for (size_t s = 0; s < sinks_.size(); ++s)
+        {
+            d->sinkQueues[s].reset(new SpscQueue<IngestBlock>(std::max(config_.sinkDepth, INGEST_MAX_BLOCKS_PER_DATAGRAM)));
+        }
+    }
+    workersRunning_.store(workers_.size());
+    for (auto &w : workers_)
+    {
+        Worker *worker = w.get();
+        worker->thread = std::thread([this, worker] { workerLoop(*worker); });
+    }
+    for (size_t s = 0; s < sinks_.size(); ++s)
+    {
+        sinkThreads_.emplace_back(new SinkThread());
+        SinkThread *st = sinkThreads_.back().get();
+        st->sink = sinks_[s];
+        st->index = s;
+        st->thread = std::thread([this, st] { sinkLoop(*st); });
+    }
+}
+
+bool IngestPipeline::submit(const IngestDatagram &datagram)
+{
+    if (datagram.device >= devices_.size() || datagram.size > INGEST_MAX_DATAGRAM)
+    {
+        return true; // 不正な入力は捨てる (背圧ではない)
+    }
+    Device &d = *devices_[datagram.device];
+    // 先に数えておき、ワーカーが処理した分を引く (stop の終了判定用)
+    inFlight_.fetch_add(1);
+    if (!d.inbound.tryPush(datagram))
+    {
+        inFlight_.fetch_sub(1);
+        inboundFull_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    schedule(d, nullptr);
+    return true;
+}
+
+void IngestPipeline::schedule(Device &device, Worker *worker)
+{
+    // 既に載っているか処理中なら、そのワーカーが抜ける前に受信キューを見直す
+    if (device.scheduled.exchange(true))
+    {
+        return;
+    }
+    if (worker != nullptr && worker->deque.push(device.id))
+    {
+        return;
+    }
+    // 注入キューはデバイス数ぶんあり、各デバイスは高々 1 回しか入らないので溢れない
+    while (!injection_.tryPush(device.id))
+    {
+        std::this_thread::yield();
+    }
+}
+
+bool IngestPipeline::nextTask(Worker &worker, uint32_t &device)
+{
+    // 自分のデックも top 側 (FIFO) から取る。LIFO だと続きのあるデバイスを同じワーカーが抱え続け、
+    // 注入キューで待つデバイスが飢える。注入キューとは 1 回ごとに優先を入れ替える
+    const bool injectionFirst = (worker.counters.tasks & 1) != 0;
+    if (injectionFirst && injection_.tryPop(device))
+    {
+        return true;
+    }
+    if (worker.deque.steal(device) || (!injectionFirst && injection_.tryPop(device)))
+    {
+        return true;
+    }
+    // ランダムな位置から一巡して盗む
+    const size_t n = workers_.size();
+    const size_t start = static_cast<size_t>(xorshift(worker.rng) % n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Worker &victim = *workers_[(start + i) % n];
+        if (&victim != &worker && victim.deque.steal(device))
+        {
+            worker.counters.steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IngestPipeline::runDevice(Worker &worker, Device &device)
+{
+    worker.counters.tasks++;
+    device.worker = &worker;
+    bool stalled = false;
+    for (size_t n = 0; n < config_.batchDatagrams; ++n)
+    {
+        const IngestDatagram *datagram = device.inbound.front();
+        if (datagram == nullptr)
+        {
+            break;
+        }
+        // 背圧: どれかのシンクが詰まっていたら、このデバイスはここで止める
+        for (size_t s = 0; s < sinks_.size(); ++s)
+        {
+            if (!device.sinkQueues[s]->hasRoom(INGEST_MAX_BLOCKS_PER_DATAGRAM))
+            {
+                worker.counters.sinkStalls[s]++;
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled)
+        {
+            break;
+        }
+        device.workerNs = monotonicNs();
+        worker.stages[INGEST_STAGE_INBOUND_WAIT].add(device.workerNs - datagram->recvNs);
+        device.current = datagram;
+        device.framer.feed(datagram->bytes, datagram->size);
+        device.current = nullptr;
+        device.inbound.popFront();
+        inFlight_.fetch_sub(1);
+        worker.counters.datagrams++;
+    }
+
+    if (stalled)
+    {
+        // scheduled のまま後回しにする (シンクが空けるまで他のデバイスを進める)
+        if (!worker.deque.push(device.id))
+        {
+            while (!injection_.tryPush(device.id))
+            {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+    // submit 側 (push → exchange) と逆順に見るので、間に全順序の区切りが要る
+    device.scheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!device.inbound.empty())
+    {
+        schedule(device, &worker);
+    }
+}
+
+void IngestPipeline::workerLoop(Worker &worker)
+{
+    size_t idle = 0;
+    uint64_t lastStalls = 0;
+    for (;;)
+    {
+        uint32_t id;
+        if (nextTask(worker, id))
+        {
+            runDevice(worker, *devices_[id]);
+            // 詰まったデバイスしか残っていないときに空回りしないよう、停滞が続いたら休む
+            uint64_t stalls = 0;
+            for (size_t s = 0; s < INGEST_MAX_SINKS; ++s)
+            {
+                stalls += worker.counters.sinkStalls[s];
+            }
+            idle = stalls != lastStalls ? idle + 1 : 0;
+            lastStalls = stalls;
+            backoff(idle);
+            continue;
+        }
+        if (inputClosed_.load() && inFlight_.load() == 0)
+        {
+            break;
+        }
+        backoff(++idle);
+    }
+    workersRunning_.fetch_sub(1);
+}
+
+void IngestPipeline::sinkLoop(SinkThread &st)
+{
+    constexpr size_t BURST = 32; // 1 デバイスから続けて取り出す上限 (公平性)
+    size_t idle = 0;
+    for (;;)
+    {
+        // ワーカーが全員抜けた後の一巡で空なら終わり
+        const bool finalPass = workersRunning_.load() == 0;
+        bool any = false;
+        for (auto &d : devices_)
+        {
+            SpscQueue<IngestBlock> &q = *d->sinkQueues[st.index];
+            for (size_t n = 0; n < BURST; ++n)
+            {
+                const IngestBlock *block = q.front();
+                if (block == nullptr)
+                {
+                    break;
+                }
+                const int64_t start = monotonicNs();
+                st.wait.add(start - block->filteredNs);
+                st.sink->consume(*block);
+                const int64_t end = monotonicNs();
+                st.consume.add(end - start);
+                st.endToEnd.add(end - block->recvNs);
+                q.popFront();
+                any = true;
+            }
+        }
+        if (any)
+        {
+            idle = 0;
+            continue;
+        }
+        if (finalPass)
+        {
+            break;
+        }
+        backoff(++idle);
+    }
+    st.sink->finish();
+}
+
+void IngestPipeline::stop()
+{
+    if (!started_)
+    {
+        return;
+    }
+    inputClosed_.store(true);
+    for (auto &w : workers_)
+    {
+        if (w->thread.joinable())
+        {
+            w->thread.join();
+        }
+    }
+    for (auto &s : sinkThreads_)
+    {
+        if (s->thread.joinable())
+        {
+            s->thread.join();
+        }
+    }
+}
+
+IngestCounters IngestPipeline::counters() const
+{
+    IngestCounters total;
+    for (const auto &w : workers_)
+    {
+        total.add(w->counters);
+    }
+    return total;
+}
+
+LatencyHistogram IngestPipeline::stageLatency(IngestStage stage) const
+{
+    LatencyHistogram total;
+    for (const auto &w : workers_)
+    {
+        total.merge(w->stages[stage]);
+    }
+    return total;
+}
+
+namespace
+{
+
+void writeLatencyRow(FILE *fp, const char *label, const LatencyHistogram &h)
+{
+    if (h.count() == 0)
+    {
+        fprintf(fp, "    %-24s %10s\n", label, "-");
+        return;
+    }
+    fprintf(fp, "    %-24s %10.1f %10.1f %10.1f %10.1f  (%llu)\n", label, h.quantile(0.5) * 1e-3, h.quantile(0.99) * 1e-3,
+            h.quantile(0.999) * 1e-3, h.max() * 1e-3, static_cast<unsigned long long>(h.count()));
+}
+
+} // namespace
+
+void IngestPipeline::writeReport(FILE *fp, double elapsedSec) const
+{
+    const IngestCounters c = counters();
+    const double secs = elapsedSec > 0 ? elapsedSec : 1e-9;
+    fprintf(fp, "  %zu devices, %zu workers, %zu sinks, filter %s\n", devices_.size(), workers_.size(), sinks_.size(),
+            config_.filter ? "on" : "off");
+    fprintf(fp, "  datagrams %llu (%.0f/s), blocks %llu, samples %.2fM/s = %.1fx real time for all devices\n",
+            static_cast<unsigned long long>(c.datagrams), c.datagrams / secs, static_cast<unsigned long long>(c.blocks),
+            c.samples / secs * 1e-6, c.samples / secs / (static_cast<double>(SAMPLE_RATE_HZ) * devices_.size()));
+    fprintf(fp, "  framing: config %llu, other %llu, crc errors %llu, resyncs %llu, gaps %llu (%llu samples)\n",
+            static_cast<unsigned long long>(c.configPackets), static_cast<unsigned long long>(c.otherPackets),
+            static_cast<unsigned long long>(c.crcErrors), static_cast<unsigned long long>(c.resyncs),
+            static_cast<unsigned long long>(c.gaps), static_cast<unsigned long long>(c.missingSamples));
+    fprintf(fp, "  scheduling: tasks %llu, steals %llu (%.1f%%)\n", static_cast<unsigned long long>(c.tasks),
+            static_cast<unsigned long long>(c.steals), c.tasks ? 100.0 * c.steals / c.tasks : 0.0);
+    fprintf(fp, "  backpressure: inbound full %llu", static_cast<unsigned long long>(inboundFull()));
+    for (size_t s = 0; s < sinks_.size(); ++s)
+    {
+        fprintf(fp, ", %s stalls %llu", sinks_[s]->name(), static_cast<unsigned long long>(c.sinkStalls[s]));
+    }
+    fprintf(fp, "\n  latency (us)             %10s %10s %10s %10s\n", "p50", "p99", "p99.9", "max");
+    writeLatencyRow(fp, "inbound wait", stageLatency(INGEST_STAGE_INBOUND_WAIT));
+    writeLatencyRow(fp, "frame + decode", stageLatency(INGEST_STAGE_DECODE));
+    writeLatencyRow(fp, "filter", stageLatency(INGEST_STAGE_FILTER));
+    char label[64];
+    for (size_t s = 0; s < sinkThreads_.size(); ++s)
+    {
+        snprintf(label, sizeof(label), "sink wait [%s]", sinks_[s]->name());
+        writeLatencyRow(fp, label, sinkThreads_[s]->wait);
+        snprintf(label, sizeof(label), "sink [%s]", sinks_[s]->name());
+        writeLatencyRow(fp, label, sinkThreads_[s]->consume);
+        snprintf(label, sizeof(label), "end to end [%s]", sinks_[s]->name());
+        writeLatencyRow(fp, label, sinkThreads_[s]->endToEnd);
+    }
+}
@@ -0,0 +1,226 @@
+// 多デバイス受信パイプライン (ホスト側)
+//
+//   受信 (submit) → [デバイスごとの SPSC] → ワーカー: フレーミング / CRC 検査 → デコード → フィルタ
+//                → [デバイス x シンクごとの SPSC] → シンクごとのスレッド
+//
+// デバイスは「受信データがある」ときだけタスクとしてワーカープールに載る (scheduled フラグで 1 回だけ)。
+// 外からの投入は MPMC の注入キュー、ワーカー内での再投入は自分の Chase-Lev デックへ入れ、
+// 手が空いたワーカーは他のデックから盗む。1 デバイスを同時に処理するのは常に 1 ワーカーなので、
+// デバイス単位のキューは SPSC のままでよく、ブロックの順序も保たれる。
+//
+// 背圧: どれかのシンクのキューに空きがなければ、そのデバイスの処理を止めて受信キューに溜める。
+// 受信キューが満杯なら submit() が false を返す (合成ソースは待ち、UDP は捨てて数える)。
+// 遅いシンクはそのまま全体の速度を決め、データは失われない。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "eeg_biquad.h"
+#include "eeg_lockfree_queue.h"
+#include "eeg_packet_framer.h"
+#include "eeg_protocol.h"
+
+constexpr size_t INGEST_MAX_DATAGRAM = 1024;
+constexpr size_t INGEST_MAX_SINKS = 4;
+// 1 データグラムから出うるチャンクの最大数 (シンクの空きをこれだけ確かめてから処理する)
+constexpr size_t INGEST_MAX_BLOCKS_PER_DATAGRAM = INGEST_MAX_DATAGRAM / sizeof(ChunkedSamplePacket) + 1;
+
+struct IngestDatagram
+{
+    uint32_t device;
+    uint32_t size;
+    int64_t recvNs; // 受信 (submit) 時刻, CLOCK_MONOTONIC
+    uint8_t bytes[INGEST_MAX_DATAGRAM];
+};
+
+// デコード済みのチャンク 1 つ分
+struct IngestBlock
+{
+    uint32_t device;
+    uint16_t startIndex;
+    uint8_t frames;
+    bool gapBefore; // 同じセッションの直前のチャンクとの間に欠けがある
+    int16_t samples[SAMPLES_PER_CHUNK * CH_MAX]; // frames x CH_MAX
+    uint8_t triggers[SAMPLES_PER_CHUNK];
+    int64_t recvNs;
+    int64_t workerNs;   // ワーカーが受信キューから取り出した
+    int64_t decodedNs;
+    int64_t filteredNs; // シンクのキューに入れた
+};
+
+// シンクはそれぞれ専用スレッドから consume() される
+class IngestSink
+{
+public:
+    virtual ~IngestSink() {}
+    virtual const char *name() const = 0;
+    virtual void consume(const IngestBlock &block) = 0;
+    // 全ブロックを渡し終えた後 (シンクのスレッドから)
+    virtual void finish() {}
+};
+
+// 対数目盛り (2 の冪をさらに 8 分割) のレイテンシ分布。1 スレッドだけが書き、集計時に merge する
+class LatencyHistogram
+{
+public:
+    void add(int64_t ns);
+    void merge(const LatencyHistogram &other);
+    uint64_t count() const { return count_; }
+    int64_t max() const { return max_; }
+    // 0 < q <= 1 の分位点 (バケット上端, ns)
+    int64_t quantile(double q) const;
+
+private:
+    static constexpr size_t SUB_BITS = 3;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS) << SUB_BITS;
+
+    static size_t bucketOf(uint64_t ns);
+    static int64_t upperBound(size_t bucket);
+
+    uint64_t buckets_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    int64_t max_ = 0;
+};
+
+struct IngestConfig
+{
+    size_t devices = 100;
+    size_t workers = 0;        // 0 = hardware_concurrency
+    size_t inboundDepth = 64;  // デバイスごとの受信データグラム数
+    size_t sinkDepth = 64;     // デバイス x シンクごとのブロック数
+    size_t batchDatagrams = 8; // 1 回のタスクで処理する最大データグラム数
+    bool filter = false;
+    FilterSpec filterSpec;
+};
+
+enum IngestStage : size_t
+{
+    INGEST_STAGE_INBOUND_WAIT = 0, // submit → ワーカー
+    INGEST_STAGE_DECODE,           // フレーミング + CRC + デコード
+    INGEST_STAGE_FILTER,
+    INGEST_STAGE_COUNT,
+};
+
+struct IngestCounters
+{
+    uint64_t datagrams = 0;
+    uint64_t packets = 0;
+    uint64_t blocks = 0;
+    uint64_t samples = 0;
+    uint64_t configPackets = 0;
+    uint64_t otherPackets = 0;
+    uint64_t crcErrors = 0;
+    uint64_t resyncs = 0;
+    uint64_t gaps = 0;
+    uint64_t missingSamples = 0;
+    uint64_t tasks = 0;
+    uint64_t steals = 0;
+    uint64_t sinkStalls[INGEST_MAX_SINKS] = {};
+
+    void add(const IngestCounters &o);
+};
+
+class IngestPipeline
+{
+public:
+    explicit IngestPipeline(const IngestConfig &config);
+    ~IngestPipeline();
+
+    // start() の前に登録する。所有権は呼び出し側
+    void addSink(IngestSink *sink);
+    void start();
+
+    // 受信スレッドから。1 デバイスには常に同じ 1 スレッドから投入すること (受信キューが SPSC)。
+    // 受信キューが満杯なら false (背圧)
+    bool submit(const IngestDatagram &datagram);
+
+    // 投入を締め切り、残りを全部流してからスレッドを止める
+    void stop();
+
+    size_t workers() const { return workers_.size(); }
+    size_t sinks() const { return sinks_.size(); }
+    uint64_t inboundFull() const { return inboundFull_.load(std::memory_order_relaxed); }
+    // stop() 後に有効
+    IngestCounters counters() const;
+    LatencyHistogram stageLatency(IngestStage stage) const;
+    const LatencyHistogram &sinkWaitLatency(size_t sink) const { return sinkThreads_[sink]->wait; }
+    const LatencyHistogram &sinkLatency(size_t sink) const { return sinkThreads_[sink]->consume; }
+    const LatencyHistogram &endToEndLatency(size_t sink) const { return sinkThreads_[sink]->endToEnd; }
+
+    void writeReport(FILE *fp, double elapsedSec) const;
+
+private:
+    struct Worker;
+
+    struct Device : PacketFramer::Handler
+    {
+        explicit Device(size_t inboundDepth);
+
+        void onPacket(uint8_t type, const uint8_t *data, size_t size) override;
+        void onResync(size_t skippedBytes) override;
+        void onCrcError(uint8_t type) override;
+
+        uint32_t id = 0;
+        IngestPipeline *pipeline = nullptr;
+        SpscQueue<IngestDatagram> inbound;
+        std::atomic<bool> scheduled{false};
+        PacketFramer framer;
+        BiquadChain filter;
+        bool haveIndex = false;
+        uint16_t expectedIndex = 0;
+        std::unique_ptr<SpscQueue<IngestBlock>> sinkQueues[INGEST_MAX_SINKS];
+
+        // 処理中のワーカーとデータグラム (onPacket から使う)
+        Worker *worker = nullptr;
+        const IngestDatagram *current = nullptr;
+        int64_t workerNs = 0;
+    };
+
+    struct Worker
+    {
+        explicit Worker(size_t devices) : deque(devices) {}
+
+        WorkStealingDeque deque;
+        IngestCounters counters;
+        LatencyHistogram stages[INGEST_STAGE_COUNT];
+        std::thread thread;
+        size_t index = 0;
+        uint64_t rng = 0;
+    };
+
+    struct SinkThread
+    {
+        IngestSink *sink = nullptr;
+        size_t index = 0;
+        LatencyHistogram wait;     // キューに入ってから consume 開始まで
+        LatencyHistogram consume;  // consume() の所要時間
+        LatencyHistogram endToEnd; // submit から consume 完了まで
+        std::thread thread;
+    };
+
+    void workerLoop(Worker &worker);
+    bool nextTask(Worker &worker, uint32_t &device);
+    void runDevice(Worker &worker, Device &device);
+    void sinkLoop(SinkThread &sink);
+    void schedule(Device &device, Worker *worker);
+
+    IngestConfig config_;
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<SinkThread>> sinkThreads_;
+    std::vector<IngestSink *> sinks_;
+    MpmcQueue<uint32_t> injection_;
+
+    std::atomic<int64_t> inFlight_{0}; // 投入済みで未処理のデータグラム
+    std::atomic<uint64_t> inboundFull_{0};
+    std::atomic<bool> inputClosed_{false};
+    std::atomic<size_t> workersRunning_{0};
+    bool started_ = false;
+};
@@ -0,0 +1,278 @@
+// 有界のロックフリーキュー (ホスト側の受信パイプライン用)
+//
+// SpscQueue          : 生産者 1 / 消費者 1 のリングバッファ。相手側のインデックスをキャッシュして
+//                      キャッシュラインの行き来を減らす。
+// MpmcQueue          : Vyukov の有界 MPMC キュー (セルごとの sequence で順番を決める)。
+// WorkStealingDeque  : Chase-Lev の固定長デック。所有スレッドが bottom 側で push/pop し、
+//                      他スレッドは top 側から steal する (Lê et al. 2013 の C11 版の手順)。
+//
+// 容量はいずれも 2 の冪に切り上げる。溢れたら push は false を返すだけで待たない (背圧は呼び出し側で扱う)。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+constexpr size_t LOCKFREE_CACHE_LINE = 64;
+
+inline size_t lockfreeRoundUpPow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity = 2)
+        : mask_(lockfreeRoundUpPow2(capacity < 2 ? 2 : capacity) - 1), slots_(new T[mask_ + 1])
+    {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // 生産者側
+    bool tryPush(const T &value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ > mask_)
+        {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ > mask_)
+            {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 生産者側: 空きが n 個以上あるか (push の前に、まとめて入るかを確かめる)
+    bool hasRoom(size_t n)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (mask_ + 1 - (tail - headCache_) >= n)
+        {
+            return true;
+        }
+        headCache_ = head_.load(std::memory_order_acquire);
+        return mask_ + 1 - (tail - headCache_) >= n;
+    }
+
+    // 消費者側
+    bool tryPop(T &out)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_)
+        {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_)
+            {
+                return false;
+            }
+        }
+        out = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 消費者側: 先頭を取り出さずに参照する (空なら nullptr)
+    const T *front()
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_)
+        {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    void popFront() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // どちらのスレッドからでも呼べる概算
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t sizeApprox() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> head_{0};
+    size_t tailCache_ = 0; // 消費者だけが触る
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> tail_{0};
+    size_t headCache_ = 0; // 生産者だけが触る
+};
+
+template <typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity = 2)
+        : mask_(lockfreeRoundUpPow2(capacity < 2 ? 2 : capacity) - 1), cells_(new Cell[mask_ + 1])
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    bool tryPush(const T &value)
+    {
+        size_t pos = enqueue_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // 満杯
+            }
+            else
+            {
+                pos = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T &out)
+    {
+        size_t pos = dequeue_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    out = cell.value;
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // 空
+            }
+            else
+            {
+                pos = dequeue_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> enqueue_{0};
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<size_t> dequeue_{0};
+};
+
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 2)
+        : mask_(lockfreeRoundUpPow2(capacity < 2 ? 2 : capacity) - 1), items_(new std::atomic<uint32_t>[mask_ + 1])
+    {
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // 所有スレッドのみ
+    bool push(uint32_t item)
+    {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t > static_cast<int64_t>(mask_))
+        {
+            return false;
+        }
+        items_[b & mask_].store(item, std::memory_order_relaxed);
+        // 項目と、それまでの所有スレッドの書き込み (デバイスの状態) を steal 側へ渡す
+        bottom_.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 所有スレッドのみ (LIFO)
+    bool pop(uint32_t &item)
+    {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = items_[b & mask_].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // 最後の 1 個は steal と取り合う
+            const bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意のスレッド (FIFO 側)。取り合いに負けた場合も false
+    bool steal(uint32_t &item)
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return false;
+        }
+        item = items_[t & mask_].load(std::memory_order_relaxed);
+        return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    size_t sizeApprox() const
+    {
+        const int64_t n = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<std::atomic<uint32_t>[]> items_;
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<int64_t> top_{0};
+    alignas(LOCKFREE_CACHE_LINE) std::atomic<int64_t> bottom_{0};
+};
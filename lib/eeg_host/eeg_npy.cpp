@@ -0,0 +1,136 @@
+#include "eeg_npy.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr size_t NPY_PREAMBLE_BYTES = 10;
+constexpr size_t NPY_APPEND_HEADER_BYTES = 128; // 形状を最後に書き直すので固定長にしておく
+
+} // namespace
+
+std::string npyHeader(const std::string &descr, const std::vector<uint64_t> &shape, size_t headerBytes)
+{
+    std::string dims;
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        dims += (i > 0 ? ", " : "") + std::to_string(shape[i]);
+    }
+    std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + dims + (shape.size() == 1 ? ",), }" : "), }");
+    const size_t total = headerBytes > 0 ? headerBytes : NPY_PREAMBLE_BYTES + dict.size() + 1 + (64 - (NPY_PREAMBLE_BYTES + dict.size() + 1) % 64) % 64;
+    dict.resize(total - NPY_PREAMBLE_BYTES - 1, ' ');
+    dict.push_back('\n');
+    const char magic[NPY_PREAMBLE_BYTES] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0, static_cast<char>(dict.size() & 0xFF),
+                                            static_cast<char>(dict.size() >> 8)};
+    return std::string(magic, NPY_PREAMBLE_BYTES) + dict;
+}
+
+// ========= NpyFile =========
+NpyFile::~NpyFile()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool NpyFile::create(const std::string &path, const char *descr, const std::vector<uint64_t> &shape, size_t itemBytes)
+{
+    uint64_t count = 1;
+    for (uint64_t d : shape)
+    {
+        count *= d;
+    }
+    const std::string header = npyHeader(descr, shape);
+
+    fd_ = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd_ < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    dataOffset_ = header.size();
+    if (pwrite(fd_, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size()))
+    {
+        perror(path.c_str());
+        return false;
+    }
+    // 先に全体を確保しておくと、各スレッドの書き込みがファイル拡張で詰まらない
+    const off_t total = static_cast<off_t>(dataOffset_ + count * itemBytes);
+    if (posix_fallocate(fd_, 0, total) != 0 && ftruncate(fd_, total) != 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool NpyFile::writeAt(uint64_t byteOffset, const void *data, size_t bytes) const
+{
+    const char *p = static_cast<const char *>(data);
+    off_t pos = static_cast<off_t>(dataOffset_ + byteOffset);
+    while (bytes > 0)
+    {
+        const ssize_t n = pwrite(fd_, p, bytes, pos);
+        if (n <= 0)
+        {
+            perror("[NPY] pwrite");
+            return false;
+        }
+        p += n;
+        pos += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// ========= AppendNpyFile =========
+AppendNpyFile::~AppendNpyFile()
+{
+    if (fp_)
+    {
+        fclose(fp_);
+    }
+}
+
+bool AppendNpyFile::create(const std::string &path, const char *descr, const std::vector<uint64_t> &innerShape)
+{
+    fp_ = fopen(path.c_str(), "wb");
+    if (!fp_)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    descr_ = descr;
+    innerShape_ = innerShape;
+    writeHeader();
+    return true;
+}
+
+void AppendNpyFile::append(const void *data, size_t bytes, uint64_t rows)
+{
+    fwrite(data, 1, bytes, fp_);
+    rows_ += rows;
+}
+
+bool AppendNpyFile::close()
+{
+    writeHeader();
+    const bool ok = ferror(fp_) == 0;
+    fclose(fp_);
+    fp_ = nullptr;
+    return ok;
+}
+
+void AppendNpyFile::writeHeader()
+{
+    std::vector<uint64_t> shape(1, rows_);
+    shape.insert(shape.end(), innerShape_.begin(), innerShape_.end());
+    const std::string header = npyHeader(descr_, shape, NPY_APPEND_HEADER_BYTES);
+    const long pos = ftell(fp_);
+    fseek(fp_, 0, SEEK_SET);
+    fwrite(header.data(), 1, header.size(), fp_);
+    fseek(fp_, pos > static_cast<long>(NPY_APPEND_HEADER_BYTES) ? pos : static_cast<long>(NPY_APPEND_HEADER_BYTES), SEEK_SET);
+}
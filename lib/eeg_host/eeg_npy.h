@@ -0,0 +1,47 @@
+// NPY (v1.0) ファイルの書き出し
+//
+//   NpyFile       : 形状が先に決まっている。全体を確保しておき、複数スレッドから位置指定で書く
+//   AppendNpyFile : 先頭の次元 (行数) が書き終わるまで分からない。追記し、close() で形状を書き直す
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// マジックと長さを含むヘッダ全体。headerBytes = 0 なら 64 バイト境界まで、非 0 ならその長さまで空白で埋める
+std::string npyHeader(const std::string &descr, const std::vector<uint64_t> &shape, size_t headerBytes = 0);
+
+class NpyFile
+{
+public:
+    ~NpyFile();
+
+    bool create(const std::string &path, const char *descr, const std::vector<uint64_t> &shape, size_t itemBytes);
+    // データ領域の先頭からのオフセットに書く (スレッドセーフ)
+    bool writeAt(uint64_t byteOffset, const void *data, size_t bytes) const;
+
+private:
+    int fd_ = -1;
+    uint64_t dataOffset_ = 0;
+};
+
+class AppendNpyFile
+{
+public:
+    ~AppendNpyFile();
+
+    bool create(const std::string &path, const char *descr, const std::vector<uint64_t> &innerShape);
+    void append(const void *data, size_t bytes, uint64_t rows);
+    bool close();
+
+private:
+    void writeHeader();
+
+    FILE *fp_ = nullptr;
+    std::string descr_;
+    std::vector<uint64_t> innerShape_;
+    uint64_t rows_ = 0;
+};
@@ -0,0 +1,217 @@
+// バイト列 (ファイル / シリアル / UDP) からパケット境界を切り出す
+//
+// パケット長は先頭の種別バイトで決まる。未知の種別は 1 バイトずつ読み飛ばして再同期する。
+// 内部バッファは最大パケット長ぶんだけなので、入力の長さによらずメモリは一定。
+//
+// CRC トレーラ (DEVICE_CFG_FLAG_CRC32C) は設定パケットのフラグを見て自動で切り替え、
+// 検査して取り除いた本体だけを onPacket に渡す。不一致なら 1 バイト読み飛ばして再同期する。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "eeg_crc.h"
+#include "eeg_protocol.h"
+
+class PacketFramer
+{
+public:
+    struct Handler
+    {
+        virtual void onPacket(uint8_t type, const uint8_t *data, size_t size) = 0;
+        virtual void onResync(size_t skippedBytes) { (void)skippedBytes; }
+        virtual void onCrcError(uint8_t type) { (void)type; }
+        virtual ~Handler() {}
+    };
+
+    explicit PacketFramer(Handler &handler) : handler_(handler) {}
+
+    // 設定パケットを含まないストリーム (途中から受信したライブ入力など) 用
+    void setCrcTrailer(bool enabled) { crcTrailer_ = enabled; }
+    bool crcTrailer() const { return crcTrailer_; }
+
+    void feed(const uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            // バッファが空なら入力から直接切り出してコピーを避ける
+            if (fill_ == 0)
+            {
+                const size_t need = frameSize(data, size);
+                if (need == SKIP || (need != 0 && need <= size && !deliver(data, need)))
+                {
+                    skip(1);
+                    data++;
+                    size--;
+                    continue;
+                }
+                if (need != 0 && need <= size)
+                {
+                    data += need;
+                    size -= need;
+                    continue;
+                }
+            }
+            const size_t take = (fill_ + size > sizeof(buffer_)) ? sizeof(buffer_) - fill_ : size;
+            memcpy(buffer_ + fill_, data, take);
+            fill_ += take;
+            data += take;
+            size -= take;
+            drainBuffer();
+        }
+    }
+
+    // 入力終端。途中で切れたパケットは捨てて読み飛ばし扱いにする
+    void finish()
+    {
+        if (fill_ > 0)
+        {
+            skip(fill_);
+            fill_ = 0;
+        }
+        flushSkipped();
+    }
+
+    // 種別バイトからパケット長を返す。長さがまだ判らなければ 0、未知の種別は SKIP
+    static size_t packetSize(const uint8_t *data, size_t available)
+    {
+        switch (data[0])
+        {
+        case PKT_TYPE_DATA_CHUNK:
+            return sizeof(ChunkedSamplePacket);
+        case PKT_TYPE_DEVICE_CFG:
+            return sizeof(DeviceConfigPacket);
+        case PKT_TYPE_TELEMETRY:
+            return sizeof(DeviceTelemetryPacket);
+        case PKT_TYPE_STREAM_DIGEST:
+            return sizeof(StreamDigestPacket);
+        case PKT_TYPE_COMMAND_LOG:
+            return available >= COMMAND_LOG_PACKET_HEADER_BYTES ? COMMAND_LOG_PACKET_HEADER_BYTES + data[3] : 0;
+        case PKT_TYPE_PREVIEW:
+            return available >= PREVIEW_PACKET_HEADER_BYTES ? previewPacketSize(data[2], data[3]) : 0;
+        case PKT_TYPE_BAND_POWER:
+            return available >= BAND_POWER_PACKET_HEADER_BYTES ? bandPowerPacketSize(data[2], data[3]) : 0;
+        case PKT_TYPE_SPECTRUM:
+            if (available < SPECTRUM_PACKET_HEADER_BYTES)
+            {
+                return 0;
+            }
+            return data[3] > 0 && data[2] < CH_MAX ? SPECTRUM_PACKET_HEADER_BYTES + data[3] : SKIP;
+        case PKT_TYPE_ERP_AVERAGE:
+            if (available < ERP_PACKET_HEADER_BYTES)
+            {
+                return 0;
+            }
+            return data[5] > 0 && data[5] <= ERP_MAX_EPOCH_SAMPLES && data[4] < data[5] ? ERP_PACKET_HEADER_BYTES + data[5] * sizeof(int16_t) : SKIP;
+        default:
+            return SKIP;
+        }
+    }
+
+    static constexpr size_t SKIP = static_cast<size_t>(-1);
+
+    static size_t previewPacketSize(uint8_t channelMask, uint8_t frames)
+    {
+        const size_t channels = __builtin_popcount(channelMask);
+        const size_t values = frames * channels;
+        return values > 0 && values <= PREVIEW_MAX_VALUES ? PREVIEW_PACKET_HEADER_BYTES + values * sizeof(int16_t) : SKIP;
+    }
+
+    static size_t bandPowerPacketSize(uint8_t channelMask, uint8_t bands)
+    {
+        const size_t values = bands * static_cast<size_t>(__builtin_popcount(channelMask));
+        return values > 0 && bands <= BAND_POWER_MAX_BANDS ? BAND_POWER_PACKET_HEADER_BYTES + values * sizeof(uint16_t) : SKIP;
+    }
+
+private:
+    // トレーラを含めたフレーム長。設定パケットは自分のフラグでトレーラの有無が決まる
+    size_t frameSize(const uint8_t *data, size_t available) const
+    {
+        const size_t base = packetSize(data, available);
+        if (base == SKIP || base == 0)
+        {
+            return base;
+        }
+        return base + trailerBytes(data, available);
+    }
+
+    size_t trailerBytes(const uint8_t *data, size_t available) const
+    {
+        if (data[0] == PKT_TYPE_DEVICE_CFG)
+        {
+            // flags が読めない間は available < base なので、まだ切り出されない
+            return available > 2 && (data[2] & DEVICE_CFG_FLAG_CRC32C) ? PACKET_CRC_BYTES : 0;
+        }
+        return crcTrailer_ ? PACKET_CRC_BYTES : 0;
+    }
+
+    // CRC を検査して本体を渡す。不一致なら false (呼び出し側で読み飛ばす)
+    bool deliver(const uint8_t *p, size_t frame)
+    {
+        const size_t trailer = trailerBytes(p, frame);
+        const size_t size = frame - trailer;
+        if (trailer == 0 && crcTrailer_ && skipped_ > 0)
+        {
+            // CRC 有効中の再同期では、CRC で確かめられたパケット以外 (CRC なしの設定パケットに見える偽の候補) を受け入れない
+            return false;
+        }
+        if (trailer > 0 && !checkPacketCrc(p, size))
+        {
+            // 再同期中の偽の候補は数えない
+            if (skipped_ == 0)
+            {
+                handler_.onCrcError(p[0]);
+            }
+            return false;
+        }
+        if (p[0] == PKT_TYPE_DEVICE_CFG)
+        {
+            crcTrailer_ = trailer > 0;
+        }
+        flushSkipped();
+        handler_.onPacket(p[0], p, size);
+        return true;
+    }
+
+    void drainBuffer()
+    {
+        size_t pos = 0;
+        while (pos < fill_)
+        {
+            const size_t need = frameSize(buffer_ + pos, fill_ - pos);
+            if (need != SKIP && (need == 0 || need > fill_ - pos))
+            {
+                break;
+            }
+            if (need == SKIP || !deliver(buffer_ + pos, need))
+            {
+                skip(1);
+                pos++;
+                continue;
+            }
+            pos += need;
+        }
+        memmove(buffer_, buffer_ + pos, fill_ - pos);
+        fill_ -= pos;
+    }
+
+    void skip(size_t n) { skipped_ += n; }
+
+    void flushSkipped()
+    {
+        if (skipped_ > 0)
+        {
+            handler_.onResync(skipped_);
+            skipped_ = 0;
+        }
+    }
+
+    static constexpr size_t MAX_PACKET_BYTES = (sizeof(DeviceConfigPacket) > sizeof(ChunkedSamplePacket) ? sizeof(DeviceConfigPacket) : sizeof(ChunkedSamplePacket)) + PACKET_CRC_BYTES;
+
+    Handler &handler_;
+    uint8_t buffer_[MAX_PACKET_BYTES];
+    size_t fill_ = 0;
+    size_t skipped_ = 0;
+    bool crcTrailer_ = false;
+};
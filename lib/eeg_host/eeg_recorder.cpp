@@ -0,0 +1,613 @@
+#include "eeg_recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "eeg_host_clock.h"
+
+namespace
+{
+
+constexpr int64_t URING_FLUSH_NS = 1000000; // 投入を溜めておく最長時間
+
+size_t alignUp(size_t n)
+{
+    return (n + RECORDER_ALIGN - 1) & ~(RECORDER_ALIGN - 1);
+}
+
+} // namespace
+
+// ========= バックエンド共通 =========
+class RecorderIo
+{
+public:
+    struct Completion
+    {
+        uint32_t buffer;
+        int64_t result; // 書けたバイト数、失敗なら -errno
+    };
+
+    virtual ~RecorderIo() {}
+    // 同時に投げるのは queueDepth 個まで (呼び出し側が守る)
+    virtual void submit(uint32_t buffer, int fd, const uint8_t *data, size_t length, uint64_t offset) = 0;
+    // 完了を最大 max 個取り出す。wait なら 1 個以上になるまで待つ
+    virtual size_t reap(bool wait, Completion *out, size_t max) = 0;
+};
+
+namespace
+{
+
+// ========= io_uring (syscall 直接) =========
+class UringIo : public RecorderIo
+{
+public:
+    ~UringIo() override
+    {
+        if (sqes_ != nullptr)
+        {
+            munmap(sqes_, sqesBytes_);
+        }
+        if (cqRing_ != nullptr && cqRing_ != sqRing_)
+        {
+            munmap(cqRing_, cqRingBytes_);
+        }
+        if (sqRing_ != nullptr)
+        {
+            munmap(sqRing_, sqRingBytes_);
+        }
+        if (ring_ >= 0)
+        {
+            close(ring_);
+        }
+    }
+
+    bool init(unsigned entries, size_t submitBatch, uint8_t *pool, size_t buffers, size_t bufferBytes)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_ < 0)
+        {
+            return false;
+        }
+        sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+        {
+            sqRingBytes_ = cqRingBytes_ = std::max(sqRingBytes_, cqRingBytes_);
+        }
+        sqRing_ = mapRing(sqRingBytes_, IORING_OFF_SQ_RING);
+        cqRing_ = single ? sqRing_ : mapRing(cqRingBytes_, IORING_OFF_CQ_RING);
+        sqesBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(mapRing(sqesBytes_, IORING_OFF_SQES));
+        if (sqRing_ == nullptr || cqRing_ == nullptr || sqes_ == nullptr)
+        {
+            return false;
+        }
+        uint8_t *sq = static_cast<uint8_t *>(sqRing_);
+        uint8_t *cq = static_cast<uint8_t *>(cqRing_);
+        sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        submitBatch_ = std::max<size_t>(1, submitBatch);
+
+        // プールを登録する。memlock の上限などで断られたら通常の WRITE で続ける
+        std::vector<iovec> iov(buffers);
+        for (size_t i = 0; i < buffers; ++i)
+        {
+            iov[i].iov_base = pool + i * bufferBytes;
+            iov[i].iov_len = bufferBytes;
+        }
+        fixed_ = syscall(__NR_io_uring_register, ring_, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(buffers)) == 0;
+        return true;
+    }
+
+    bool fixedBuffers() const { return fixed_; }
+
+    void submit(uint32_t buffer, int fd, const uint8_t *data, size_t length, uint64_t offset) override
+    {
+        const unsigned tail = *sqTail_;
+        const unsigned index = tail & sqMask_;
+        io_uring_sqe &sqe = sqes_[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = fixed_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = static_cast<uint32_t>(length);
+        sqe.off = offset;
+        sqe.buf_index = fixed_ ? static_cast<uint16_t>(buffer) : 0;
+        sqe.user_data = buffer;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        if (pending_++ == 0)
+        {
+            pendingSinceNs_ = monotonicNs();
+        }
+        if (pending_ >= submitBatch_)
+        {
+            enter(0);
+        }
+    }
+
+    size_t reap(bool wait, Completion *out, size_t max) override
+    {
+        size_t n = drain(out, max);
+        // 溜めた投入は、待つとき・溜めてから時間が経ったときだけ入れる (append ごとの syscall を避ける)
+        const bool flush = pending_ > 0 && (wait || monotonicNs() - pendingSinceNs_ > URING_FLUSH_NS);
+        if (flush || (wait && n == 0))
+        {
+            enter(wait && n == 0 ? 1 : 0);
+            n += drain(out + n, max - n);
+        }
+        while (wait && n == 0)
+        {
+            enter(1);
+            n = drain(out, max);
+        }
+        return n;
+    }
+
+private:
+    void *mapRing(size_t bytes, off_t offset)
+    {
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    void enter(unsigned minComplete)
+    {
+        for (;;)
+        {
+            const unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+            const long r = syscall(__NR_io_uring_enter, ring_, static_cast<unsigned>(pending_), minComplete, flags, nullptr, 0);
+            if (r >= 0)
+            {
+                pending_ -= std::min<size_t>(pending_, static_cast<size_t>(r));
+                if (pending_ == 0 || minComplete > 0)
+                {
+                    return;
+                }
+                continue;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                return;
+            }
+            if (errno == EBUSY)
+            {
+                return; // CQ が詰まっている: 呼び出し側が drain してから入れ直す
+            }
+        }
+    }
+
+    size_t drain(Completion *out, size_t max)
+    {
+        unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        size_t n = 0;
+        while (head != tail && n < max)
+        {
+            const io_uring_cqe &cqe = cqes_[head & cqMask_];
+            out[n].buffer = static_cast<uint32_t>(cqe.user_data);
+            out[n].result = cqe.res;
+            n++;
+            head++;
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    int ring_ = -1;
+    void *sqRing_ = nullptr;
+    void *cqRing_ = nullptr;
+    size_t sqRingBytes_ = 0;
+    size_t cqRingBytes_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqesBytes_ = 0;
+    unsigned *sqHead_ = nullptr;
+    unsigned *sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned *sqArray_ = nullptr;
+    unsigned *cqHead_ = nullptr;
+    unsigned *cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+    size_t pending_ = 0; // SQ に置いたがまだ入れていない
+    int64_t pendingSinceNs_ = 0;
+    size_t submitBatch_ = 1;
+    bool fixed_ = false;
+};
+
+// ========= スレッドプール (pwrite) =========
+class ThreadPoolIo : public RecorderIo
+{
+public:
+    explicit ThreadPoolIo(size_t threads)
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, threads); ++i)
+        {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPoolIo() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        jobReady_.notify_all();
+        for (auto &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    void submit(uint32_t buffer, int fd, const uint8_t *data, size_t length, uint64_t offset) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(Job{buffer, fd, data, length, offset});
+        }
+        jobReady_.notify_one();
+    }
+
+    size_t reap(bool wait, Completion *out, size_t max) override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wait)
+        {
+            done_.wait(lock, [this] { return !completions_.empty(); });
+        }
+        size_t n = 0;
+        while (!completions_.empty() && n < max)
+        {
+            out[n++] = completions_.front();
+            completions_.pop_front();
+        }
+        return n;
+    }
+
+private:
+    struct Job
+    {
+        uint32_t buffer;
+        int fd;
+        const uint8_t *data;
+        size_t length;
+        uint64_t offset;
+    };
+
+    void run()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                jobReady_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                {
+                    return;
+                }
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+            // 短い書き込みはここで続きを書く
+            int64_t result = 0;
+            while (static_cast<size_t>(result) < job.length)
+            {
+                const ssize_t w = pwrite(job.fd, job.data + result, job.length - result, job.offset + result);
+                if (w < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (w <= 0)
+                {
+                    result = w < 0 ? -errno : result;
+                    break;
+                }
+                result += w;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                completions_.push_back(Completion{job.buffer, result});
+            }
+            done_.notify_one();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::condition_variable done_;
+    std::deque<Job> jobs_;
+    std::deque<Completion> completions_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+} // namespace
+
+// ========= RecordingWriter =========
+RecordingWriter::RecordingWriter(const RecorderConfig &config) : config_(config)
+{
+    config_.maxFiles = std::max<size_t>(1, config_.maxFiles);
+    config_.queueDepth = std::max<size_t>(1, config_.queueDepth);
+}
+
+RecordingWriter::~RecordingWriter()
+{
+    finish();
+    io_.reset();
+    free(pool_);
+}
+
+bool RecordingWriter::start()
+{
+    if (io_)
+    {
+        return true;
+    }
+    // 各ファイルが詰めている途中の 1 個 + 書き込み中の queueDepth 個
+    bufferBytes_ = alignUp(std::max<size_t>(config_.bufferBytes, RECORDER_ALIGN));
+    const size_t buffers = config_.maxFiles + config_.queueDepth;
+    void *pool = nullptr;
+    if (posix_memalign(&pool, RECORDER_ALIGN, buffers * bufferBytes_) != 0)
+    {
+        return false;
+    }
+    pool_ = static_cast<uint8_t *>(pool);
+    memset(pool_, 0, buffers * bufferBytes_);
+    freeBuffers_.clear();
+    for (size_t i = buffers; i-- > 0;)
+    {
+        freeBuffers_.push_back(static_cast<uint32_t>(i));
+    }
+    writes_.assign(buffers, Write{-1, 0, 0, 0});
+    files_.assign(config_.maxFiles, File());
+
+    if (config_.backend != RECORDER_BACKEND_THREADS)
+    {
+        std::unique_ptr<UringIo> uring(new UringIo());
+        if (uring->init(static_cast<unsigned>(config_.queueDepth), config_.submitBatch, pool_, buffers, bufferBytes_))
+        {
+            stats_.fixedBuffers = uring->fixedBuffers();
+            io_ = std::move(uring);
+            backend_ = RECORDER_BACKEND_URING;
+            return true;
+        }
+        if (config_.backend == RECORDER_BACKEND_URING)
+        {
+            return false;
+        }
+    }
+    io_.reset(new ThreadPoolIo(config_.threads));
+    backend_ = RECORDER_BACKEND_THREADS;
+    return true;
+}
+
+const char *RecordingWriter::backendName() const
+{
+    switch (backend_)
+    {
+    case RECORDER_BACKEND_URING:
+        return stats_.fixedBuffers ? "io_uring (fixed buffers)" : "io_uring";
+    case RECORDER_BACKEND_THREADS:
+        return "threads";
+    default:
+        return "none";
+    }
+}
+
+int RecordingWriter::openFile(const char *path)
+{
+    if (!io_)
+    {
+        return -1;
+    }
+    const auto slot = std::find_if(files_.begin(), files_.end(), [](const File &f) { return f.fd < 0; });
+    if (slot == files_.end())
+    {
+        return -1;
+    }
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = config_.direct ? open(path, flags | O_DIRECT, 0644) : -1;
+    const bool direct = fd >= 0;
+    if (fd < 0)
+    {
+        fd = open(path, flags, 0644);
+    }
+    if (fd < 0)
+    {
+        return -1;
+    }
+    *slot = File();
+    slot->fd = fd;
+    slot->direct = direct;
+    stats_.directFiles += direct ? 1 : 0;
+    return static_cast<int>(slot - files_.begin());
+}
+
+bool RecordingWriter::append(int file, const void *data, size_t size)
+{
+    if (file < 0 || static_cast<size_t>(file) >= files_.size() || files_[file].fd < 0 || files_[file].failed)
+    {
+        return false;
+    }
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    stats_.bytes += size;
+    while (size > 0)
+    {
+        if (files_[file].buffer < 0)
+        {
+            files_[file].buffer = acquireBuffer();
+            files_[file].fill = 0;
+        }
+        File &f = files_[file];
+        const size_t take = std::min(size, bufferBytes_ - f.fill);
+        memcpy(bufferData(f.buffer) + f.fill, p, take);
+        f.fill += take;
+        f.size += take;
+        p += take;
+        size -= take;
+        if (f.fill == bufferBytes_)
+        {
+            submitBuffer(file, bufferBytes_);
+        }
+    }
+    // 待たずに済む完了はここで回収しておく (空きバッファを早く戻す)
+    reap(false);
+    return !files_[file].failed;
+}
+
+bool RecordingWriter::closeFile(int file)
+{
+    if (file < 0 || static_cast<size_t>(file) >= files_.size() || files_[file].fd < 0)
+    {
+        return false;
+    }
+    File &f = files_[file];
+    if (f.buffer >= 0 && f.fill > 0)
+    {
+        // O_DIRECT は長さも揃える必要があるので 0 で埋めて書き、後で切り詰める
+        const size_t length = f.direct ? alignUp(f.fill) : f.fill;
+        memset(bufferData(f.buffer) + f.fill, 0, length - f.fill);
+        submitBuffer(file, length);
+    }
+    else if (f.buffer >= 0)
+    {
+        freeBuffers_.push_back(static_cast<uint32_t>(f.buffer));
+        f.buffer = -1;
+    }
+    while (files_[file].inFlight > 0)
+    {
+        reap(true);
+    }
+    File &done = files_[file];
+    bool ok = !done.failed;
+    // 0 埋めした末尾を落とす (途中で O_DIRECT をやめたファイルも埋めて書いている場合がある)
+    if (ftruncate(done.fd, static_cast<off_t>(done.size)) != 0)
+    {
+        ok = false;
+    }
+    ok = close(done.fd) == 0 && ok;
+    done = File();
+    return ok;
+}
+
+void RecordingWriter::finish()
+{
+    for (size_t i = 0; i < files_.size(); ++i)
+    {
+        if (files_[i].fd >= 0)
+        {
+            closeFile(static_cast<int>(i));
+        }
+    }
+}
+
+int RecordingWriter::acquireBuffer()
+{
+    if (freeBuffers_.empty())
+    {
+        // 各ファイルが持つのは 1 個までなので、空きがなければ必ず書き込み中のものがある
+        const int64_t t0 = monotonicNs();
+        while (freeBuffers_.empty())
+        {
+            reap(true);
+        }
+        stats_.stalls++;
+        stats_.stallNs += monotonicNs() - t0;
+    }
+    const uint32_t buffer = freeBuffers_.back();
+    freeBuffers_.pop_back();
+    return static_cast<int>(buffer);
+}
+
+void RecordingWriter::submitBuffer(int file, size_t length)
+{
+    if (inFlight_ >= config_.queueDepth)
+    {
+        const int64_t t0 = monotonicNs();
+        while (inFlight_ >= config_.queueDepth)
+        {
+            reap(true);
+        }
+        stats_.stalls++;
+        stats_.stallNs += monotonicNs() - t0;
+    }
+    File &f = files_[file];
+    const uint32_t buffer = static_cast<uint32_t>(f.buffer);
+    writes_[buffer] = Write{file, f.offset, length, 0};
+    f.offset += length;
+    f.buffer = -1;
+    f.fill = 0;
+    f.inFlight++;
+    inFlight_++;
+    stats_.maxInFlight = std::max(stats_.maxInFlight, inFlight_);
+    io_->submit(buffer, f.fd, bufferData(buffer), length, writes_[buffer].offset);
+}
+
+void RecordingWriter::reap(bool wait)
+{
+    RecorderIo::Completion done[64];
+    const size_t n = io_->reap(wait && inFlight_ > 0, done, 64);
+    for (size_t i = 0; i < n; ++i)
+    {
+        complete(done[i].buffer, done[i].result);
+    }
+}
+
+void RecordingWriter::complete(uint32_t buffer, int64_t result)
+{
+    Write &w = writes_[buffer];
+    File &f = files_[w.file];
+    if (result == -EINVAL && f.direct && w.done == 0)
+    {
+        // open は通っても書き込みで O_DIRECT を断るファイルシステムがある: このファイルは通常書き込みに戻す
+        const int flags = fcntl(f.fd, F_GETFL);
+        if (flags >= 0 && fcntl(f.fd, F_SETFL, flags & ~O_DIRECT) == 0)
+        {
+            f.direct = false;
+            stats_.directFiles--;
+            io_->submit(buffer, f.fd, bufferData(buffer), w.length, w.offset);
+            return;
+        }
+    }
+    if (result > 0 && w.done + static_cast<size_t>(result) < w.length)
+    {
+        // 短い書き込み: 残りを同じバッファから投げ直す
+        w.done += static_cast<size_t>(result);
+        stats_.shortWrites++;
+        io_->submit(buffer, f.fd, bufferData(buffer) + w.done, w.length - w.done, w.offset + w.done);
+        return;
+    }
+    if (result <= 0)
+    {
+        stats_.errors++;
+        f.failed = true;
+    }
+    stats_.writes++;
+    f.inFlight--;
+    inFlight_--;
+    freeBuffers_.push_back(buffer);
+}
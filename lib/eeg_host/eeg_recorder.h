@@ -0,0 +1,123 @@
+// 多ストリームの記録用ライタ (ホスト側)
+//
+// append() は呼び出し側のデータを固定長のバッファ (4 KiB 境界に揃えたプール) へ詰めるだけで、
+// バッファが埋まったらファイル位置を指定した書き込みとして非同期に投げ、次のバッファへ移る。
+// 書き込みの完了を刈り取ったバッファは空きリストへ戻して使い回す。ディスクが遅いときに待つのは
+// 「空きバッファがない」か「同時書き込み数が queueDepth に達した」ときだけで、その時間は stallNs に出る。
+//
+// バックエンド:
+//   io_uring : liburing を使わず syscall で直接叩く。プールを IORING_REGISTER_BUFFERS で登録して
+//              WRITE_FIXED を使う (登録できなければ通常の WRITE)。投入は submitBatch 個ずつまとめて
+//              1 回の io_uring_enter で入れる。
+//   threads  : io_uring が使えない (古いカーネル / seccomp で禁止) ときの代わり。
+//              pwrite() するワーカースレッド群とジョブキュー。
+//
+// O_DIRECT はファイルごとに試し、使えないファイルシステムなら通常の書き込みに戻す。
+// O_DIRECT のファイルは最後の端数を 4 KiB まで 0 で埋めて書き、閉じるときに実際の長さへ切り詰める。
+//
+// ライタ自体はスレッドセーフではない。1 本のスレッド (シンクのスレッドなど) から使うこと。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+constexpr size_t RECORDER_ALIGN = 4096;
+
+enum RecorderBackend : uint8_t
+{
+    RECORDER_BACKEND_AUTO = 0, // io_uring → だめなら threads
+    RECORDER_BACKEND_URING,
+    RECORDER_BACKEND_THREADS,
+};
+
+struct RecorderConfig
+{
+    size_t maxFiles = 64;
+    size_t bufferBytes = 256 * 1024; // RECORDER_ALIGN の倍数に切り上げる
+    size_t queueDepth = 32;          // 同時に投げておく書き込みの上限
+    size_t submitBatch = 4;          // io_uring: これだけ溜まったら投入する
+    size_t threads = 4;              // threads バックエンドのワーカー数
+    bool direct = true;              // O_DIRECT を試す
+    RecorderBackend backend = RECORDER_BACKEND_AUTO;
+};
+
+struct RecorderStats
+{
+    uint64_t bytes = 0;       // append された量
+    uint64_t writes = 0;      // 完了した書き込み
+    uint64_t shortWrites = 0; // 残りを投げ直した
+    uint64_t errors = 0;
+    uint64_t stalls = 0;      // append が完了待ちに入った回数
+    int64_t stallNs = 0;
+    size_t maxInFlight = 0;
+    size_t directFiles = 0;
+    bool fixedBuffers = false; // io_uring の登録済みバッファを使っている
+};
+
+class RecorderIo;
+
+class RecordingWriter
+{
+public:
+    explicit RecordingWriter(const RecorderConfig &config);
+    ~RecordingWriter();
+
+    RecordingWriter(const RecordingWriter &) = delete;
+    RecordingWriter &operator=(const RecordingWriter &) = delete;
+
+    // バッファを確保してバックエンドを選ぶ。URING を指定して使えなければ false
+    bool start();
+    RecorderBackend backend() const { return backend_; }
+    const char *backendName() const;
+
+    // 失敗 (maxFiles 超過 / open できない) なら -1
+    int openFile(const char *path);
+    bool append(int file, const void *data, size_t size);
+    // 端数を書き、このファイルの書き込みが全部終わるのを待って閉じる
+    bool closeFile(int file);
+    // 開いているファイルを全部閉じる
+    void finish();
+
+    const RecorderStats &stats() const { return stats_; }
+
+private:
+    struct File
+    {
+        int fd = -1;
+        bool direct = false;
+        bool failed = false;
+        int buffer = -1;     // 詰めている途中のバッファ
+        size_t fill = 0;
+        uint64_t offset = 0; // 次に投げる書き込みのファイル位置
+        uint64_t size = 0;   // 実際の長さ (0 埋めを除く)
+        size_t inFlight = 0;
+    };
+
+    struct Write
+    {
+        int file;
+        uint64_t offset;
+        size_t length;
+        size_t done;
+    };
+
+    int acquireBuffer();
+    void submitBuffer(int file, size_t length);
+    void reap(bool wait);
+    void complete(uint32_t buffer, int64_t result);
+    uint8_t *bufferData(uint32_t buffer) const { return pool_ + static_cast<size_t>(buffer) * bufferBytes_; }
+
+    RecorderConfig config_;
+    RecorderBackend backend_ = RECORDER_BACKEND_AUTO;
+    std::unique_ptr<RecorderIo> io_;
+    uint8_t *pool_ = nullptr;
+    size_t bufferBytes_ = 0;
+    std::vector<uint32_t> freeBuffers_;
+    std::vector<Write> writes_; // バッファ番号ごと
+    std::vector<File> files_;
+    size_t inFlight_ = 0;
+    RecorderStats stats_;
+};
@@ -0,0 +1,125 @@
+#include "eeg_recording_compressor.h"
+
+#define ZSTD_STATIC_LINKING_ONLY // ZSTD_createThreadPool / ZSTD_CCtx_refThreadPool
+#include <zstd.h>
+
+ZstdWorkerPool::ZstdWorkerPool(size_t threads) : pool_(threads > 0 ? ZSTD_createThreadPool(threads) : nullptr) {}
+
+ZstdWorkerPool::~ZstdWorkerPool()
+{
+    ZSTD_freeThreadPool(static_cast<ZSTD_threadPool *>(pool_));
+}
+
+CompressedRecording::CompressedRecording(RecordingWriter &writer, const RecordingCompressionConfig &config, ZstdWorkerPool *pool)
+    : writer_(writer), config_(config), pool_(pool)
+{
+}
+
+CompressedRecording::~CompressedRecording()
+{
+    if (file_ >= 0)
+    {
+        close();
+    }
+    ZSTD_freeCCtx(cctx_);
+}
+
+bool CompressedRecording::multithreadAvailable()
+{
+    return ZSTD_cParam_getBounds(ZSTD_c_nbWorkers).upperBound > 0;
+}
+
+bool CompressedRecording::open(const char *path)
+{
+    if (file_ >= 0)
+    {
+        return false;
+    }
+    if (cctx_ == nullptr)
+    {
+        cctx_ = ZSTD_createCCtx();
+        if (cctx_ == nullptr)
+        {
+            return false;
+        }
+    }
+    ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_and_parameters);
+    // nbWorkers は MT なしのビルドではエラーになるので、その場合は 0 のまま続ける
+    bool ok = !ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, config_.level)) &&
+              !ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_checksumFlag, config_.checksum ? 1 : 0));
+    if (ok && config_.workers > 0 && multithreadAvailable())
+    {
+        ok = !ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_nbWorkers, config_.workers));
+        if (ok && config_.jobBytes > 0)
+        {
+            ok = !ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_jobSize, static_cast<int>(config_.jobBytes)));
+        }
+        if (ok && pool_ != nullptr && pool_->handle() != nullptr)
+        {
+            ok = !ZSTD_isError(ZSTD_CCtx_refThreadPool(cctx_, static_cast<ZSTD_threadPool *>(pool_->handle())));
+        }
+    }
+    if (!ok)
+    {
+        return false;
+    }
+    file_ = writer_.openFile(path);
+    failed_ = file_ < 0;
+    bytesIn_ = 0;
+    bytesOut_ = 0;
+    return file_ >= 0;
+}
+
+bool CompressedRecording::append(const void *data, size_t size)
+{
+    bytesIn_ += size;
+    return drive(data, size, false);
+}
+
+bool CompressedRecording::close()
+{
+    if (file_ < 0)
+    {
+        return false;
+    }
+    const bool ok = drive(nullptr, 0, true);
+    const bool closed = writer_.closeFile(file_);
+    file_ = -1;
+    return ok && closed;
+}
+
+// 入力を渡し切るまで (end なら フレームを閉じ切るまで) 圧縮を進め、出てきた分を書く。
+// workers > 0 のときは、ジョブの空きができるのを待つ場合を除いてすぐ戻る
+bool CompressedRecording::drive(const void *data, size_t size, bool end)
+{
+    if (file_ < 0 || failed_)
+    {
+        return false;
+    }
+    ZSTD_inBuffer in = {data, size, 0};
+    for (;;)
+    {
+        ZSTD_outBuffer out = {out_, sizeof(out_), 0};
+        const size_t remaining = ZSTD_compressStream2(cctx_, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining))
+        {
+            failed_ = true;
+            return false;
+        }
+        if (out.pos > 0)
+        {
+            bytesOut_ += out.pos;
+            if (!writer_.append(file_, out_, out.pos))
+            {
+                failed_ = true;
+                return false;
+            }
+        }
+        const bool done = end ? remaining == 0 : in.pos == in.size;
+        // 出力バッファが埋まったなら、まだ出せる圧縮データが残っている
+        if (done && out.pos < out.size)
+        {
+            return true;
+        }
+    }
+}
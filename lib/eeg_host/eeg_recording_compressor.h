@@ -0,0 +1,77 @@
+// 記録ファイルの zstd 圧縮 (ホスト側)
+//
+// CompressedRecording は append() されたデータを zstd のストリーム圧縮に通し、出てきた圧縮データを
+// RecordingWriter のファイルへ流す。ホストのビルドでは lib/zstd を ZSTD_MULTITHREAD 付きで作るので、
+// workers > 0 なら入力は jobBytes ごとのジョブに分かれ、ワーカースレッドで並列に圧縮される
+// (呼び出し側は入力をジョブに積むだけで待たない)。出力は 1 フレームの普通の .zst で、
+// workers の値によらず zstd -d でそのまま展開できる。
+//
+// 多数のファイルを同時に圧縮するときは ZstdWorkerPool を共有して、スレッド数をファイル数と無関係に抑える。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeg_recorder.h"
+
+struct ZSTD_CCtx_s;
+
+struct RecordingCompressionConfig
+{
+    int level = 3;
+    int workers = 0;      // ZSTD_c_nbWorkers。0 = 呼び出しスレッドで圧縮する
+    size_t jobBytes = 0;  // ZSTD_c_jobSize。0 = zstd の既定 (レベルから決まる)
+    bool checksum = true; // フレーム末尾に内容のチェックサム
+};
+
+// 複数の CompressedRecording で共有する圧縮スレッド
+class ZstdWorkerPool
+{
+public:
+    explicit ZstdWorkerPool(size_t threads);
+    ~ZstdWorkerPool();
+
+    ZstdWorkerPool(const ZstdWorkerPool &) = delete;
+    ZstdWorkerPool &operator=(const ZstdWorkerPool &) = delete;
+
+    void *handle() const { return pool_; }
+
+private:
+    void *pool_ = nullptr; // ZSTD_threadPool
+};
+
+class CompressedRecording
+{
+public:
+    CompressedRecording(RecordingWriter &writer, const RecordingCompressionConfig &config, ZstdWorkerPool *pool = nullptr);
+    ~CompressedRecording();
+
+    CompressedRecording(const CompressedRecording &) = delete;
+    CompressedRecording &operator=(const CompressedRecording &) = delete;
+
+    // zstd が ZSTD_MULTITHREAD 付きでビルドされているか (workers > 0 が効くか)
+    static bool multithreadAvailable();
+
+    bool open(const char *path);
+    bool append(const void *data, size_t size);
+    // フレームを閉じ、残りの圧縮データを書いてファイルを閉じる
+    bool close();
+
+    uint64_t bytesIn() const { return bytesIn_; }
+    uint64_t bytesOut() const { return bytesOut_; }
+
+private:
+    bool drive(const void *data, size_t size, bool end);
+
+    static constexpr size_t OUT_BYTES = 16 * 1024;
+
+    RecordingWriter &writer_;
+    RecordingCompressionConfig config_;
+    ZstdWorkerPool *pool_;
+    ZSTD_CCtx_s *cctx_ = nullptr;
+    int file_ = -1;
+    bool failed_ = false;
+    uint64_t bytesIn_ = 0;
+    uint64_t bytesOut_ = 0;
+    uint8_t out_[OUT_BYTES];
+};
@@ -0,0 +1,193 @@
+#include "eeg_resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr double RESAMPLER_PI = 3.14159265358979323846;
+constexpr double FILL_SERVO_SEC = 20.0;       // 出力位置のずれをこの時定数で戻す
+constexpr double FILL_SERVO_MAX_PPM = 1000.0; // 1 ブロックで掛ける補正の上限
+
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+} // namespace
+
+PolyphaseResampler::PolyphaseResampler(size_t channels, size_t tapsPerPhase, size_t phases, float cutoff)
+    : channels_(channels), taps_(tapsPerPhase), phases_(phases), coeffs_((phases + 1) * tapsPerPhase), row_(tapsPerPhase)
+{
+    // 位相 p の係数 k は、出力点から入力サンプル k までの距離 d = k - p/phases - (taps/2 - 1) で評価する
+    const double beta = 8.0;
+    const double half = taps_ / 2.0;
+    for (size_t p = 0; p <= phases_; ++p)
+    {
+        double sum = 0.0;
+        float *row = &coeffs_[p * taps_];
+        for (size_t k = 0; k < taps_; ++k)
+        {
+            const double d = static_cast<double>(k) - static_cast<double>(p) / phases_ - (half - 1.0);
+            const double x = 2.0 * cutoff * d;
+            const double sinc = fabs(x) < 1e-12 ? 1.0 : sin(RESAMPLER_PI * x) / (RESAMPLER_PI * x);
+            const double w = fabs(d) >= half ? 0.0 : besselI0(beta * sqrt(1.0 - (d / half) * (d / half))) / besselI0(beta);
+            row[k] = static_cast<float>(sinc * w);
+            sum += row[k];
+        }
+        for (size_t k = 0; k < taps_; ++k)
+        {
+            row[k] = static_cast<float>(row[k] / sum); // DC ゲイン 1
+        }
+    }
+    reset();
+}
+
+void PolyphaseResampler::reset()
+{
+    buffer_.assign(taps_ * channels_, 0.0f); // 先頭を無音で埋めて立ち上がりを滑らかにする
+    bufferedFrames_ = taps_;
+    time_ = 0.0;
+}
+
+void PolyphaseResampler::computeRow(double frac, float *row) const
+{
+    const double p = frac * phases_;
+    const size_t pi = std::min(static_cast<size_t>(p), phases_ - 1);
+    const float pf = static_cast<float>(p - pi);
+    const float *a = &coeffs_[pi * taps_];
+    const float *b = a + taps_;
+    for (size_t k = 0; k < taps_; ++k)
+    {
+        row[k] = a[k] + pf * (b[k] - a[k]);
+    }
+}
+
+size_t PolyphaseResampler::process(const float *in, size_t inFrames, float *out, size_t maxOutFrames)
+{
+    if (inFrames > 0)
+    {
+        buffer_.resize((bufferedFrames_ + inFrames) * channels_);
+        memcpy(&buffer_[bufferedFrames_ * channels_], in, inFrames * channels_ * sizeof(float));
+        bufferedFrames_ += inFrames;
+    }
+
+    size_t produced = 0;
+    float *row = row_.data();
+    while (produced < maxOutFrames)
+    {
+        const size_t i = static_cast<size_t>(time_);
+        if (i + taps_ > bufferedFrames_)
+        {
+            break;
+        }
+        computeRow(time_ - i, row);
+
+        float *__restrict acc = out + produced * channels_;
+        const float *__restrict x = &buffer_[i * channels_];
+        for (size_t c = 0; c < channels_; ++c)
+        {
+            acc[c] = 0.0f;
+        }
+        for (size_t k = 0; k < taps_; ++k)
+        {
+            const float ck = row[k];
+            const float *__restrict xk = x + k * channels_;
+            for (size_t c = 0; c < channels_; ++c)
+            {
+                acc[c] += ck * xk[c];
+            }
+        }
+        produced++;
+        time_ += ratio_;
+    }
+
+    // 以後参照しない入力を捨てる
+    const size_t consumed = std::min(static_cast<size_t>(time_), bufferedFrames_);
+    if (consumed > 0)
+    {
+        memmove(buffer_.data(), buffer_.data() + consumed * channels_, (bufferedFrames_ - consumed) * channels_ * sizeof(float));
+        bufferedFrames_ -= consumed;
+        buffer_.resize(bufferedFrames_ * channels_);
+        time_ -= consumed;
+    }
+    return produced;
+}
+
+RateTracker::RateTracker(double nominalRateHz, double bandwidthHz)
+    : nominal_(nominalRateHz), bandwidth_(bandwidthHz), basePeriod_(1.0 / nominalRateHz)
+{
+}
+
+void RateTracker::update(size_t frames, double hostTimeSec)
+{
+    if (frames == 0)
+    {
+        return;
+    }
+    if (blocks_++ == 0)
+    {
+        predicted_ = hostTimeSec;
+        return;
+    }
+    // 2 次 DLL: 位相誤差で予測時刻と周期を補正する (ω = 2π B T_block)
+    const double blockSec = frames * (basePeriod_ + correction_);
+    const double omega = 2.0 * RESAMPLER_PI * bandwidth_ * blockSec;
+    const double b = sqrt(2.0) * omega;
+    const double c = omega * omega;
+    predicted_ += blockSec;
+    const double err = hostTimeSec - predicted_;
+    predicted_ += b * err;
+    correction_ += c * err / frames;
+}
+
+void RateTracker::setDeviceClockPpm(double ppm)
+{
+    basePeriod_ = 1.0 / (nominal_ * (1.0 + ppm * 1e-6));
+    if (!feedForward_)
+    {
+        feedForward_ = true;
+        correction_ = 0.0;
+    }
+}
+
+AsyncSampleRateConverter::AsyncSampleRateConverter(size_t channels, double nominalInputHz, double outputHz)
+    : tracker_(nominalInputHz), resampler_(channels), outputHz_(outputHz)
+{
+    resampler_.setRatio(nominalInputHz / outputHz);
+}
+
+void AsyncSampleRateConverter::push(const float *in, size_t frames, double arrivalSec, std::vector<float> &out)
+{
+    tracker_.update(frames, arrivalSec);
+    // 前のブロックまでの出力の不足分を比例で戻す。足りなければ ratio を下げて多めに出す
+    const double servo = std::max(-FILL_SERVO_MAX_PPM, std::min(FILL_SERVO_MAX_PPM, fillError_ / (FILL_SERVO_SEC * outputHz_) * 1e6));
+    resampler_.setRatio(tracker_.rateHz() / outputHz_ * (1.0 - servo * 1e-6));
+
+    const size_t channels = resampler_.channels();
+    const size_t maxOut = static_cast<size_t>(frames / resampler_.ratio()) + 2;
+    const size_t base = out.size() / channels;
+    out.resize((base + maxOut) * channels);
+    const size_t produced = resampler_.process(in, frames, out.data() + base * channels, maxOut);
+    out.resize((base + produced) * channels);
+
+    // 最初のブロック以降、出力はホスト時刻に対して outputHz で増えるはず
+    if (!started_)
+    {
+        started_ = true;
+        originSec_ = tracker_.smoothedTimeSec();
+        return;
+    }
+    produced_ += produced;
+    fillError_ = (tracker_.smoothedTimeSec() - originSec_) * outputHz_ - static_cast<double>(produced_);
+}
@@ -0,0 +1,99 @@
+// デバイスのストリームをホスト時計に載せ替える非同期サンプルレート変換 (ASRC)
+//
+//   - PolyphaseResampler : Kaiser 窓 sinc の多相フィルタ。隣接位相の係数を線形補間し、
+//                          チャネル方向 (インタリーブ) に内積を取るのでチャネル数に対してベクトル化される。
+//   - RateTracker        : パケット到着時刻に 2 次 DLL をかけ、ホスト時計でのデバイスのサンプルレートを推定する。
+//                          クロック同期の推定値 (ppm) があれば前置き (feed-forward) にし、DLL はその残りだけを補正する。
+//   - AsyncSampleRateConverter : 両者をつないだもの。到着したブロックを入れると出力レートのフレームが出る。
+//                          推定レートに加え、出力済みフレーム数と (DLL で均した) ホスト時刻のずれを比例制御で戻すので、
+//                          収束までの推定誤差が出力の位置ずれとして残らない。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler(size_t channels, size_t tapsPerPhase = 24, size_t phases = 128, float cutoff = 0.45f);
+
+    // 出力 1 フレームあたりに進む入力フレーム数 (= 入力レート / 出力レート)
+    void setRatio(double inputPerOutput) { ratio_ = inputPerOutput; }
+    double ratio() const { return ratio_; }
+
+    // インタリーブされた入力を全て取り込み、作れるだけ出力する。書いたフレーム数を返す。
+    // maxOutFrames で止まった場合、残りは次回の呼び出しで出力される。
+    size_t process(const float *in, size_t inFrames, float *out, size_t maxOutFrames);
+
+    void reset();
+    size_t channels() const { return channels_; }
+    size_t latencyFrames() const { return taps_ / 2; }
+
+private:
+    void computeRow(double frac, float *row) const;
+
+    size_t channels_;
+    size_t taps_;
+    size_t phases_;
+    std::vector<float> coeffs_; // (phases_ + 1) x taps_
+    std::vector<float> buffer_; // 未消費の入力フレーム (インタリーブ)
+    std::vector<float> row_;
+    size_t bufferedFrames_ = 0;
+    double time_ = 0.0; // 次の出力の位置 (buffer_ 先頭からの入力フレーム単位)
+    double ratio_ = 1.0;
+};
+
+class RateTracker
+{
+public:
+    // bandwidthHz: DLL のループ帯域。BLE の到着ジッタ (数十 ms) を均すため既定は 0.002Hz (収束に ~3 分)。
+    // 収束までの出力位置のずれは AsyncSampleRateConverter の servo が戻すので、推定の精度を優先して狭くしている
+    explicit RateTracker(double nominalRateHz, double bandwidthHz = 0.002);
+
+    // frames 個のサンプルを含むブロックが hostTimeSec に届いた
+    void update(size_t frames, double hostTimeSec);
+
+    // クロック同期からの推定 (デバイスのずれ ppm) を前置きにする。最初の 1 回は DLL がそれまでに積んだ補正を捨て、
+    // 以後は前置きを差し替えても DLL の補正 (前置きに残る偏り) を保つ
+    void setDeviceClockPpm(double ppm);
+
+    double rateHz() const { return 1.0 / (basePeriod_ + correction_); }
+    double ppm() const { return (rateHz() / nominal_ - 1.0) * 1e6; }
+    bool locked() const { return blocks_ > 8; }
+    // 直近ブロックの到着時刻を DLL で均したもの (ジッタを除いたホスト時刻)
+    double smoothedTimeSec() const { return predicted_; }
+
+private:
+    double nominal_;
+    double bandwidth_;
+    double basePeriod_;        // 前置き (なければ公称値)
+    double correction_ = 0.0;  // DLL が積んだ周期の補正
+    bool feedForward_ = false;
+    double predicted_ = 0.0;
+    uint64_t blocks_ = 0;
+};
+
+class AsyncSampleRateConverter
+{
+public:
+    AsyncSampleRateConverter(size_t channels, double nominalInputHz, double outputHz);
+
+    // 到着したブロックを変換して out に追記する
+    void push(const float *in, size_t frames, double arrivalSec, std::vector<float> &out);
+
+    RateTracker &tracker() { return tracker_; }
+    const PolyphaseResampler &resampler() const { return resampler_; }
+    // ホスト時刻から見た出力の不足 (フレーム、正なら出力が遅れている)
+    double fillErrorFrames() const { return fillError_; }
+
+private:
+    RateTracker tracker_;
+    PolyphaseResampler resampler_;
+    double outputHz_;
+    bool started_ = false;
+    double originSec_ = 0.0;   // 最初のブロックの均した到着時刻
+    uint64_t produced_ = 0;    // 最初のブロックより後に出力したフレーム数
+    double fillError_ = 0.0;
+};
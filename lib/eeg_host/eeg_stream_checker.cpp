@@ -0,0 +1,243 @@
+#include "eeg_stream_checker.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "eeg_signal_generator.h"
+
+StreamChecker::StreamChecker(const StreamCheckLimits &limits)
+    : limits_(limits), framer_(*this)
+{
+    const float freqs[NUM_BINS] = {ALPHA_FREQ_HZ, BETA_FREQ_HZ, limits_.referenceHz[0], limits_.referenceHz[1]};
+    for (size_t b = 0; b < NUM_BINS; ++b)
+    {
+        coeff_[b] = 2.0f * cosf(2.0f * EEG_PI * freqs[b] / SAMPLE_RATE_HZ);
+    }
+}
+
+void StreamChecker::onResync(size_t skippedBytes)
+{
+    resyncs_++;
+    skippedBytes_ += skippedBytes;
+    bytes_ += skippedBytes;
+}
+
+void StreamChecker::onCrcError(uint8_t type)
+{
+    (void)type;
+    crcErrors_++;
+}
+
+void StreamChecker::onPacket(uint8_t type, const uint8_t *data, size_t size)
+{
+    // 設定パケットではトレーラの有無が onPacket より先に切り替わっている
+    const bool withCrc = framer_.crcTrailer();
+    crcPackets_ += withCrc ? 1 : 0;
+    bytes_ += size + (withCrc ? PACKET_CRC_BYTES : 0);
+    packets_++;
+    if (type == PKT_TYPE_DEVICE_CFG)
+    {
+        // 新しいセッション: インデックスもパルスも最初から
+        configPackets_++;
+        haveIndex_ = true;
+        expectedIndex_ = 0;
+        closePulse(true);
+        digest_.startSession();
+        return;
+    }
+    if (type == PKT_TYPE_STREAM_DIGEST)
+    {
+        StreamDigestPacket checkpoint;
+        memcpy(&checkpoint, data, sizeof(checkpoint));
+        digest_.onCheckpoint(checkpoint);
+        return;
+    }
+    if (type != PKT_TYPE_DATA_CHUNK)
+    {
+        otherPackets_++;
+        return;
+    }
+
+    digest_.onChunk(data, size);
+    ChunkedSamplePacket chunk;
+    memcpy(&chunk, data, sizeof(chunk));
+    if (chunk.num_samples != SAMPLES_PER_CHUNK)
+    {
+        badNumSamples_++;
+    }
+    if (haveIndex_ && chunk.start_index != expectedIndex_)
+    {
+        const uint16_t ahead = static_cast<uint16_t>(chunk.start_index - expectedIndex_);
+        if (ahead < 0x8000)
+        {
+            gaps_++;
+            missingSamples_ += ahead;
+        }
+        else
+        {
+            duplicates_++;
+        }
+        closePulse(true);
+    }
+    haveIndex_ = true;
+    expectedIndex_ = static_cast<uint16_t>(chunk.start_index + SAMPLES_PER_CHUNK);
+
+    for (size_t i = 0; i < SAMPLES_PER_CHUNK; ++i)
+    {
+        onSample(chunk.samples[i]);
+    }
+}
+
+void StreamChecker::closePulse(bool interrupted)
+{
+    if (pulseWidth_ == 0)
+    {
+        return;
+    }
+    pulses_++;
+    if (interrupted)
+    {
+        pulsesInterrupted_++;
+    }
+    else if (pulseWidth_ != TRIGGER_PULSE_WIDTH_SAMPLES)
+    {
+        pulseWidthErrors_++;
+    }
+    pulseValue_ = 0;
+    pulseWidth_ = 0;
+}
+
+void StreamChecker::onSample(const SampleData &sample)
+{
+    samples_++;
+
+    const uint8_t trig = sample.trigger_state;
+    if (trig != pulseValue_)
+    {
+        closePulse(false);
+        pulseValue_ = trig;
+    }
+    if (trig != 0)
+    {
+        pulseWidth_++;
+    }
+    if (sample.reserved[0] != trig || sample.reserved[1] != (trig ? 0xA5 : 0x00))
+    {
+        reservedMismatches_++;
+    }
+
+    for (size_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        const int16_t v = sample.signals[ch];
+        minCount_ = v < minCount_ ? v : minCount_;
+        maxCount_ = v > maxCount_ ? v : maxCount_;
+        if (v >= INT16_MAX || v <= INT16_MIN + 1)
+        {
+            clipped_++;
+        }
+        if (v > limits_.maxAbsCounts || v < -limits_.maxAbsCounts)
+        {
+            outOfBound_++;
+        }
+        const float x = static_cast<float>(v);
+        for (size_t b = 0; b < NUM_BINS; ++b)
+        {
+            const float s0 = x + coeff_[b] * s1_[b][ch] - s2_[b][ch];
+            s2_[b][ch] = s1_[b][ch];
+            s1_[b][ch] = s0;
+        }
+    }
+
+    if (++blockFill_ == GOERTZEL_BLOCK)
+    {
+        for (size_t b = 0; b < NUM_BINS; ++b)
+        {
+            for (size_t ch = 0; ch < CH_MAX; ++ch)
+            {
+                const float a = s1_[b][ch];
+                const float c = s2_[b][ch];
+                power_[b][ch] += a * a + c * c - coeff_[b] * a * c;
+                s1_[b][ch] = 0.0f;
+                s2_[b][ch] = 0.0f;
+            }
+        }
+        blockFill_ = 0;
+        blocks_++;
+    }
+}
+
+void StreamChecker::finish()
+{
+    framer_.finish();
+    closePulse(true);
+}
+
+namespace
+{
+
+double sumPower(const double (&power)[CH_MAX])
+{
+    double s = 0.0;
+    for (size_t ch = 0; ch < CH_MAX; ++ch)
+    {
+        s += power[ch];
+    }
+    return s;
+}
+
+} // namespace
+
+bool StreamChecker::passed() const
+{
+    const double ref = (sumPower(power_[2]) + sumPower(power_[3])) * 0.5;
+    const bool spectrumOk = blocks_ > 0 && sumPower(power_[0]) >= ref * limits_.minPeakRatio && sumPower(power_[1]) >= ref * limits_.minPeakRatio;
+    return resyncs_ == 0 && crcErrors_ == 0 && gaps_ == 0 && duplicates_ == 0 && badNumSamples_ == 0 && pulseWidthErrors_ == 0 &&
+           reservedMismatches_ == 0 && outOfBound_ == 0 && clipped_ == 0 && spectrumOk && digest_.mismatches() == 0;
+}
+
+void StreamChecker::writeJson(FILE *fp, const char *name, int indent) const
+{
+    const double ref = (sumPower(power_[2]) + sumPower(power_[3])) * 0.5;
+    const double alphaRatio = ref > 0.0 ? sumPower(power_[0]) / ref : 0.0;
+    const double betaRatio = ref > 0.0 ? sumPower(power_[1]) / ref : 0.0;
+    const bool framingOk = resyncs_ == 0 && crcErrors_ == 0;
+    const bool continuityOk = gaps_ == 0 && duplicates_ == 0 && badNumSamples_ == 0;
+    const bool triggerOk = pulseWidthErrors_ == 0 && reservedMismatches_ == 0;
+    const bool amplitudeOk = outOfBound_ == 0 && clipped_ == 0;
+    const bool spectrumOk = blocks_ > 0 && alphaRatio >= limits_.minPeakRatio && betaRatio >= limits_.minPeakRatio;
+    const bool digestOk = digest_.mismatches() == 0;
+    const char *pad = "        ";
+    const int p = indent < 8 ? indent : 8;
+
+    fprintf(fp, "%.*s{\n", p, pad);
+    fprintf(fp, "%.*s  \"name\": \"%s\",\n", p, pad, name);
+    fprintf(fp, "%.*s  \"pass\": %s,\n", p, pad, passed() ? "true" : "false");
+    fprintf(fp, "%.*s  \"bytes\": %llu, \"packets\": %llu, \"samples\": %llu, \"duration_s\": %.3f,\n", p, pad,
+            static_cast<unsigned long long>(bytes_), static_cast<unsigned long long>(packets_),
+            static_cast<unsigned long long>(samples_), samples_ / static_cast<double>(SAMPLE_RATE_HZ));
+    fprintf(fp, "%.*s  \"framing\": {\"pass\": %s, \"config_packets\": %llu, \"other_packets\": %llu, \"resyncs\": %llu, \"skipped_bytes\": %llu, \"crc_packets\": %llu, \"crc_errors\": %llu},\n",
+            p, pad, framingOk ? "true" : "false", static_cast<unsigned long long>(configPackets_),
+            static_cast<unsigned long long>(otherPackets_), static_cast<unsigned long long>(resyncs_),
+            static_cast<unsigned long long>(skippedBytes_), static_cast<unsigned long long>(crcPackets_),
+            static_cast<unsigned long long>(crcErrors_));
+    fprintf(fp, "%.*s  \"continuity\": {\"pass\": %s, \"gaps\": %llu, \"missing_samples\": %llu, \"duplicates\": %llu, \"bad_num_samples\": %llu},\n",
+            p, pad, continuityOk ? "true" : "false", static_cast<unsigned long long>(gaps_),
+            static_cast<unsigned long long>(missingSamples_), static_cast<unsigned long long>(duplicates_),
+            static_cast<unsigned long long>(badNumSamples_));
+    fprintf(fp, "%.*s  \"trigger\": {\"pass\": %s, \"pulses\": %llu, \"width_errors\": %llu, \"interrupted\": %llu, \"reserved_mismatches\": %llu},\n",
+            p, pad, triggerOk ? "true" : "false", static_cast<unsigned long long>(pulses_),
+            static_cast<unsigned long long>(pulseWidthErrors_), static_cast<unsigned long long>(pulsesInterrupted_),
+            static_cast<unsigned long long>(reservedMismatches_));
+    fprintf(fp, "%.*s  \"amplitude\": {\"pass\": %s, \"min\": %d, \"max\": %d, \"limit\": %d, \"out_of_bound\": %llu, \"clipped\": %llu},\n",
+            p, pad, amplitudeOk ? "true" : "false", samples_ ? minCount_ : 0, samples_ ? maxCount_ : 0,
+            limits_.maxAbsCounts, static_cast<unsigned long long>(outOfBound_), static_cast<unsigned long long>(clipped_));
+    fprintf(fp, "%.*s  \"spectrum\": {\"pass\": %s, \"blocks\": %llu, \"alpha_ratio\": %.2f, \"beta_ratio\": %.2f, \"min_ratio\": %.2f},\n",
+            p, pad, spectrumOk ? "true" : "false", static_cast<unsigned long long>(blocks_), alphaRatio, betaRatio,
+            limits_.minPeakRatio);
+    fprintf(fp, "%.*s  \"digest\": {\"pass\": %s, \"checkpoints\": %llu, \"verified\": %llu, \"mismatches\": %llu, \"unverified\": %llu, \"verified_chunks\": %llu, \"missing_chunks\": %llu, \"pending_chunks\": %u}\n",
+            p, pad, digestOk ? "true" : "false", static_cast<unsigned long long>(digest_.checkpoints()),
+            static_cast<unsigned long long>(digest_.verified()), static_cast<unsigned long long>(digest_.mismatches()),
+            static_cast<unsigned long long>(digest_.unverified()), static_cast<unsigned long long>(digest_.verifiedChunks()),
+            static_cast<unsigned long long>(digest_.missingChunks()), digest_.pendingChunks());
+    fprintf(fp, "%.*s}", p, pad);
+}
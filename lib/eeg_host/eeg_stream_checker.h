@@ -0,0 +1,94 @@
+// 長時間キャプチャの適合性チェック (1 パス・定数メモリ)
+//
+//   - framing    : 未知バイトの読み飛ばし
+//   - continuity : start_index が SAMPLES_PER_CHUNK ずつ進むか (DeviceConfigPacket で 0 から再開)
+//   - trigger    : トリガーパルス幅が TRIGGER_PULSE_WIDTH_SAMPLES か、reserved の写しが一致するか
+//   - amplitude  : |counts| が上限以内か、±32767 に張り付いていないか
+//   - spectrum   : ALPHA_FREQ_HZ / BETA_FREQ_HZ の Goertzel パワーが参照周波数より十分大きいか
+//   - digest     : ダイジェストパケット (0xD6) があれば、受信したチャンクの畳み込みと一致するか
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "eeg_digest_verifier.h"
+#include "eeg_packet_framer.h"
+#include "eeg_protocol.h"
+
+struct StreamCheckLimits
+{
+    int16_t maxAbsCounts = 64;    // ≒366µV
+    float minPeakRatio = 4.0f;    // alpha/beta パワー ÷ 参照周波数パワー
+    float referenceHz[2] = {27.0f, 33.0f}; // SSVEP タグの高調波とも重ならない帯域
+};
+
+class StreamChecker : public PacketFramer::Handler
+{
+public:
+    explicit StreamChecker(const StreamCheckLimits &limits = StreamCheckLimits());
+
+    void feed(const uint8_t *data, size_t size) { framer_.feed(data, size); }
+    void finish();
+
+    bool passed() const;
+    uint64_t samples() const { return samples_; }
+    void writeJson(FILE *fp, const char *name, int indent) const;
+
+    void onPacket(uint8_t type, const uint8_t *data, size_t size) override;
+    void onResync(size_t skippedBytes) override;
+    void onCrcError(uint8_t type) override;
+
+private:
+    // 0: alpha, 1: beta, 2/3: 参照周波数
+    static constexpr size_t NUM_BINS = 4;
+    static constexpr size_t GOERTZEL_BLOCK = SAMPLE_RATE_HZ; // 1 秒 = 1Hz 分解能
+
+    void onSample(const SampleData &sample);
+    void closePulse(bool interrupted);
+
+    StreamCheckLimits limits_;
+    PacketFramer framer_;
+    StreamDigestVerifier digest_;
+
+    // framing
+    uint64_t bytes_ = 0;
+    uint64_t packets_ = 0;
+    uint64_t configPackets_ = 0;
+    uint64_t otherPackets_ = 0;
+    uint64_t resyncs_ = 0;
+    uint64_t skippedBytes_ = 0;
+    uint64_t crcPackets_ = 0;
+    uint64_t crcErrors_ = 0;
+
+    // continuity
+    bool haveIndex_ = false;
+    uint16_t expectedIndex_ = 0;
+    uint64_t samples_ = 0;
+    uint64_t gaps_ = 0;
+    uint64_t missingSamples_ = 0;
+    uint64_t duplicates_ = 0;
+    uint64_t badNumSamples_ = 0;
+
+    // trigger
+    uint8_t pulseValue_ = 0;
+    uint32_t pulseWidth_ = 0;
+    uint64_t pulses_ = 0;
+    uint64_t pulseWidthErrors_ = 0;
+    uint64_t pulsesInterrupted_ = 0;
+    uint64_t reservedMismatches_ = 0;
+
+    // amplitude
+    int16_t minCount_ = INT16_MAX;
+    int16_t maxCount_ = INT16_MIN;
+    uint64_t outOfBound_ = 0;
+    uint64_t clipped_ = 0;
+
+    // spectrum (チャネルごとの Goertzel 状態と累積パワー)
+    float coeff_[NUM_BINS];
+    float s1_[NUM_BINS][CH_MAX] = {};
+    float s2_[NUM_BINS][CH_MAX] = {};
+    double power_[NUM_BINS][CH_MAX] = {};
+    uint32_t blockFill_ = 0;
+    uint64_t blocks_ = 0;
+};
@@ -0,0 +1,203 @@
+#include "eeg_stream_merger.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+StreamMerger::StreamMerger(const MergerConfig &config, BlockHandler handler)
+    : config_(config), handler_(handler), queues_(config.devices), stats_(config.devices)
+{
+    config_.maxQueuedFrames = std::max<size_t>(config_.maxQueuedFrames, 1);
+    for (DeviceQueue &q : queues_)
+    {
+        q.times.resize(config_.maxQueuedFrames);
+        q.samples.resize(config_.maxQueuedFrames * config_.channels);
+    }
+    block_.frames = config_.blockFrames;
+    block_.data.assign(config_.blockFrames * config_.devices * config_.channels, 0);
+    block_.present.assign(config_.blockFrames * config_.devices, 0);
+}
+
+int64_t StreamMerger::slotOf(double time) const
+{
+    return static_cast<int64_t>(llround((time - t0_) * config_.rateHz));
+}
+
+void StreamMerger::push(size_t device, double firstTime, double periodSec, const int16_t *samples, size_t frames)
+{
+    if (device >= queues_.size() || frames == 0)
+    {
+        return;
+    }
+    if (!started_)
+    {
+        // 最初に届いたサンプルを格子の原点にする
+        started_ = true;
+        t0_ = firstTime;
+        block_.firstSlot = 0;
+        block_.startTime = t0_;
+    }
+
+    DeviceQueue &q = queues_[device];
+    MergerDeviceStats &st = stats_[device];
+    const bool wasEmpty = q.count == 0;
+    for (size_t i = 0; i < frames; ++i)
+    {
+        const double t = firstTime + i * periodSec;
+        st.framesIn++;
+        if (q.count == q.times.size())
+        {
+            // 溢れたら最も古いフレームを捨てる (ヒープ上の先頭時刻は popHead で更新される)
+            st.overflowDrops++;
+            q.head = (q.head + 1) % q.times.size();
+            q.count--;
+        }
+        const size_t slot = (q.head + q.count) % q.times.size();
+        q.times[slot] = t;
+        memcpy(&q.samples[slot * config_.channels], samples + i * config_.channels, config_.channels * sizeof(int16_t));
+        q.count++;
+        q.lastTime = t;
+        newestTime_ = t > newestTime_ ? t : newestTime_;
+    }
+    if (wasEmpty)
+    {
+        heap_.push({q.times[q.head], device});
+    }
+    drain(false);
+}
+
+void StreamMerger::popHead(size_t device)
+{
+    DeviceQueue &q = queues_[device];
+    q.head = (q.head + 1) % q.times.size();
+    q.count--;
+    if (q.count > 0)
+    {
+        heap_.push({q.times[q.head], device});
+    }
+}
+
+// 現在のブロックを確定してよいか: 全デバイスがブロック末尾を越えたか、最新時刻から maxSkew 以上遅れている
+bool StreamMerger::blockReady() const
+{
+    const int64_t blockEnd = block_.firstSlot + static_cast<int64_t>(config_.blockFrames);
+    const double blockEndTime = t0_ + (blockEnd - 0.5) / config_.rateHz;
+    if (newestTime_ - blockEndTime > config_.maxSkewSec)
+    {
+        return true;
+    }
+    for (const DeviceQueue &q : queues_)
+    {
+        // drain 後にキューが残っていれば先頭はブロック末尾より後。空なら最後のサンプルが末尾スロットに達したか
+        const bool passed = q.count > 0 || (q.lastTime > -1e300 && slotOf(q.lastTime) >= blockEnd - 1);
+        if (!passed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StreamMerger::emitBlock()
+{
+    for (size_t frame = 0; frame < config_.blockFrames; ++frame)
+    {
+        for (size_t d = 0; d < config_.devices; ++d)
+        {
+            if (!block_.present[frame * config_.devices + d])
+            {
+                stats_[d].missingSlots++;
+            }
+        }
+    }
+    handler_(block_);
+    blocksEmitted_++;
+
+    block_.firstSlot += static_cast<int64_t>(config_.blockFrames);
+    block_.startTime = t0_ + block_.firstSlot / config_.rateHz;
+    std::fill(block_.data.begin(), block_.data.end(), 0);
+    std::fill(block_.present.begin(), block_.present.end(), 0);
+}
+
+void StreamMerger::drain(bool force)
+{
+    if (!started_)
+    {
+        return;
+    }
+    for (;;)
+    {
+        const int64_t blockEnd = block_.firstSlot + static_cast<int64_t>(config_.blockFrames);
+        // ヒープから現在のブロックに入るサンプルを時刻順に取り出す
+        while (!heap_.empty())
+        {
+            const HeapEntry top = heap_.top();
+            DeviceQueue &q = queues_[top.device];
+            // 溢れで先頭が入れ替わった古いエントリは現在の先頭で置き換える
+            if (q.count == 0 || q.times[q.head] != top.time)
+            {
+                heap_.pop();
+                if (q.count > 0)
+                {
+                    heap_.push({q.times[q.head], top.device});
+                }
+                continue;
+            }
+            const int64_t slot = slotOf(top.time);
+            if (slot >= blockEnd)
+            {
+                break;
+            }
+            heap_.pop();
+            if (slot < block_.firstSlot)
+            {
+                stats_[top.device].lateDrops++;
+            }
+            else
+            {
+                const size_t cell = static_cast<size_t>(slot - block_.firstSlot) * config_.devices + top.device;
+                memcpy(&block_.data[cell * config_.channels], &q.samples[q.head * config_.channels], config_.channels * sizeof(int16_t));
+                block_.present[cell] = 1;
+                stats_[top.device].framesPlaced++;
+            }
+            popHead(top.device);
+        }
+
+        if (force)
+        {
+            bool any = false;
+            for (uint8_t p : block_.present)
+            {
+                any = any || p;
+            }
+            if (any)
+            {
+                emitBlock();
+            }
+            if (heap_.empty())
+            {
+                return;
+            }
+            if (!any)
+            {
+                // 欠測だけのブロックは飛ばして次のサンプルの位置まで進める
+                const int64_t next = slotOf(heap_.top().time);
+                const int64_t blocks = (next - block_.firstSlot) / static_cast<int64_t>(config_.blockFrames);
+                block_.firstSlot += (blocks > 0 ? blocks : 1) * static_cast<int64_t>(config_.blockFrames);
+                block_.startTime = t0_ + block_.firstSlot / config_.rateHz;
+            }
+            continue;
+        }
+        if (!blockReady())
+        {
+            return;
+        }
+        emitBlock();
+    }
+}
+
+void StreamMerger::flush()
+{
+    drain(true);
+}
@@ -0,0 +1,98 @@
+// 複数デバイスのストリームを同期済みタイムスタンプで揃えて 1 本にまとめる
+//
+// 各デバイスのサンプルは (タイムスタンプ, 1 フレーム) としてデバイスごとの固定長キューに積み、
+// キュー先頭のタイムスタンプをキーにしたヒープ (k-way merge) で時刻順に取り出す。
+// 出力は rateHz の共通格子 (スロット) に載せた blockFrames フレームのブロックで、
+// 各スロットには最も近いサンプルが入る。遅れているデバイスは maxSkewSec まで待ち、
+// それを超えたら欠測 (present = 0) としてブロックを確定させるので、バッファは有界。
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "eeg_protocol.h"
+
+struct MergerConfig
+{
+    size_t devices = 2;
+    size_t channels = CH_MAX; // 1 フレームのチャンネル数 (キューとブロックはこの数で確保する)
+    double rateHz = SAMPLE_RATE_HZ;
+    double maxSkewSec = 0.5;
+    size_t blockFrames = SAMPLES_PER_CHUNK;
+    size_t maxQueuedFrames = 4096; // デバイスごと
+};
+
+struct MergedBlock
+{
+    int64_t firstSlot;          // 共通格子上の番号 (startTime = t0 + firstSlot / rateHz)
+    double startTime;
+    size_t frames;
+    std::vector<int16_t> data;   // frames x devices x channels
+    std::vector<uint8_t> present; // frames x devices
+};
+
+struct MergerDeviceStats
+{
+    uint64_t framesIn = 0;
+    uint64_t framesPlaced = 0;
+    uint64_t lateDrops = 0;     // 確定済みのブロックより前に届いた
+    uint64_t overflowDrops = 0; // キューが溢れた
+    uint64_t missingSlots = 0;  // 欠測として確定したスロット
+};
+
+class StreamMerger
+{
+public:
+    using BlockHandler = std::function<void(const MergedBlock &)>;
+
+    StreamMerger(const MergerConfig &config, BlockHandler handler);
+
+    // device のフレームを push する。samples はインタリーブ (frames x channels)、
+    // i 番目のフレームの時刻は firstTime + i * periodSec (ホスト / 同期済みの時間軸)
+    void push(size_t device, double firstTime, double periodSec, const int16_t *samples, size_t frames);
+
+    // 入力終端。残りを待たずに全て確定させる
+    void flush();
+
+    const MergerDeviceStats &stats(size_t device) const { return stats_[device]; }
+    uint64_t blocksEmitted() const { return blocksEmitted_; }
+
+private:
+    // フレームのリング。サンプルは channels 個ずつ詰めて持つ
+    struct DeviceQueue
+    {
+        std::vector<double> times;
+        std::vector<int16_t> samples;
+        size_t head = 0;
+        size_t count = 0;
+        double lastTime = -1e300;
+    };
+
+    struct HeapEntry
+    {
+        double time;
+        size_t device;
+        bool operator<(const HeapEntry &o) const { return time > o.time; } // min-heap
+    };
+
+    void drain(bool force);
+    bool blockReady() const;
+    void emitBlock();
+    void popHead(size_t device);
+    int64_t slotOf(double time) const;
+
+    MergerConfig config_;
+    BlockHandler handler_;
+    std::vector<DeviceQueue> queues_;
+    std::vector<MergerDeviceStats> stats_;
+    std::priority_queue<HeapEntry> heap_;
+    MergedBlock block_;
+    bool started_ = false;
+    double t0_ = 0.0;
+    double newestTime_ = -1e300;
+    uint64_t blocksEmitted_ = 0;
+};
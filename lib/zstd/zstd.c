@@ -43,6 +43,8 @@
 #undef  XXH_INLINE_ALL
 #define XXH_INLINE_ALL
 #define ZSTD_LEGACY_SUPPORT 0
+// デバイス (ESP32) ではスレッドを使わない。ホストのビルドは platformio.ini の host_common で
+// -DZSTD_MULTITHREAD を渡して有効にする (ZSTD_c_nbWorkers)
 // #ifndef __EMSCRIPTEN__
 // #define ZSTD_MULTITHREAD
 // #endif
@@ -0,0 +1,153 @@
+// ASRC のベンチマークと追従精度の確認
+//
+//   asrc_bench [--channels 64] [--rate 1000] [--seconds 600] [--ppm 150] [--jitter-ms 30] [--sync-ppm P]
+//
+// 1) スループット: channels ch / rate Hz の入力を seconds 秒分変換し、1 コアに占める割合を出す。
+// 2) 追従精度: ppm ずれたデバイス (250Hz, 10Hz 正弦) のチャンクをジッタ付きで到着させ、
+//    到着時刻だけから推定したレートと、出力の 10Hz 成分の位相の傾きから残留誤差 (ppm) を出す。
+//    出力フレーム数は送ったサンプルの時間分と比べる。--sync-ppm でクロック同期の推定を前置きとして渡す。
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <complex>
+#include <string>
+#include <vector>
+
+#include "eeg_host_clock.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+#include "eeg_resampler.h"
+
+namespace
+{
+
+constexpr double BENCH_PI = 3.14159265358979323846;
+
+void benchThroughput(size_t channels, double rateHz, double seconds)
+{
+    const size_t block = 25;
+    const size_t blocks = static_cast<size_t>(seconds * rateHz / block);
+    std::vector<float> in(block * channels);
+    Pcg32 rng(7);
+    for (float &v : in)
+    {
+        v = rng.nextUniform() - 0.5f;
+    }
+
+    AsyncSampleRateConverter asrc(channels, rateHz, rateHz);
+    std::vector<float> out;
+    out.reserve((block + 4) * channels);
+    size_t produced = 0;
+    const double t0 = cpuSec();
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        out.clear();
+        asrc.push(in.data(), block, (b + 1) * block / rateHz * (1.0 + 100e-6), out);
+        produced += out.size() / channels;
+    }
+    const double cpu = cpuSec() - t0;
+    printf("throughput: %zu ch @ %.0f Hz, %.0f s of input -> %zu frames in %.3f s CPU (%.2f%% of one core, %.0fx real time)\n",
+           channels, rateHz, seconds, produced, cpu, cpu / seconds * 100.0, seconds / cpu);
+}
+
+void benchTracking(double ppm, double jitterMs, double seconds, bool sync, double syncPpm)
+{
+    const size_t channels = CH_MAX;
+    const double deviceHz = SAMPLE_RATE_HZ * (1.0 + ppm * 1e-6); // ホスト時計で見たデバイスのレート
+    const double toneHz = 10.0;
+    const size_t totalSamples = static_cast<size_t>(seconds * deviceHz);
+    Pcg32 rng(11);
+
+    AsyncSampleRateConverter asrc(channels, SAMPLE_RATE_HZ, SAMPLE_RATE_HZ);
+    if (sync)
+    {
+        asrc.tracker().setDeviceClockPpm(syncPpm);
+    }
+    std::vector<float> block(SAMPLES_PER_CHUNK * channels);
+    std::vector<float> out;
+    out.reserve(static_cast<size_t>(seconds * SAMPLE_RATE_HZ * 1.01) * channels);
+
+    size_t sentSamples = 0;
+    for (size_t n0 = 0; n0 + SAMPLES_PER_CHUNK <= totalSamples; n0 += SAMPLES_PER_CHUNK)
+    {
+        for (size_t i = 0; i < SAMPLES_PER_CHUNK; ++i)
+        {
+            const float v = static_cast<float>(sin(2.0 * BENCH_PI * toneHz * (n0 + i) / deviceHz));
+            for (size_t c = 0; c < channels; ++c)
+            {
+                block[i * channels + c] = v;
+            }
+        }
+        const double arrival = (n0 + SAMPLES_PER_CHUNK) / deviceHz + 0.020 + rng.nextUniform() * jitterMs * 1e-3;
+        asrc.push(block.data(), SAMPLES_PER_CHUNK, arrival, out);
+        sentSamples = n0 + SAMPLES_PER_CHUNK;
+    }
+
+    // 後半の出力を 10 秒窓で 10Hz 復調し、位相の傾きから出力側に残った周波数誤差を求める
+    const size_t frames = out.size() / channels;
+    const size_t window = 10 * SAMPLE_RATE_HZ;
+    std::vector<double> phases;
+    for (size_t start = frames / 2; start + window <= frames; start += window)
+    {
+        std::complex<double> acc(0.0, 0.0);
+        for (size_t m = start; m < start + window; ++m)
+        {
+            const double t = static_cast<double>(m) / SAMPLE_RATE_HZ;
+            acc += static_cast<double>(out[m * channels]) * std::polar(1.0, -2.0 * BENCH_PI * toneHz * t);
+        }
+        phases.push_back(std::arg(acc));
+    }
+    double slope = 0.0;
+    for (size_t i = 1; i < phases.size(); ++i)
+    {
+        slope += std::remainder(phases[i] - phases[i - 1], 2.0 * BENCH_PI);
+    }
+    const double residualHz = phases.size() > 1 ? slope / (phases.size() - 1) / (2.0 * BENCH_PI * window / SAMPLE_RATE_HZ) : 0.0;
+
+    printf("tracking: true %+.2f ppm, jitter %.0f ms -> estimated %+.2f ppm, output frames %zu (expected %.0f, fill error %+.2f), "
+           "residual %+.3f ppm\n",
+           ppm, jitterMs, asrc.tracker().ppm(), frames, (sentSamples / deviceHz) * SAMPLE_RATE_HZ, asrc.fillErrorFrames(),
+           residualHz / toneHz * 1e6);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t channels = 64;
+    double rateHz = 1000.0;
+    double seconds = 600.0;
+    double ppm = 150.0;
+    double jitterMs = 30.0;
+    bool sync = false;
+    double syncPpm = 0.0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--channels")
+            channels = strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--rate")
+            rateHz = strtod(argv[i + 1], nullptr);
+        else if (arg == "--seconds")
+            seconds = strtod(argv[i + 1], nullptr);
+        else if (arg == "--ppm")
+            ppm = strtod(argv[i + 1], nullptr);
+        else if (arg == "--jitter-ms")
+            jitterMs = strtod(argv[i + 1], nullptr);
+        else if (arg == "--sync-ppm")
+        {
+            sync = true;
+            syncPpm = strtod(argv[i + 1], nullptr);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--channels N] [--rate HZ] [--seconds S] [--ppm P] [--jitter-ms MS] [--sync-ppm P]\n", argv[0]);
+            return 2;
+        }
+    }
+    benchThroughput(channels, rateHz, seconds);
+    benchTracking(ppm, jitterMs, std::max(seconds, 1200.0), sync, syncPpm);
+    return 0;
+}
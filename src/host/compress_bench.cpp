@@ -0,0 +1,249 @@
+// 記録の zstd 圧縮 (CompressedRecording) のベンチマーク
+//
+//   compress_bench [--devices 16] [--seconds 600] [--levels 1,3,9] [--workers 0,1,2,4] [--job-kb 0] [--dir /tmp/compress_bench.d]
+//
+// 生成器で devices 台 x seconds 秒分の記録 (ingest_bench の記録シンクと同じ形式:
+// 装置番号 u32 + start_index u16 + 25 x 8 ch の int16) をメモリ上に作り、レベルとワーカー数の組み合わせごとに
+// RecordingWriter 経由でファイルへ圧縮して書く。入力 MB/s (append から close まで)・圧縮率を出し、
+// 書いたファイルを展開して元と一致するか確かめる。
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zstd.h>
+
+#include "eeg_host_clock.h"
+#include "eeg_protocol.h"
+#include "eeg_recorder.h"
+#include "eeg_recording_compressor.h"
+#include "eeg_signal_generator.h"
+
+namespace
+{
+
+struct BenchOptions
+{
+    size_t devices = 16;
+    double seconds = 600.0;
+    std::string levels = "1,3,9";
+    std::string workers; // 空 = 0,1,2,4,... hardware_concurrency まで
+    size_t jobKb = 0;
+    std::string dir = "/tmp/compress_bench.d";
+};
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --devices N        devices in the recording (default 16)\n"
+            "  --seconds SEC      recording length (default 600)\n"
+            "  --levels LIST      zstd levels, comma separated (default 1,3,9)\n"
+            "  --workers LIST     ZSTD_c_nbWorkers values (default 0,1,2,4,... up to the core count)\n"
+            "  --job-kb KB        ZSTD_c_jobSize (default: zstd chooses)\n"
+            "  --dir PATH         scratch directory (default /tmp/compress_bench.d)\n",
+            argv0);
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--devices" && hasValue)
+            opt.devices = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seconds" && hasValue)
+            opt.seconds = strtod(argv[++i], nullptr);
+        else if (arg == "--levels" && hasValue)
+            opt.levels = argv[++i];
+        else if (arg == "--workers" && hasValue)
+            opt.workers = argv[++i];
+        else if (arg == "--job-kb" && hasValue)
+            opt.jobKb = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--dir" && hasValue)
+            opt.dir = argv[++i];
+        else
+            return false;
+    }
+    return opt.devices > 0 && opt.seconds > 0;
+}
+
+std::vector<int> parseList(const std::string &text)
+{
+    std::vector<int> values;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        const size_t comma = text.find(',', start);
+        const std::string item = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!item.empty())
+        {
+            values.push_back(atoi(item.c_str()));
+        }
+        if (comma == std::string::npos)
+        {
+            break;
+        }
+        start = comma + 1;
+    }
+    return values;
+}
+
+// チャンク単位でデバイスを順に並べた記録 (受信順に近い)
+std::vector<uint8_t> buildRecording(const BenchOptions &opt)
+{
+    std::vector<EegSignalGenerator> generators;
+    for (size_t d = 0; d < opt.devices; ++d)
+    {
+        generators.emplace_back(1000003ULL + d);
+    }
+    const size_t chunks = static_cast<size_t>(opt.seconds * SAMPLE_RATE_HZ / SAMPLES_PER_CHUNK);
+    const size_t recordBytes = sizeof(uint32_t) + sizeof(uint16_t) + SAMPLES_PER_CHUNK * CH_MAX * sizeof(int16_t);
+    std::vector<uint8_t> data;
+    data.reserve(chunks * opt.devices * recordBytes);
+    SampleData sample;
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        for (size_t d = 0; d < opt.devices; ++d)
+        {
+            const uint32_t device = static_cast<uint32_t>(d);
+            const uint16_t index = static_cast<uint16_t>(c * SAMPLES_PER_CHUNK);
+            data.insert(data.end(), reinterpret_cast<const uint8_t *>(&device), reinterpret_cast<const uint8_t *>(&device) + 4);
+            data.insert(data.end(), reinterpret_cast<const uint8_t *>(&index), reinterpret_cast<const uint8_t *>(&index) + 2);
+            for (size_t i = 0; i < SAMPLES_PER_CHUNK; ++i)
+            {
+                generators[d].generate(sample);
+                const uint8_t *p = reinterpret_cast<const uint8_t *>(sample.signals);
+                data.insert(data.end(), p, p + sizeof(sample.signals));
+            }
+        }
+    }
+    return data;
+}
+
+bool verify(const std::string &path, const std::vector<uint8_t> &expected)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+    {
+        return false;
+    }
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    std::vector<uint8_t> in(ZSTD_DStreamInSize());
+    std::vector<uint8_t> out(ZSTD_DStreamOutSize());
+    size_t offset = 0;
+    bool ok = dctx != nullptr;
+    size_t last = 0;
+    while (ok)
+    {
+        const size_t got = fread(in.data(), 1, in.size(), fp);
+        if (got == 0)
+        {
+            break;
+        }
+        ZSTD_inBuffer input = {in.data(), got, 0};
+        while (ok && input.pos < input.size)
+        {
+            ZSTD_outBuffer output = {out.data(), out.size(), 0};
+            last = ZSTD_decompressStream(dctx, &output, &input);
+            ok = !ZSTD_isError(last) && offset + output.pos <= expected.size() &&
+                 memcmp(out.data(), expected.data() + offset, output.pos) == 0;
+            offset += output.pos;
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+    fclose(fp);
+    return ok && last == 0 && offset == expected.size();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<int> workerCounts = parseList(opt.workers);
+    if (workerCounts.empty())
+    {
+        const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        workerCounts.push_back(0);
+        for (int w = 1; w <= cores; w *= 2)
+        {
+            workerCounts.push_back(w);
+        }
+        if (workerCounts.back() != cores)
+        {
+            workerCounts.push_back(cores);
+        }
+    }
+    if (!CompressedRecording::multithreadAvailable())
+    {
+        fprintf(stderr, "zstd was built without ZSTD_MULTITHREAD: workers > 0 run single-threaded\n");
+    }
+
+    const int64_t g0 = monotonicNs();
+    const std::vector<uint8_t> recording = buildRecording(opt);
+    const double mb = recording.size() / (1024.0 * 1024.0);
+    printf("compress_bench: %zu devices x %.0f s = %.1f MB (generated in %.1f s), %u cores\n", opt.devices, opt.seconds, mb,
+           (monotonicNs() - g0) * 1e-9, std::thread::hardware_concurrency());
+    printf("  level  workers    MB/s   ratio  output MB\n");
+
+    mkdir(opt.dir.c_str(), 0755);
+    const std::string path = opt.dir + "/recording.zst";
+    RecorderConfig recorderConfig;
+    recorderConfig.maxFiles = 1;
+    RecordingWriter writer(recorderConfig);
+    if (!writer.start())
+    {
+        fprintf(stderr, "Recording writer backend unavailable\n");
+        return 1;
+    }
+
+    bool ok = true;
+    // 記録シンクが受け取る単位 (1 チャンク分のレコード) で渡す
+    const size_t recordBytes = sizeof(uint32_t) + sizeof(uint16_t) + SAMPLES_PER_CHUNK * CH_MAX * sizeof(int16_t);
+    for (int level : parseList(opt.levels))
+    {
+        for (int workers : workerCounts)
+        {
+            RecordingCompressionConfig config;
+            config.level = level;
+            config.workers = workers;
+            config.jobBytes = opt.jobKb * 1024;
+            CompressedRecording out(writer, config);
+            if (!out.open(path.c_str()))
+            {
+                fprintf(stderr, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+                return 1;
+            }
+            const int64_t t0 = monotonicNs();
+            bool written = true;
+            for (size_t pos = 0; pos < recording.size() && written; pos += recordBytes)
+            {
+                written = out.append(recording.data() + pos, recordBytes);
+            }
+            written = out.close() && written;
+            const double elapsed = (monotonicNs() - t0) * 1e-9;
+            const bool verified = written && verify(path, recording);
+            printf("  %5d  %7d  %6.1f  %6.3f  %9.2f  %s\n", level, workers, mb / elapsed,
+                   static_cast<double>(out.bytesIn()) / out.bytesOut(), out.bytesOut() / (1024.0 * 1024.0),
+                   verified ? "verified" : "VERIFY FAILED");
+            ok = ok && verified;
+            unlink(path.c_str());
+        }
+    }
+    rmdir(opt.dir.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+// 合成ラベル付きデータセット生成 CLI
+//
+// ファームウェアと同じ生成器・パラダイムを使い、実時間ではなく CPU 速度で
+// エポック (X.npy / y.npy) または連続データ (signals.npy / triggers.npy) を書き出す。
+// 作業はサンプル位置で固定サイズのブロックに分け、各ブロックは生成器をシークして
+// 独立に作るので、出力はスレッド数によらず同一になる。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eeg_host_clock.h"
+#include "eeg_npy.h"
+#include "eeg_paradigm.h"
+#include "eeg_protocol.h"
+#include "eeg_signal_generator.h"
+#include "p300_waveform_data.h"
+
+namespace
+{
+
+constexpr size_t WRITE_BLOCK_BYTES = 8u << 20;          // 1 回の pwrite の目安
+constexpr uint64_t CONTINUOUS_BLOCK_SAMPLES = 1u << 18; // 連続モードの分割単位 (出力の決定性に関わるので固定)
+
+enum class OutputMode
+{
+    Epochs,
+    Continuous,
+};
+
+struct DatasetOptions
+{
+    std::string outDir;
+    OutputMode mode = OutputMode::Epochs;
+    StimulusParadigm paradigm;
+    uint64_t epochs = 100000;
+    double seconds = 3600.0;
+    uint32_t preMs = 200;
+    uint32_t postMs = 800;
+    size_t threads = 0;
+};
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s --out DIR [options]\n"
+            "  --mode epochs|continuous   (default epochs)\n"
+            "  --paradigm p300|ssvep      (default p300)\n"
+            "  --epochs N                 epochs to generate (default 100000)\n"
+            "  --seconds S                continuous length (default 3600)\n"
+            "  --window-ms PRE POST       epoch window around onset (default 200 800)\n"
+            "  --target-prob P            P300 target probability (default 0.2)\n"
+            "  --isi-ms MIN MAX           continuous stimulus interval (default 800 1200)\n"
+            "  --seed S                   (default 1)\n"
+            "  --threads N                (default: all cores)\n",
+            argv0);
+}
+
+bool parseOptions(int argc, char **argv, DatasetOptions &opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue)
+            opt.outDir = argv[++i];
+        else if (arg == "--mode" && hasValue)
+        {
+            const std::string v = argv[++i];
+            if (v != "epochs" && v != "continuous")
+                return false;
+            opt.mode = v == "epochs" ? OutputMode::Epochs : OutputMode::Continuous;
+        }
+        else if (arg == "--paradigm" && hasValue)
+        {
+            const std::string v = argv[++i];
+            if (v != "p300" && v != "ssvep")
+                return false;
+            opt.paradigm.mode = v == "ssvep" ? STIM_MODE_SSVEP : STIM_MODE_P300;
+        }
+        else if (arg == "--epochs" && hasValue)
+            opt.epochs = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seconds" && hasValue)
+            opt.seconds = strtod(argv[++i], nullptr);
+        else if (arg == "--window-ms" && i + 2 < argc)
+        {
+            opt.preMs = strtoul(argv[++i], nullptr, 10);
+            opt.postMs = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--target-prob" && hasValue)
+            opt.paradigm.targetProbability = strtof(argv[++i], nullptr);
+        else if (arg == "--isi-ms" && i + 2 < argc)
+        {
+            opt.paradigm.isiMinSamples = strtoul(argv[++i], nullptr, 10) * SAMPLE_RATE_HZ / 1000u;
+            opt.paradigm.isiMaxSamples = std::max<uint32_t>(opt.paradigm.isiMinSamples, strtoul(argv[++i], nullptr, 10) * SAMPLE_RATE_HZ / 1000u);
+        }
+        else if (arg == "--seed" && hasValue)
+            opt.paradigm.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue)
+            opt.threads = strtoul(argv[++i], nullptr, 10);
+        else
+            return false;
+    }
+    return !opt.outDir.empty() && opt.preMs + opt.postMs > 0;
+}
+
+// ========= エポックモード =========
+// エポック e は生成器を e * epochLen にシークして独立に作る。
+// 刺激オンセットは pre サンプル目、ラベルはパラダイムの e 番目のトリガー値。
+bool generateEpochs(const DatasetOptions &opt, size_t threads)
+{
+    const uint32_t pre = opt.preMs * SAMPLE_RATE_HZ / 1000u;
+    const uint32_t epochLen = pre + opt.postMs * SAMPLE_RATE_HZ / 1000u;
+    const size_t epochBytes = static_cast<size_t>(epochLen) * CH_MAX * sizeof(int16_t);
+    const uint64_t epochsPerBlock = std::max<uint64_t>(1, WRITE_BLOCK_BYTES / epochBytes);
+
+    NpyFile xFile;
+    NpyFile yFile;
+    if (!xFile.create(opt.outDir + "/X.npy", "<i2", {opt.epochs, epochLen, CH_MAX}, sizeof(int16_t)) ||
+        !yFile.create(opt.outDir + "/y.npy", "|u1", {opt.epochs}, sizeof(uint8_t)))
+    {
+        return false;
+    }
+
+    std::atomic<uint64_t> nextBlock{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]()
+    {
+        EegSignalGenerator generator(opt.paradigm.seed);
+        generator.setStimulusMode(opt.paradigm.mode);
+        std::vector<int16_t> xBuf(epochsPerBlock * epochLen * CH_MAX);
+        std::vector<uint8_t> yBuf(epochsPerBlock);
+        SampleData sample;
+
+        for (;;)
+        {
+            const uint64_t first = nextBlock.fetch_add(1) * epochsPerBlock;
+            if (first >= opt.epochs || failed.load())
+            {
+                return;
+            }
+            const uint64_t count = std::min(epochsPerBlock, opt.epochs - first);
+            int16_t *out = xBuf.data();
+            for (uint64_t e = first; e < first + count; ++e)
+            {
+                const uint8_t label = opt.paradigm.triggerValueOf(e);
+                yBuf[e - first] = label;
+                generator.seek(e * epochLen);
+                for (uint32_t i = 0; i < epochLen; ++i)
+                {
+                    if (i == pre)
+                    {
+                        generator.startStimulusEvent(label);
+                    }
+                    generator.generate(sample);
+                    memcpy(out, sample.signals, sizeof(sample.signals));
+                    out += CH_MAX;
+                }
+            }
+            if (!xFile.writeAt(first * epochBytes, xBuf.data(), count * epochBytes) ||
+                !yFile.writeAt(first, yBuf.data(), count))
+            {
+                failed.store(true);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &th : pool)
+    {
+        th.join();
+    }
+    return !failed.load();
+}
+
+// ========= 連続モード =========
+// ブロック [s0, s1) は直前の warmup サンプル分から生成し直して、ブロック境界をまたぐ
+// イベント応答 (P300 テンプレート / SSVEP 応答) を再現する。
+bool generateContinuous(const DatasetOptions &opt, size_t threads)
+{
+    const uint64_t totalSamples = static_cast<uint64_t>(opt.seconds * SAMPLE_RATE_HZ);
+    uint64_t warmup = P300_CYCLE_SAMPLES;
+    {
+        EegSignalGenerator probe;
+        for (size_t tag = 0; tag < SSVEP_MAX_TAGS; ++tag)
+        {
+            warmup = std::max<uint64_t>(warmup, probe.ssvepTag(tag).durationSamples + SSVEP_RAMP_SAMPLES);
+        }
+    }
+
+    NpyFile signalFile;
+    NpyFile triggerFile;
+    if (!signalFile.create(opt.outDir + "/signals.npy", "<i2", {totalSamples, CH_MAX}, sizeof(int16_t)) ||
+        !triggerFile.create(opt.outDir + "/triggers.npy", "|u1", {totalSamples}, sizeof(uint8_t)))
+    {
+        return false;
+    }
+
+    std::atomic<uint64_t> nextBlock{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]()
+    {
+        EegSignalGenerator generator(opt.paradigm.seed);
+        generator.setStimulusMode(opt.paradigm.mode);
+        ParadigmScheduler scheduler;
+        std::vector<int16_t> signalBuf(CONTINUOUS_BLOCK_SAMPLES * CH_MAX);
+        std::vector<uint8_t> triggerBuf(CONTINUOUS_BLOCK_SAMPLES);
+        SampleData sample;
+
+        for (;;)
+        {
+            const uint64_t s0 = nextBlock.fetch_add(1) * CONTINUOUS_BLOCK_SAMPLES;
+            if (s0 >= totalSamples || failed.load())
+            {
+                return;
+            }
+            const uint64_t s1 = std::min(s0 + CONTINUOUS_BLOCK_SAMPLES, totalSamples);
+            const uint64_t w = s0 > warmup ? s0 - warmup : 0;
+            generator.seek(w);
+            scheduler.begin(opt.paradigm, w);
+            for (uint64_t i = w; i < s1; ++i)
+            {
+                scheduler.poll(generator, i);
+                generator.generate(sample);
+                if (i >= s0)
+                {
+                    memcpy(&signalBuf[(i - s0) * CH_MAX], sample.signals, sizeof(sample.signals));
+                    triggerBuf[i - s0] = sample.trigger_state;
+                }
+            }
+            const uint64_t n = s1 - s0;
+            if (!signalFile.writeAt(s0 * CH_MAX * sizeof(int16_t), signalBuf.data(), n * CH_MAX * sizeof(int16_t)) ||
+                !triggerFile.writeAt(s0, triggerBuf.data(), n))
+            {
+                failed.store(true);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &th : pool)
+    {
+        th.join();
+    }
+    return !failed.load();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    DatasetOptions opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const size_t threads = opt.threads > 0 ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+    mkdir(opt.outDir.c_str(), 0755);
+
+    const double t0 = monotonicSec();
+    bool ok = false;
+    uint64_t samples = 0;
+    if (opt.mode == OutputMode::Epochs)
+    {
+        ok = generateEpochs(opt, threads);
+        samples = opt.epochs * ((opt.preMs + opt.postMs) * SAMPLE_RATE_HZ / 1000u);
+    }
+    else
+    {
+        ok = generateContinuous(opt, threads);
+        samples = static_cast<uint64_t>(opt.seconds * SAMPLE_RATE_HZ);
+    }
+    const double elapsed = monotonicSec() - t0;
+    if (!ok)
+    {
+        fprintf(stderr, "[DATASET] failed\n");
+        return 1;
+    }
+
+    const double mb = samples * CH_MAX * sizeof(int16_t) / 1e6;
+    fprintf(stderr, "[DATASET] %llu samples (%.1f MB) in %.2fs on %zu threads: %.1fx real time, %.1f MB/s\n",
+            static_cast<unsigned long long>(samples), mb, elapsed, threads,
+            samples / static_cast<double>(SAMPLE_RATE_HZ) / std::max(elapsed, 1e-9), mb / std::max(elapsed, 1e-9));
+    if (opt.mode == OutputMode::Epochs)
+    {
+        fprintf(stderr, "[DATASET] %.0f epochs/s\n", opt.epochs / std::max(elapsed, 1e-9));
+    }
+    return 0;
+}
@@ -0,0 +1,502 @@
+// 仮想デバイスファーム: ファームウェアと同じ生成器・パケット化を N 台分ホストで動かす
+//
+// 各インスタンスは独立した seed / クロックスキュー / オドボール刺激スケジュールを持ち、
+// ワーカースレッドごとに 1 本のタイマー (tick) でまとめて進める。
+// チャンクは UDP (127.0.0.1:BASE+i) か Unix datagram (DIR/dev-XXXXX.sock) へ送る。
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eeg_clock_model.h"
+#include "eeg_crc.h"
+#include "eeg_host_clock.h"
+#include "eeg_paradigm.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+#include "eeg_signal_generator.h"
+#include "eeg_stream_digest.h"
+
+namespace
+{
+
+constexpr int64_t NSEC_PER_SEC = 1000000000LL;
+constexpr int64_t CHUNK_PERIOD_NS = NSEC_PER_SEC * SAMPLES_PER_CHUNK / SAMPLE_RATE_HZ;
+constexpr size_t SEND_BATCH = 64;
+
+struct FarmOptions
+{
+    size_t devices = 100;
+    size_t threads = 0; // 0 = hardware_concurrency
+    uint16_t udpBasePort = 50000;
+    std::string unixDir;
+    double skewPpm = 50.0; // 各デバイスは ±skewPpm の範囲でランダム
+    double wanderPpm = 0.0; // 温度変化のような揺らぎ (標準偏差)
+    double wanderTauSec = 600.0;
+    uint32_t telemetryChunks = 0; // 0 = テレメトリを送らない
+    bool crc = false;             // 設定パケット + 全パケットに CRC-32C トレーラ
+    uint32_t digestChunks = 0;    // 0 = ダイジェストを送らない
+    uint64_t seed = 1;
+    uint32_t tickMs = 20;
+    uint32_t isiMinMs = 800;
+    uint32_t isiMaxMs = 1200;
+    double durationSec = 0.0; // 0 = シグナルまで継続
+    double reportSec = 10.0;
+    std::string reportCsv;
+};
+
+struct DeviceStats
+{
+    std::atomic<uint64_t> packetsSent{0};
+    std::atomic<uint64_t> sendErrors{0};
+    std::atomic<uint64_t> deadlineMisses{0};
+    std::atomic<int64_t> maxLatenessNs{0};
+};
+
+struct VirtualDevice
+{
+    uint32_t id = 0;
+    EegSignalGenerator generator;
+    ChunkPacketizer packetizer;
+    ParadigmScheduler scheduler;
+    ClockDriftModel clock;
+    double skewPpm = 0.0;
+    double effectiveRateHz = SAMPLE_RATE_HZ; // 起動からの平均
+    double dueSamples = 0.0;                 // ずれを含めた分数サンプル時刻
+    uint64_t samplesGenerated = 0;
+    uint32_t chunksSinceTelemetry = 0;
+    StreamDigest digest;
+    uint64_t lastTelemetrySamples = 0;
+    int64_t lastTelemetryNs = 0;
+    sockaddr_storage addr{};
+    socklen_t addrLen = 0;
+    DeviceStats stats;
+};
+
+struct OutgoingPacket
+{
+    VirtualDevice *device;
+    size_t size;
+    uint8_t bytes[sizeof(ChunkedSamplePacket) + PACKET_CRC_BYTES];
+};
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int)
+{
+    g_stop.store(true);
+}
+
+void sleepUntilNs(int64_t deadline)
+{
+    timespec ts;
+    ts.tv_sec = deadline / NSEC_PER_SEC;
+    ts.tv_nsec = deadline % NSEC_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR && !g_stop.load())
+    {
+    }
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --devices N        number of virtual devices (default 100)\n"
+            "  --threads N        worker threads (default: all cores)\n"
+            "  --udp-port BASE    send device i to 127.0.0.1:BASE+i (default 50000)\n"
+            "  --unix-dir DIR     send device i to DIR/dev-XXXXX.sock instead of UDP\n"
+            "  --skew-ppm P       per-device clock offset drawn from [-P, +P] (default 50)\n"
+            "  --wander-ppm P     slow clock wander std-dev (default 0)\n"
+            "  --wander-tau SEC   wander correlation time (default 600)\n"
+            "  --telemetry N      send a telemetry packet every N chunks\n"
+            "  --crc              start with a config packet and append CRC-32C to every packet\n"
+            "  --digest N         send a stream digest checkpoint every N chunks\n"
+            "  --seed S           base seed (default 1)\n"
+            "  --tick-ms MS       batched timer period per worker (default 20)\n"
+            "  --isi-ms MIN MAX   stimulus onset interval range (default 800 1200)\n"
+            "  --duration SEC     stop after SEC seconds (default: run until SIGINT)\n"
+            "  --report SEC       summary interval (default 10)\n"
+            "  --report-csv PATH  write per-device stats on exit\n",
+            argv0);
+}
+
+bool parseOptions(int argc, char **argv, FarmOptions &opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--devices" && hasValue)
+            opt.devices = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue)
+            opt.threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--udp-port" && hasValue)
+            opt.udpBasePort = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--unix-dir" && hasValue)
+            opt.unixDir = argv[++i];
+        else if (arg == "--skew-ppm" && hasValue)
+            opt.skewPpm = strtod(argv[++i], nullptr);
+        else if (arg == "--wander-ppm" && hasValue)
+            opt.wanderPpm = strtod(argv[++i], nullptr);
+        else if (arg == "--wander-tau" && hasValue)
+            opt.wanderTauSec = strtod(argv[++i], nullptr);
+        else if (arg == "--telemetry" && hasValue)
+            opt.telemetryChunks = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--crc")
+            opt.crc = true;
+        else if (arg == "--digest" && hasValue)
+            opt.digestChunks = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && hasValue)
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--tick-ms" && hasValue)
+            opt.tickMs = std::max<uint32_t>(1, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--isi-ms" && i + 2 < argc)
+        {
+            opt.isiMinMs = strtoul(argv[++i], nullptr, 10);
+            opt.isiMaxMs = std::max<uint32_t>(opt.isiMinMs, strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--duration" && hasValue)
+            opt.durationSec = strtod(argv[++i], nullptr);
+        else if (arg == "--report" && hasValue)
+            opt.reportSec = strtod(argv[++i], nullptr);
+        else if (arg == "--report-csv" && hasValue)
+            opt.reportCsv = argv[++i];
+        else
+            return false;
+    }
+    return opt.devices > 0;
+}
+
+void initDevice(VirtualDevice &dev, uint32_t id, const FarmOptions &opt)
+{
+    dev.id = id;
+    dev.generator.reseed(opt.seed * 1000003ULL + id);
+    dev.skewPpm = (hashUniform(opt.seed, id) * 2.0 - 1.0) * opt.skewPpm;
+    dev.effectiveRateHz = SAMPLE_RATE_HZ * (1.0 + dev.skewPpm * 1e-6);
+    dev.clock = ClockDriftModel(splitmix64(opt.seed ^ (0xC10CULL << 32 | id)));
+    ClockProfile profile;
+    profile.offsetPpm = static_cast<float>(dev.skewPpm);
+    profile.wanderPpm = static_cast<float>(opt.wanderPpm);
+    profile.wanderTauSec = static_cast<float>(opt.wanderTauSec);
+    dev.clock.configure(profile);
+    dev.packetizer.reset(0);
+
+    StimulusParadigm paradigm;
+    paradigm.seed = splitmix64(opt.seed + 0x9E3779B97F4A7C15ULL * (id + 1));
+    paradigm.isiMinSamples = opt.isiMinMs * SAMPLE_RATE_HZ / 1000u;
+    paradigm.isiMaxSamples = opt.isiMaxMs * SAMPLE_RATE_HZ / 1000u;
+    dev.scheduler.begin(paradigm, 0);
+
+    if (opt.unixDir.empty())
+    {
+        sockaddr_in *in = reinterpret_cast<sockaddr_in *>(&dev.addr);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<uint16_t>(opt.udpBasePort + id));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        dev.addrLen = sizeof(sockaddr_in);
+    }
+    else
+    {
+        sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&dev.addr);
+        un->sun_family = AF_UNIX;
+        snprintf(un->sun_path, sizeof(un->sun_path), "%s/dev-%05u.sock", opt.unixDir.c_str(), id);
+        dev.addrLen = sizeof(sockaddr_un);
+    }
+}
+
+void flushOutgoing(int sock, std::vector<OutgoingPacket> &outgoing)
+{
+    mmsghdr msgs[SEND_BATCH];
+    iovec iovs[SEND_BATCH];
+    for (size_t base = 0; base < outgoing.size(); base += SEND_BATCH)
+    {
+        const size_t n = std::min(SEND_BATCH, outgoing.size() - base);
+        for (size_t i = 0; i < n; ++i)
+        {
+            OutgoingPacket &out = outgoing[base + i];
+            iovs[i].iov_base = out.bytes;
+            iovs[i].iov_len = out.size;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &out.device->addr;
+            msgs[i].msg_hdr.msg_namelen = out.device->addrLen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        // sendmmsg は失敗したメッセージで止まるので、1 件ずつ飛ばしながら送り切る
+        size_t sent = 0;
+        while (sent < n)
+        {
+            const int rc = sendmmsg(sock, msgs + sent, static_cast<unsigned>(n - sent), MSG_DONTWAIT);
+            if (rc > 0)
+            {
+                for (int i = 0; i < rc; ++i)
+                {
+                    outgoing[base + sent + i].device->stats.packetsSent.fetch_add(1, std::memory_order_relaxed);
+                }
+                sent += static_cast<size_t>(rc);
+                continue;
+            }
+            outgoing[base + sent].device->stats.sendErrors.fetch_add(1, std::memory_order_relaxed);
+            sent++;
+        }
+    }
+    outgoing.clear();
+}
+
+void queuePacket(std::vector<OutgoingPacket> &outgoing, VirtualDevice *dev, const void *packet, size_t size, bool crc)
+{
+    outgoing.emplace_back();
+    OutgoingPacket &out = outgoing.back();
+    out.device = dev;
+    out.size = size;
+    memcpy(out.bytes, packet, size);
+    if (crc)
+    {
+        appendPacketCrc(out.bytes, size);
+        out.size += PACKET_CRC_BYTES;
+    }
+}
+
+// ファームウェアと同じく、CRC の有無は先頭の設定パケットで受信側に知らせる
+void queueDeviceConfig(std::vector<OutgoingPacket> &outgoing, VirtualDevice *dev, bool crc)
+{
+    DeviceConfigPacket cfg;
+    cfg.packet_type = PKT_TYPE_DEVICE_CFG;
+    cfg.num_channels = CH_MAX;
+    cfg.flags = crc ? DEVICE_CFG_FLAG_CRC32C : 0;
+    memset(cfg.reserved, 0, sizeof(cfg.reserved));
+    memcpy(cfg.configs, DEFAULT_ELECTRODES, sizeof(DEFAULT_ELECTRODES));
+    queuePacket(outgoing, dev, &cfg, sizeof(cfg), crc);
+}
+
+void queueTelemetry(std::vector<OutgoingPacket> &outgoing, VirtualDevice *dev, int64_t now, int64_t startNs, bool crc)
+{
+    DeviceTelemetryPacket telemetry;
+    telemetry.packet_type = PKT_TYPE_TELEMETRY;
+    telemetry.version = 2;
+    telemetry.sample_index = static_cast<uint16_t>(dev->samplesGenerated);
+    telemetry.uptime_ms = static_cast<uint32_t>((now - startNs) / 1000000LL);
+    telemetry.clock_offset_ppb = static_cast<int32_t>(dev->clock.currentPpm() * 1000.0f);
+    const int64_t elapsedNs = now - dev->lastTelemetryNs;
+    telemetry.effective_rate_mhz = (dev->lastTelemetryNs != 0 && elapsedNs > 0)
+                                       ? static_cast<uint32_t>((dev->samplesGenerated - dev->lastTelemetrySamples) * 1e12 / elapsedNs)
+                                       : 0;
+    telemetry.samples_generated = static_cast<uint32_t>(dev->samplesGenerated);
+    telemetry.degrade_level = 0;
+    telemetry.degrade_changes = 0;
+    telemetry.min_slack_permille = 1000;
+    telemetry.lost_ticks = 0;
+    dev->lastTelemetryNs = now;
+    dev->lastTelemetrySamples = dev->samplesGenerated;
+    queuePacket(outgoing, dev, &telemetry, sizeof(telemetry), crc);
+}
+
+void runWorker(std::vector<VirtualDevice *> devices, const FarmOptions &opt, int64_t startNs, int64_t stopNs)
+{
+    const int family = opt.unixDir.empty() ? AF_INET : AF_UNIX;
+    const int sock = socket(family, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        perror("[FARM] socket");
+        return;
+    }
+
+    std::vector<OutgoingPacket> outgoing;
+    outgoing.reserve(devices.size() * 2);
+    const int64_t tickNs = static_cast<int64_t>(opt.tickMs) * 1000000LL;
+    int64_t nextTick = startNs;
+    int64_t lastTick = startNs;
+    if (opt.crc)
+    {
+        for (VirtualDevice *dev : devices)
+        {
+            queueDeviceConfig(outgoing, dev, true);
+        }
+    }
+
+    while (!g_stop.load(std::memory_order_relaxed) && (stopNs == 0 || nextTick < stopNs))
+    {
+        sleepUntilNs(nextTick);
+        const int64_t now = monotonicNs();
+        const double dtSec = static_cast<double>(now - lastTick) / NSEC_PER_SEC;
+        const double elapsedSec = static_cast<double>(now - startNs) / NSEC_PER_SEC;
+        lastTick = now;
+
+        for (VirtualDevice *dev : devices)
+        {
+            // ファームウェアの分数タイムベースと同じく、現在のずれで時刻を積分する
+            const double rateHz = SAMPLE_RATE_HZ * (1.0 + dev->clock.update(static_cast<float>(dtSec)) * 1e-6);
+            dev->dueSamples += dtSec * rateHz;
+            while (dev->samplesGenerated < static_cast<uint64_t>(dev->dueSamples))
+            {
+                dev->scheduler.poll(dev->generator, dev->samplesGenerated);
+                SampleData sample;
+                dev->generator.generate(sample);
+                dev->samplesGenerated++;
+                if (!dev->packetizer.push(sample))
+                {
+                    continue;
+                }
+                queuePacket(outgoing, dev, &dev->packetizer.packet(), sizeof(ChunkedSamplePacket), opt.crc);
+                dev->digest.update(&dev->packetizer.packet(), sizeof(ChunkedSamplePacket));
+                if (opt.digestChunks > 0 && dev->digest.chunks() % opt.digestChunks == 0)
+                {
+                    StreamDigestPacket digest;
+                    dev->digest.fill(digest, dev->packetizer.packet().start_index);
+                    queuePacket(outgoing, dev, &digest, sizeof(digest), opt.crc);
+                }
+
+                // 実機なら最後のサンプルが揃った時点で送れる。そこから 1 チャンク周期を超えたら miss
+                const int64_t latenessNs = static_cast<int64_t>((dev->dueSamples - dev->samplesGenerated) / rateHz * NSEC_PER_SEC);
+                if (latenessNs > CHUNK_PERIOD_NS)
+                {
+                    dev->stats.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (latenessNs > dev->stats.maxLatenessNs.load(std::memory_order_relaxed))
+                {
+                    dev->stats.maxLatenessNs.store(latenessNs, std::memory_order_relaxed);
+                }
+                if (opt.telemetryChunks > 0 && ++dev->chunksSinceTelemetry >= opt.telemetryChunks)
+                {
+                    dev->chunksSinceTelemetry = 0;
+                    queueTelemetry(outgoing, dev, now, startNs, opt.crc);
+                }
+            }
+            dev->effectiveRateHz = elapsedSec > 0.0 ? dev->samplesGenerated / elapsedSec : SAMPLE_RATE_HZ;
+        }
+        flushOutgoing(sock, outgoing);
+
+        nextTick += tickNs;
+        if (nextTick < now)
+        {
+            // tick 自体が溢れた場合は詰めて再開 (遅れはデバイスごとの miss に計上済み)
+            nextTick = now + tickNs;
+        }
+    }
+    close(sock);
+}
+
+void printSummary(const std::vector<VirtualDevice> &devices, double elapsedSec)
+{
+    uint64_t packets = 0;
+    uint64_t errors = 0;
+    uint64_t misses = 0;
+    size_t devicesWithMisses = 0;
+    int64_t worstLateness = 0;
+    for (const VirtualDevice &dev : devices)
+    {
+        packets += dev.stats.packetsSent.load(std::memory_order_relaxed);
+        errors += dev.stats.sendErrors.load(std::memory_order_relaxed);
+        const uint64_t m = dev.stats.deadlineMisses.load(std::memory_order_relaxed);
+        misses += m;
+        devicesWithMisses += m > 0 ? 1 : 0;
+        worstLateness = std::max(worstLateness, dev.stats.maxLatenessNs.load(std::memory_order_relaxed));
+    }
+    fprintf(stderr,
+            "[FARM] t=%.1fs devices=%zu packets=%llu (%.0f/s) send_errors=%llu deadline_misses=%llu on %zu devices, worst_lateness=%.1fms\n",
+            elapsedSec, devices.size(), static_cast<unsigned long long>(packets), packets / std::max(elapsedSec, 1e-9),
+            static_cast<unsigned long long>(errors), static_cast<unsigned long long>(misses), devicesWithMisses,
+            worstLateness / 1e6);
+}
+
+void writeReportCsv(const std::vector<VirtualDevice> &devices, const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        perror("[FARM] report csv");
+        return;
+    }
+    fprintf(fp, "device,skew_ppm,effective_rate_hz,samples,packets_sent,send_errors,deadline_misses,max_lateness_ms\n");
+    for (const VirtualDevice &dev : devices)
+    {
+        fprintf(fp, "%u,%.3f,%.6f,%llu,%llu,%llu,%llu,%.3f\n", dev.id, dev.skewPpm, dev.effectiveRateHz,
+                static_cast<unsigned long long>(dev.samplesGenerated),
+                static_cast<unsigned long long>(dev.stats.packetsSent.load()),
+                static_cast<unsigned long long>(dev.stats.sendErrors.load()),
+                static_cast<unsigned long long>(dev.stats.deadlineMisses.load()),
+                dev.stats.maxLatenessNs.load() / 1e6);
+    }
+    fclose(fp);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    FarmOptions opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opt.threads == 0)
+    {
+        opt.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    opt.threads = std::min(opt.threads, opt.devices);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    std::vector<VirtualDevice> devices(opt.devices);
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        initDevice(devices[i], static_cast<uint32_t>(i), opt);
+    }
+
+    // デバイスはラウンドロビンでワーカーに割り当てる (各ワーカーの負荷を均す)
+    std::vector<std::vector<VirtualDevice *>> shards(opt.threads);
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        shards[i % opt.threads].push_back(&devices[i]);
+    }
+
+    const int64_t startNs = monotonicNs() + CHUNK_PERIOD_NS;
+    const int64_t stopNs = opt.durationSec > 0.0 ? startNs + static_cast<int64_t>(opt.durationSec * NSEC_PER_SEC) : 0;
+    fprintf(stderr, "[FARM] %zu devices on %zu threads, tick=%ums, output=%s\n", opt.devices, opt.threads, opt.tickMs,
+            opt.unixDir.empty() ? "udp" : opt.unixDir.c_str());
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < opt.threads; ++t)
+    {
+        workers.emplace_back(runWorker, shards[t], std::cref(opt), startNs, stopNs);
+    }
+
+    const int64_t reportNs = static_cast<int64_t>(std::max(opt.reportSec, 0.1) * NSEC_PER_SEC);
+    int64_t nextReport = startNs + reportNs;
+    while (!g_stop.load() && (stopNs == 0 || monotonicNs() < stopNs))
+    {
+        sleepUntilNs(stopNs == 0 ? nextReport : std::min(nextReport, stopNs));
+        if (monotonicNs() >= nextReport)
+        {
+            printSummary(devices, static_cast<double>(monotonicNs() - startNs) / NSEC_PER_SEC);
+            nextReport += reportNs;
+        }
+    }
+    g_stop.store(true);
+    for (std::thread &w : workers)
+    {
+        w.join();
+    }
+
+    printSummary(devices, static_cast<double>(monotonicNs() - startNs) / NSEC_PER_SEC);
+    if (!opt.reportCsv.empty())
+    {
+        writeReportCsv(devices, opt.reportCsv);
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+// デバイス側 DSP のベンチマーク
+//
+//   dsp_bench [--notch 50] [--harmonics 2] [--highpass 0.5] [--lowpass 40] [--band-rate 2] [--samples 2000000]
+//
+// 1) 周波数特性: 正弦波を BiquadChain に通し、代表周波数での利得 (dB) を double 版の設計値と並べる。
+// 2) 量子化雑音: 同じ入力を double の DF-I と比べた誤差 RMS (LSB)。誤差帰還の効果を見る。
+// 3) 速度: 1 サンプル (全チャンネル) あたりの ns。ESP32-S3 の実測はファームウェアの [FLT] ログを参照。
+// 4) 帯域パワー: 既知の正弦波で dB 値を確認し、生成器の信号での α/β と速度・帯域幅を出す。
+// 5) スペクトル: FFT 長ごとに正弦波の振幅 (dB) の読み、1 チャンネル / 1 ブロックの ns と hop 周期に対する割合。
+// 6) ERP: 生成器に P300 の標的 / 非標的トリガーを入れ、条件別平均の振幅と 1 分あたりの送信量を出す。
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "eeg_band_power.h"
+#include "eeg_biquad.h"
+#include "eeg_erp.h"
+#include "eeg_host_clock.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+#include "eeg_signal_generator.h"
+#include "eeg_spectrum.h"
+
+namespace
+{
+
+constexpr double BENCH_PI = 3.14159265358979323846;
+
+// 振幅 amplitude の正弦波を通し、過渡を捨てた後の RMS 比を dB で返す
+double measureGainDb(const FilterSpec &spec, double freqHz, double amplitude)
+{
+    BiquadChain chain;
+    chain.configure(spec);
+    const size_t settle = SAMPLE_RATE_HZ * 20;
+    const size_t measure = SAMPLE_RATE_HZ * 20;
+    double inPower = 0.0;
+    double outPower = 0.0;
+    int16_t signals[CH_MAX];
+    for (size_t n = 0; n < settle + measure; ++n)
+    {
+        const double x = amplitude * sin(2.0 * BENCH_PI * freqHz * n / SAMPLE_RATE_HZ);
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            signals[ch] = static_cast<int16_t>(lround(x));
+        }
+        chain.process(signals);
+        if (n >= settle)
+        {
+            inPower += x * x;
+            outPower += static_cast<double>(signals[0]) * signals[0];
+        }
+    }
+    return 10.0 * log10((outPower + 1e-9) / inPower);
+}
+
+// 量子化した係数を double に戻して設計上の利得を計算する
+double designGainDb(const FilterSpec &spec, double freqHz)
+{
+    BiquadChain chain;
+    chain.configure(spec);
+    const double w = 2.0 * BENCH_PI * freqHz / SAMPLE_RATE_HZ;
+    double mag = 1.0;
+    for (size_t s = 0; s < chain.stages(); ++s)
+    {
+        const BiquadCoeffs &c = chain.coeffs(s);
+        const double k = 1.0 / (1 << BIQUAD_COEFF_FRAC_BITS);
+        const double b0 = c.b0 * k, b1 = c.b1 * k, b2 = c.b2 * k;
+        const double a1 = c.a1 * k, a2 = c.a2 * k;
+        const double nr = b0 + b1 * cos(w) + b2 * cos(2 * w), ni = -b1 * sin(w) - b2 * sin(2 * w);
+        const double dr = 1.0 + a1 * cos(w) + a2 * cos(2 * w), di = -a1 * sin(w) - a2 * sin(2 * w);
+        mag *= sqrt((nr * nr + ni * ni) / (dr * dr + di * di));
+    }
+    return 20.0 * log10(mag + 1e-12);
+}
+
+// double の DF-I (同じ量子化係数) と比べた出力誤差の RMS (LSB)
+double quantisationErrorLsb(const FilterSpec &spec, size_t samples)
+{
+    BiquadChain chain;
+    chain.configure(spec);
+    double state[BIQUAD_MAX_STAGES][4] = {};
+    const double k = 1.0 / (1 << BIQUAD_COEFF_FRAC_BITS);
+    Pcg32 rng(9);
+    double errPower = 0.0;
+    int16_t signals[CH_MAX];
+    for (size_t i = 0; i < samples; ++i)
+    {
+        const int16_t in = static_cast<int16_t>(static_cast<int32_t>(rng.next() % 8000) - 4000 +
+                                                lround(3000.0 * sin(2.0 * BENCH_PI * 10.0 * i / SAMPLE_RATE_HZ)));
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            signals[ch] = in;
+        }
+        chain.process(signals);
+        double x = in;
+        for (size_t s = 0; s < chain.stages(); ++s)
+        {
+            const BiquadCoeffs &c = chain.coeffs(s);
+            double *st = state[s];
+            const double y = c.b0 * k * x + c.b1 * k * st[0] + c.b2 * k * st[1] - c.a1 * k * st[2] - c.a2 * k * st[3];
+            st[1] = st[0];
+            st[0] = x;
+            st[3] = st[2];
+            st[2] = y;
+            x = y;
+        }
+        if (i > SAMPLE_RATE_HZ * 20)
+        {
+            const double e = signals[0] - x;
+            errPower += e * e;
+        }
+    }
+    return sqrt(errPower / (samples - SAMPLE_RATE_HZ * 20 - 1));
+}
+
+// 計測ループの結果を捨てられないように書き込む先 (表示はしない)
+volatile uint64_t benchSink = 0;
+
+void benchSpeed(const FilterSpec &spec, size_t samples)
+{
+    BiquadChain chain;
+    chain.configure(spec);
+    Pcg32 rng(3);
+    int16_t signals[CH_MAX];
+    int64_t checksum = 0;
+    const double t0 = cpuSec();
+    for (size_t i = 0; i < samples; ++i)
+    {
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            signals[ch] = static_cast<int16_t>(rng.next());
+        }
+        chain.process(signals);
+        checksum += signals[i % CH_MAX];
+    }
+    const double cpu = cpuSec() - t0;
+    const double ns = cpu / samples * 1e9;
+    benchSink = static_cast<uint64_t>(checksum);
+    printf("  %zu stages x %u ch: %.1f ns/sample (%.2f ns/stage/ch), %.0fx the %u Hz budget\n", chain.stages(), CH_MAX, ns,
+           ns / (chain.stages() * CH_MAX), 1e9 / SAMPLE_RATE_HZ / ns, SAMPLE_RATE_HZ);
+}
+
+double decodeDb(int16_t q8)
+{
+    return q8 / 256.0;
+}
+
+void benchBandPower(uint8_t rateHz, size_t samples)
+{
+    // 1) 振幅 A の正弦波は平均二乗 A^2/2 → α 帯域に 20log10(A/√2) dB が出るはず
+    BandPowerEstimator est;
+    est.configure(rateHz, 0xFF, nullptr, 0);
+    const double amplitude = 1000.0;
+    int16_t signals[CH_MAX];
+    double alphaDb = 0.0;
+    double betaDb = 0.0;
+    size_t blocks = 0;
+    for (size_t n = 0; n < SAMPLE_RATE_HZ * 10u; ++n)
+    {
+        const double x = amplitude * sin(2.0 * BENCH_PI * 10.3 * n / SAMPLE_RATE_HZ);
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            signals[ch] = static_cast<int16_t>(lround(x));
+        }
+        if (est.push(signals))
+        {
+            alphaDb += decodeDb(est.packet().power[0]);
+            betaDb += decodeDb(est.packet().power[CH_MAX]);
+            blocks++;
+        }
+    }
+    printf("  10.3 Hz sine, A=%.0f: alpha %.2f dB (expected %.2f), beta %.2f dB\n", amplitude, alphaDb / blocks,
+           20.0 * log10(amplitude / sqrt(2.0)), betaDb / blocks);
+
+    // 2) 生成器の信号 (α/β 成分を含む)
+    EegSignalGenerator generator(7);
+    SampleData sample;
+    est.configure(rateHz, 0xFF, nullptr, 0);
+    alphaDb = betaDb = 0.0;
+    blocks = 0;
+    uint64_t checksum = 0;
+    const double t0 = cpuSec();
+    for (size_t n = 0; n < samples; ++n)
+    {
+        generator.generate(sample);
+        memcpy(signals, sample.signals, sizeof(signals));
+        if (est.push(signals))
+        {
+            alphaDb += decodeDb(est.packet().power[0]);
+            betaDb += decodeDb(est.packet().power[CH_MAX]);
+            checksum += static_cast<uint16_t>(est.packet().power[1]);
+            blocks++;
+        }
+    }
+    const double cpu = cpuSec() - t0;
+    // 生成器の時間を除くため、同じ量の生成だけを別に測る
+    const double t1 = cpuSec();
+    for (size_t n = 0; n < samples; ++n)
+    {
+        generator.generate(sample);
+        checksum += static_cast<uint16_t>(sample.signals[n % CH_MAX]);
+    }
+    const double genCpu = cpuSec() - t1;
+    const double ns = (cpu - genCpu) / samples * 1e9;
+    const double featureBytes = est.packetSize() * static_cast<double>(rateHz);
+    const double rawBytes = sizeof(ChunkedSamplePacket) * SAMPLE_RATE_HZ / static_cast<double>(SAMPLES_PER_CHUNK);
+    printf("  generator, %u Hz blocks: alpha %.2f dB, beta %.2f dB (%zu blocks)\n", rateHz, alphaDb / blocks,
+           betaDb / blocks, blocks);
+    benchSink = checksum;
+    printf("  %zu bins x %u ch: %.1f ns/sample, %zu B/packet -> %.0f B/s vs %.0f B/s raw (%.0fx less)\n", est.bins(), CH_MAX, ns,
+           est.packetSize(), featureBytes, rawBytes, rawBytes / featureBytes);
+}
+
+void benchSpectrum(size_t samples)
+{
+    printf("  %5s %6s %10s %10s %12s %12s %10s\n", "N", "hop", "sine dB", "peak bin", "ns/channel", "ns/block 8ch",
+           "% of hop");
+    for (uint8_t log2n = FFT_MIN_LOG2; log2n <= FFT_MAX_LOG2; ++log2n)
+    {
+        // bin 中心の正弦波 (振幅 100 counts → 40 dB) を読めるか
+        SpectrumAnalyzer analyzer;
+        analyzer.configure(log2n, 0x01, 1, 0);
+        const size_t n = analyzer.fftSize();
+        const size_t bin = n / 25; // 10Hz 付近
+        int16_t signals[CH_MAX] = {};
+        double peakDb = 0.0;
+        size_t peakBin = 0;
+        for (size_t i = 0; i < n * 2; ++i)
+        {
+            signals[0] = static_cast<int16_t>(lround(100.0 * sin(2.0 * BENCH_PI * bin * i / n)));
+            if (analyzer.push(signals))
+            {
+                const SpectrumPacket &pkt = analyzer.packet();
+                peakBin = 0;
+                for (size_t k = 1; k < pkt.num_bins; ++k)
+                {
+                    peakBin = pkt.magnitude[k] > pkt.magnitude[peakBin] ? k : peakBin;
+                }
+                peakDb = pkt.magnitude[peakBin] / 2.0 - SPECTRUM_DB_OFFSET;
+            }
+        }
+
+        // 全 8ch、50% 重なりで生成器の信号を流す
+        analyzer.configure(log2n, 0xFF, 1, 0);
+        EegSignalGenerator generator(5);
+        SampleData sample;
+        uint64_t checksum = 0;
+        size_t computed = 0;
+        const double t0 = cpuSec();
+        for (size_t i = 0; i < samples; ++i)
+        {
+            generator.generate(sample);
+            memcpy(signals, sample.signals, sizeof(signals));
+            if (analyzer.push(signals))
+            {
+                checksum += analyzer.packet().magnitude[bin];
+                computed++;
+            }
+        }
+        const double cpu = cpuSec() - t0;
+        const double t1 = cpuSec();
+        for (size_t i = 0; i < samples; ++i)
+        {
+            generator.generate(sample);
+            checksum += static_cast<uint16_t>(sample.signals[0]);
+        }
+        const double perChannel = (cpu - (cpuSec() - t1)) / computed * 1e9;
+        const double hopNs = 1e9 * analyzer.hop() / SAMPLE_RATE_HZ;
+        benchSink = checksum;
+        printf("  %5zu %6zu %7.2f dB %6zu/%-3zu %12.0f %12.0f %9.4f%%\n", n, analyzer.hop(), peakDb, peakBin, bin, perChannel,
+               perChannel * CH_MAX, 100.0 * perChannel * CH_MAX / hopNs);
+    }
+}
+
+void benchErp(size_t minutes)
+{
+    // 0.4..0.6 秒ごと (α と位相が揃わないようにばらつかせる) に刺激、5 回に 1 回が標的 (トリガー 1)、
+    // 他は非標的 (トリガー 2)。-100..+800ms、1 分ごとに報告
+    ErpAverager erp;
+    erp.configure(25, 200, SAMPLE_RATE_HZ * 60u, 0xFF, false);
+    EegSignalGenerator generator(17);
+    Pcg32 rng(23);
+    SampleData sample;
+    int16_t signals[CH_MAX];
+    const size_t samples = minutes * 60u * SAMPLE_RATE_HZ;
+    size_t packets = 0;
+    double peak[2] = {0.0, 0.0};
+    uint16_t counts[2] = {0, 0};
+    size_t nextStimulus = SAMPLE_RATE_HZ;
+    const double t0 = cpuSec();
+    for (size_t n = 0; n < samples; ++n)
+    {
+        if (n == nextStimulus)
+        {
+            generator.startStimulusEvent(rng.next() % 5 == 0 ? 1 : 2);
+            nextStimulus += 100 + rng.next() % 50;
+        }
+        generator.generate(sample);
+        memcpy(signals, sample.signals, sizeof(signals));
+        if (erp.push(signals, sample.trigger_state))
+        {
+            packets++;
+            const ErpAveragePacket &pkt = erp.packet();
+            if (pkt.channel == 0 && (pkt.condition == 1 || pkt.condition == 2))
+            {
+                // 立ち上がり後 250..500ms の最大 (µV)
+                double best = -1e9;
+                for (size_t i = pkt.pre_samples + 62; i < pkt.pre_samples + 125u && i < pkt.num_samples; ++i)
+                {
+                    best = std::max(best, pkt.values[i] / static_cast<double>(1 << pkt.frac_bits) * MICROVOLT_PER_COUNT);
+                }
+                peak[pkt.condition - 1] = best;
+                counts[pkt.condition - 1] = pkt.epoch_count;
+            }
+        }
+    }
+    const double cpu = cpuSec() - t0;
+    const double bytesPerMin = packets * erp.packetSize() / static_cast<double>(minutes);
+    const double rawPerMin = sizeof(ChunkedSamplePacket) * SAMPLE_RATE_HZ * 60.0 / SAMPLES_PER_CHUNK;
+    printf("  %zu min: target %.2f uV peak (%u epochs), non-target %.2f uV (%u epochs), dropped %u\n", minutes, peak[0],
+           counts[0], peak[1], counts[1], erp.stats().droppedNoBaseline + erp.stats().droppedOverflow);
+    printf("  %.1f packets/min, %.0f B/min vs %.0f B/min raw (%.0fx less), %.1f ns/sample incl. generator\n",
+           packets / static_cast<double>(minutes), bytesPerMin, rawPerMin, rawPerMin / bytesPerMin, cpu / samples * 1e9);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    FilterSpec spec;
+    spec.notchHz = 50;
+    spec.notchHarmonics = 2;
+    spec.highpassCentiHz = 50;
+    spec.lowpassHz = 40;
+    size_t samples = 2000000;
+    uint8_t bandRate = 2;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--notch" && i + 1 < argc)
+            spec.notchHz = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--harmonics" && i + 1 < argc)
+            spec.notchHarmonics = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--highpass" && i + 1 < argc)
+            spec.highpassCentiHz = static_cast<uint16_t>(lround(strtod(argv[++i], nullptr) * 100.0));
+        else if (arg == "--lowpass" && i + 1 < argc)
+            spec.lowpassHz = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--band-rate" && i + 1 < argc)
+            bandRate = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--samples" && i + 1 < argc)
+            samples = std::max<size_t>(SAMPLE_RATE_HZ * 40, strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            fprintf(stderr, "Usage: %s [--notch HZ] [--harmonics N] [--highpass HZ] [--lowpass HZ] [--band-rate HZ] [--samples N]\n", argv[0]);
+            return 2;
+        }
+    }
+    BiquadChain chain;
+    if (!chain.configure(spec))
+    {
+        fprintf(stderr, "[DSP] filter spec rejected (cutoff at or above Nyquist)\n");
+        return 1;
+    }
+
+    printf("biquad chain: notch %u Hz x%u, high-pass %.2f Hz, low-pass %u Hz (%zu stages)\n", spec.notchHz,
+           spec.notchHarmonics, spec.highpassCentiHz / 100.0, spec.lowpassHz, chain.stages());
+    printf("response (measured / designed):\n");
+    const double freqs[] = {0.2, 0.5, 1.0, 5.0, 10.0, 20.0, 30.0, 40.0, 45.0, 49.0, 50.0, 60.0, 100.0, 120.0};
+    for (double f : freqs)
+    {
+        if (f >= SAMPLE_RATE_HZ / 2)
+        {
+            continue;
+        }
+        printf("  %6.1f Hz  %8.2f dB  %8.2f dB\n", f, measureGainDb(spec, f, 8000.0), designGainDb(spec, f));
+    }
+    printf("quantisation error vs double DF-I: %.3f LSB rms\n", quantisationErrorLsb(spec, samples / 4));
+    printf("speed:\n");
+    benchSpeed(spec, samples);
+    if (SAMPLE_RATE_HZ % std::max<uint8_t>(bandRate, 1) != 0 || bandRate == 0 || bandRate > BAND_POWER_MAX_RATE_HZ)
+    {
+        fprintf(stderr, "[DSP] band rate must divide %u and be 1..%u\n", SAMPLE_RATE_HZ, BAND_POWER_MAX_RATE_HZ);
+        return 1;
+    }
+    printf("band power (alpha 8-12 Hz / beta 13-30 Hz, Hann, %u Hz resolution):\n", bandRate);
+    benchBandPower(bandRate, samples);
+    printf("spectrum (Hann, 50%% overlap, Q31 real FFT):\n");
+    benchSpectrum(samples);
+    printf("ERP averaging (P300 oddball, 8 ch):\n");
+    benchErp(10);
+    return 0;
+}
@@ -0,0 +1,291 @@
+// 記録ライタ (eeg_recorder) のベンチマーク
+//
+//   record_bench [--files 64] [--total-mb 512] [--record-bytes 406] [--buffer-kb 256] [--depth 32]
+//                [--threads 4] [--dir /tmp/record_bench.d] [--modes sync,threads,uring] [--no-direct]
+//
+// デバイスごとのファイルへ、チャンク 1 個分 (既定 406 B = 装置番号 + インデックス + 25 x 8 ch) の
+// レコードを順番に append し続ける。モードごとに
+//   sync    : ファイルごとに同じ大きさのバッファを持ち、埋まったら write() で待つ (従来の書き方)
+//   threads : RecordingWriter + pwrite スレッドプール
+//   uring   : RecordingWriter + io_uring
+// のスループットと append 1 回の所要時間 (p50 / p99 / p99.9 / max) を出す。書き込み後は先頭と末尾のファイルを
+// 読み戻して内容を確かめる。O_DIRECT の有無でページキャッシュの効き方が変わるので両方見ること。
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "eeg_host_clock.h"
+#include "eeg_ingest_pipeline.h"
+#include "eeg_recorder.h"
+
+namespace
+{
+
+struct BenchOptions
+{
+    size_t files = 64;
+    size_t totalMb = 512;
+    size_t recordBytes = sizeof(uint32_t) + sizeof(uint16_t) + SAMPLES_PER_CHUNK * CH_MAX * sizeof(int16_t);
+    size_t bufferKb = 256;
+    size_t depth = 32;
+    size_t threads = 4;
+    bool direct = true;
+    std::string dir = "/tmp/record_bench.d";
+    std::string modes = "sync,threads,uring";
+};
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --files N          number of streams / files (default 64)\n"
+            "  --total-mb MB      bytes written per mode (default 512)\n"
+            "  --record-bytes N   size of one append (default: one chunk record)\n"
+            "  --buffer-kb KB     per-write buffer (default 256)\n"
+            "  --depth N          writes in flight (default 32)\n"
+            "  --threads N        thread-pool writers (default 4)\n"
+            "  --dir PATH         scratch directory (default /tmp/record_bench.d)\n"
+            "  --modes LIST       comma separated: sync,threads,uring\n"
+            "  --no-direct        do not try O_DIRECT\n",
+            argv0);
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--files" && hasValue)
+            opt.files = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--total-mb" && hasValue)
+            opt.totalMb = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--record-bytes" && hasValue)
+            opt.recordBytes = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--buffer-kb" && hasValue)
+            opt.bufferKb = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--depth" && hasValue)
+            opt.depth = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue)
+            opt.threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--dir" && hasValue)
+            opt.dir = argv[++i];
+        else if (arg == "--modes" && hasValue)
+            opt.modes = argv[++i];
+        else if (arg == "--no-direct")
+            opt.direct = false;
+        else
+            return false;
+    }
+    return opt.files > 0 && opt.totalMb > 0 && opt.recordBytes >= 8;
+}
+
+std::string filePath(const BenchOptions &opt, size_t file)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/dev-%05zu.raw", file);
+    return opt.dir + name;
+}
+
+// レコード内容: 先頭 8 バイトに (ファイル, 通し番号)、残りは両方から決まる擬似乱数
+void fillRecord(uint8_t *out, size_t bytes, uint32_t file, uint32_t index)
+{
+    memcpy(out, &file, sizeof(file));
+    memcpy(out + 4, &index, sizeof(index));
+    uint32_t x = file * 2654435761u ^ index * 40503u ^ 0x9E3779B9u;
+    for (size_t i = 8; i < bytes; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = static_cast<uint8_t>(x);
+    }
+}
+
+// 従来の書き方: ファイルごとのバッファ + 埋まったら write() で待つ
+class SyncWriter
+{
+public:
+    SyncWriter(size_t files, size_t bufferBytes) : bufferBytes_(bufferBytes), fds_(files, -1), buffers_(files) {}
+
+    bool open(size_t file, const char *path)
+    {
+        fds_[file] = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        buffers_[file].reserve(bufferBytes_);
+        return fds_[file] >= 0;
+    }
+
+    bool append(size_t file, const uint8_t *data, size_t size)
+    {
+        std::vector<uint8_t> &buf = buffers_[file];
+        buf.insert(buf.end(), data, data + size);
+        return buf.size() < bufferBytes_ || flush(file);
+    }
+
+    bool close(size_t file)
+    {
+        const bool ok = flush(file);
+        return ::close(fds_[file]) == 0 && ok;
+    }
+
+private:
+    bool flush(size_t file)
+    {
+        std::vector<uint8_t> &buf = buffers_[file];
+        size_t done = 0;
+        while (done < buf.size())
+        {
+            const ssize_t w = write(fds_[file], buf.data() + done, buf.size() - done);
+            if (w < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (w <= 0)
+            {
+                return false;
+            }
+            done += static_cast<size_t>(w);
+        }
+        buf.clear();
+        return true;
+    }
+
+    size_t bufferBytes_;
+    std::vector<int> fds_;
+    std::vector<std::vector<uint8_t>> buffers_;
+};
+
+bool verifyFile(const BenchOptions &opt, size_t file, uint32_t records)
+{
+    FILE *fp = fopen(filePath(opt, file).c_str(), "rb");
+    if (fp == nullptr)
+    {
+        return false;
+    }
+    std::vector<uint8_t> expected(opt.recordBytes);
+    std::vector<uint8_t> actual(opt.recordBytes);
+    bool ok = true;
+    for (uint32_t i = 0; i < records && ok; ++i)
+    {
+        fillRecord(expected.data(), opt.recordBytes, static_cast<uint32_t>(file), i);
+        ok = fread(actual.data(), 1, opt.recordBytes, fp) == opt.recordBytes && actual == expected;
+    }
+    ok = ok && fgetc(fp) == EOF; // 0 埋めが切り詰められている
+    fclose(fp);
+    return ok;
+}
+
+bool runMode(const BenchOptions &opt, const std::string &mode)
+{
+    const size_t records = opt.totalMb * 1024 * 1024 / opt.recordBytes;
+    const uint32_t perFile = static_cast<uint32_t>(records / opt.files);
+    std::vector<uint8_t> record(opt.recordBytes);
+
+    RecorderConfig config;
+    config.maxFiles = opt.files;
+    config.bufferBytes = opt.bufferKb * 1024;
+    config.queueDepth = opt.depth;
+    config.threads = opt.threads;
+    config.direct = opt.direct;
+    config.backend = mode == "uring" ? RECORDER_BACKEND_URING : RECORDER_BACKEND_THREADS;
+    RecordingWriter writer(config);
+    SyncWriter sync(opt.files, config.bufferBytes);
+    std::vector<int> handles(opt.files, -1);
+
+    if (mode != "sync" && !writer.start())
+    {
+        printf("%-8s unavailable on this system\n", mode.c_str());
+        return true;
+    }
+    for (size_t f = 0; f < opt.files; ++f)
+    {
+        const std::string path = filePath(opt, f);
+        const bool ok = mode == "sync" ? sync.open(f, path.c_str()) : (handles[f] = writer.openFile(path.c_str())) >= 0;
+        if (!ok)
+        {
+            fprintf(stderr, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    LatencyHistogram appendNs;
+    bool ok = true;
+    const int64_t t0 = monotonicNs();
+    for (uint32_t i = 0; i < perFile && ok; ++i)
+    {
+        for (size_t f = 0; f < opt.files; ++f)
+        {
+            fillRecord(record.data(), opt.recordBytes, static_cast<uint32_t>(f), i);
+            const int64_t a = monotonicNs();
+            ok = mode == "sync" ? sync.append(f, record.data(), record.size()) : writer.append(handles[f], record.data(), record.size());
+            appendNs.add(monotonicNs() - a);
+        }
+    }
+    for (size_t f = 0; f < opt.files; ++f)
+    {
+        ok = (mode == "sync" ? sync.close(f) : writer.closeFile(handles[f])) && ok;
+    }
+    const double elapsed = (monotonicNs() - t0) * 1e-9;
+    const double mb = static_cast<double>(perFile) * opt.files * opt.recordBytes / (1024.0 * 1024.0);
+
+    const bool verified = ok && verifyFile(opt, 0, perFile) && verifyFile(opt, opt.files - 1, perFile);
+    printf("%-8s %6.0f MB/s  append p50 %5.2f us  p99 %6.2f us  p99.9 %8.1f us  max %8.1f us", mode.c_str(), mb / elapsed,
+           appendNs.quantile(0.5) * 1e-3, appendNs.quantile(0.99) * 1e-3, appendNs.quantile(0.999) * 1e-3, appendNs.max() * 1e-3);
+    if (mode != "sync")
+    {
+        const RecorderStats &s = writer.stats();
+        printf("  [%s, direct %zu/%zu, in flight max %zu, stalls %llu (%.1f ms), short %llu, errors %llu]", writer.backendName(),
+               s.directFiles, opt.files, s.maxInFlight, static_cast<unsigned long long>(s.stalls), s.stallNs * 1e-6,
+               static_cast<unsigned long long>(s.shortWrites), static_cast<unsigned long long>(s.errors));
+    }
+    printf("  %s\n", verified ? "verified" : "VERIFY FAILED");
+
+    for (size_t f = 0; f < opt.files; ++f)
+    {
+        unlink(filePath(opt, f).c_str());
+    }
+    return verified;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    mkdir(opt.dir.c_str(), 0755);
+    printf("record_bench: %zu files, %zu MB per mode, %zu B records, %zu KiB buffers, depth %zu, O_DIRECT %s\n", opt.files,
+           opt.totalMb, opt.recordBytes, opt.bufferKb, opt.depth, opt.direct ? "on" : "off");
+
+    bool ok = true;
+    size_t start = 0;
+    while (start <= opt.modes.size())
+    {
+        const size_t comma = std::min(opt.modes.find(',', start), opt.modes.size());
+        const std::string mode = opt.modes.substr(start, comma - start);
+        if (mode == "sync" || mode == "threads" || mode == "uring")
+        {
+            ok = runMode(opt, mode) && ok;
+        }
+        else if (!mode.empty())
+        {
+            fprintf(stderr, "Unknown mode: %s\n", mode.c_str());
+            ok = false;
+        }
+        start = comma + 1;
+    }
+    rmdir(opt.dir.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+// ストリーム適合性チェッカー CLI
+//
+//   stream_check [options] FILE... | -        キャプチャ (パケット連結) を検査
+//   stream_check [options] --udp PORT         ライブ受信 (SIGINT / --duration で終了)
+//
+// ファイルはスレッドプールで並列に処理し、結果を JSON で標準出力へ書く。
+// 1 つでも不合格なら終了コード 1。
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eeg_host_clock.h"
+#include "eeg_stream_checker.h"
+
+namespace
+{
+
+constexpr size_t READ_BLOCK_BYTES = 1u << 20;
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int)
+{
+    g_stop.store(true);
+}
+
+bool checkFile(const std::string &path, StreamChecker &checker)
+{
+    const int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[READ_BLOCK_BYTES]);
+    ssize_t n;
+    while ((n = read(fd, buf.get(), READ_BLOCK_BYTES)) > 0)
+    {
+        checker.feed(buf.get(), static_cast<size_t>(n));
+    }
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    checker.finish();
+    if (n < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool checkUdp(uint16_t port, double durationSec, StreamChecker &checker)
+{
+    const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (sock < 0 || bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        perror("[CHECK] udp");
+        return false;
+    }
+    timeval tv{0, 200000}; // 停止要求を見るための受信タイムアウト
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    const double stopAt = durationSec > 0.0 ? monotonicSec() + durationSec : 0.0;
+    uint8_t buf[2048];
+    while (!g_stop.load() && (stopAt == 0.0 || monotonicSec() < stopAt))
+    {
+        const ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            checker.feed(buf, static_cast<size_t>(n));
+        }
+    }
+    close(sock);
+    checker.finish();
+    return true;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] FILE... | - | --udp PORT\n"
+            "  --threads N            parallel files (default: all cores)\n"
+            "  --max-abs-counts N     amplitude bound (default 64)\n"
+            "  --min-peak-ratio R     alpha/beta vs reference power (default 4)\n"
+            "  --duration SEC         stop live input after SEC seconds\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    StreamCheckLimits limits;
+    std::vector<std::string> inputs;
+    size_t threads = 0;
+    int udpPort = -1;
+    double durationSec = 0.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue)
+            threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--max-abs-counts" && hasValue)
+            limits.maxAbsCounts = static_cast<int16_t>(strtol(argv[++i], nullptr, 10));
+        else if (arg == "--min-peak-ratio" && hasValue)
+            limits.minPeakRatio = strtof(argv[++i], nullptr);
+        else if (arg == "--udp" && hasValue)
+            udpPort = atoi(argv[++i]);
+        else if (arg == "--duration" && hasValue)
+            durationSec = strtod(argv[++i], nullptr);
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-")
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty() == (udpPort < 0))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (udpPort >= 0)
+    {
+        inputs.push_back("udp:" + std::to_string(udpPort));
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+    }
+
+    std::vector<std::unique_ptr<StreamChecker>> checkers;
+    std::vector<char> ok(inputs.size(), 0);
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        checkers.emplace_back(new StreamChecker(limits));
+    }
+
+    const double t0 = monotonicSec();
+    if (udpPort >= 0)
+    {
+        ok[0] = checkUdp(static_cast<uint16_t>(udpPort), durationSec, *checkers[0]);
+    }
+    else
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < std::min(threads, inputs.size()); ++t)
+        {
+            pool.emplace_back([&]()
+                              {
+                                  for (size_t i = next.fetch_add(1); i < inputs.size(); i = next.fetch_add(1))
+                                  {
+                                      ok[i] = checkFile(inputs[i], *checkers[i]);
+                                  }
+                              });
+        }
+        for (std::thread &th : pool)
+        {
+            th.join();
+        }
+    }
+    const double elapsed = monotonicSec() - t0;
+
+    bool allPassed = true;
+    uint64_t totalSamples = 0;
+    printf("{\n  \"results\": [\n");
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        checkers[i]->writeJson(stdout, inputs[i].c_str(), 4);
+        printf(i + 1 < inputs.size() ? ",\n" : "\n");
+        allPassed = allPassed && ok[i] && checkers[i]->passed();
+        totalSamples += checkers[i]->samples();
+    }
+    const double recordedSec = totalSamples / static_cast<double>(SAMPLE_RATE_HZ);
+    printf("  ],\n  \"pass\": %s,\n  \"elapsed_s\": %.3f,\n  \"realtime_factor\": %.1f\n}\n",
+           allPassed ? "true" : "false", elapsed, recordedSec / (elapsed > 0 ? elapsed : 1e-9));
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+// 複数デバイスのストリーム結合 CLI
+//
+//   stream_merge [options] FILE...        キャプチャ 1 ファイル = 1 デバイスとして結合
+//   stream_merge --bench N [options]      N 台ぶんの合成ストリームで結合のスループットを測る
+//
+// ファイル入力の時刻は start_index (16bit を展開) とテレメトリ (0xE1) のクロックずれから作り、
+// --offset DEV:SEC で各デバイスの開始時刻を合わせる。結果は --out DIR に
+// merged.npy (frames, devices, CH_MAX) int16 と present.npy (frames, devices) uint8 で書く。
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "eeg_host_clock.h"
+#include "eeg_npy.h"
+#include "eeg_packet_framer.h"
+#include "eeg_random.h"
+#include "eeg_signal_generator.h"
+#include "eeg_stream_merger.h"
+
+namespace
+{
+
+// 1 回の読み込みで進む時間が maxSkew より十分短くなるよう、チャンク 2 個ぶんずつ読む
+constexpr size_t READ_BLOCK_BYTES = 2 * sizeof(ChunkedSamplePacket);
+
+// 1 デバイスぶんのキャプチャを読み、チャンクごとに時刻を付けて merger へ渡す
+class CaptureSource : public PacketFramer::Handler
+{
+public:
+    CaptureSource(size_t device, double offsetSec, StreamMerger &merger)
+        : device_(device), offsetSec_(offsetSec), merger_(merger), framer_(*this)
+    {
+    }
+
+    bool open(const std::string &path)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+        {
+            perror(path.c_str());
+            return false;
+        }
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return true;
+    }
+
+    bool finished() const { return fd_ < 0; }
+    double timeSec() const { return timeSec_; }
+
+    // READ_BLOCK_BYTES だけ読み進める。終端なら false
+    bool pump()
+    {
+        if (fd_ < 0)
+        {
+            return false;
+        }
+        const ssize_t n = read(fd_, buf_, sizeof(buf_));
+        if (n <= 0)
+        {
+            framer_.finish();
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        framer_.feed(buf_, static_cast<size_t>(n));
+        return true;
+    }
+
+    void onPacket(uint8_t type, const uint8_t *data, size_t size) override
+    {
+        if (type == PKT_TYPE_TELEMETRY && size == sizeof(DeviceTelemetryPacket))
+        {
+            DeviceTelemetryPacket tel;
+            memcpy(&tel, data, sizeof(tel));
+            clockPpm_ = tel.clock_offset_ppb * 1e-3;
+            return;
+        }
+        if (type != PKT_TYPE_DATA_CHUNK || size != sizeof(ChunkedSamplePacket))
+        {
+            return;
+        }
+        ChunkedSamplePacket pkt;
+        memcpy(&pkt, data, sizeof(pkt));
+
+        // 16bit の start_index を展開し、デバイスの実レートで積分した時刻に直す
+        if (!started_)
+        {
+            started_ = true;
+            sampleIndex_ = pkt.start_index;
+            timeSec_ = offsetSec_;
+        }
+        else
+        {
+            uint16_t delta = static_cast<uint16_t>(pkt.start_index - static_cast<uint16_t>(sampleIndex_));
+            if (delta >= 0x8000)
+            {
+                // 後ろへ飛んだのはセッションの再開始。時間軸は途切れずに続いているとみなす
+                delta = SAMPLES_PER_CHUNK;
+            }
+            timeSec_ += delta * periodSec();
+            sampleIndex_ += delta;
+        }
+
+        int16_t frames[SAMPLES_PER_CHUNK * CH_MAX];
+        const size_t n = std::min<size_t>(pkt.num_samples, SAMPLES_PER_CHUNK);
+        for (size_t i = 0; i < n; ++i)
+        {
+            memcpy(&frames[i * CH_MAX], pkt.samples[i].signals, sizeof(pkt.samples[i].signals));
+        }
+        merger_.push(device_, timeSec_, periodSec(), frames, n);
+    }
+
+private:
+    double periodSec() const
+    {
+        return 1.0 / (SAMPLE_RATE_HZ * (1.0 + clockPpm_ * 1e-6));
+    }
+
+    size_t device_;
+    double offsetSec_;
+    StreamMerger &merger_;
+    PacketFramer framer_;
+    int fd_ = -1;
+    uint8_t buf_[READ_BLOCK_BYTES];
+    bool started_ = false;
+    uint64_t sampleIndex_ = 0;
+    double timeSec_ = 0.0;
+    double clockPpm_ = 0.0;
+};
+
+// ベンチ用の合成デバイス: 開始時刻のずれ・クロックずれ・到着順の入れ替わり・欠落を持つ
+struct SyntheticDevice
+{
+    EegSignalGenerator generator;
+    double startSec;
+    double periodSec;
+    uint64_t chunk = 0;
+};
+
+void printStats(const StreamMerger &merger, size_t devices, double elapsed, double mergedSec)
+{
+    uint64_t placed = 0;
+    uint64_t late = 0;
+    uint64_t overflow = 0;
+    uint64_t missing = 0;
+    for (size_t d = 0; d < devices; ++d)
+    {
+        const MergerDeviceStats &st = merger.stats(d);
+        placed += st.framesPlaced;
+        late += st.lateDrops;
+        overflow += st.overflowDrops;
+        missing += st.missingSlots;
+    }
+    printf("{\n  \"devices\": %zu,\n  \"blocks\": %llu,\n  \"merged_s\": %.3f,\n"
+           "  \"frames_placed\": %llu,\n  \"late_drops\": %llu,\n  \"overflow_drops\": %llu,\n"
+           "  \"missing_slots\": %llu,\n  \"elapsed_s\": %.3f,\n  \"realtime_factor\": %.1f\n}\n",
+           devices, static_cast<unsigned long long>(merger.blocksEmitted()), mergedSec,
+           static_cast<unsigned long long>(placed), static_cast<unsigned long long>(late),
+           static_cast<unsigned long long>(overflow), static_cast<unsigned long long>(missing),
+           elapsed, mergedSec / (elapsed > 0 ? elapsed : 1e-9));
+}
+
+int runBench(size_t devices, double durationSec, MergerConfig config, double jitterSec, double lossRate, uint32_t seed)
+{
+    config.devices = devices;
+    uint64_t frames = 0;
+    StreamMerger merger(config, [&](const MergedBlock &block)
+                        { frames += block.frames; });
+
+    Pcg32 rng(seed, 0xB1E5);
+    std::vector<std::unique_ptr<SyntheticDevice>> devs;
+    for (size_t d = 0; d < devices; ++d)
+    {
+        const double ppm = (rng.nextUniform() * 2.0 - 1.0) * 50.0;
+        devs.emplace_back(new SyntheticDevice{EegSignalGenerator(splitmix64(seed + d)),
+                                              rng.nextUniform() * config.maxSkewSec * 0.5,
+                                              1.0 / (config.rateHz * (1.0 + ppm * 1e-6))});
+    }
+
+    // 到着時刻 (チャンク末尾の時刻 + ジッタ) の順に push する
+    struct Arrival
+    {
+        double time;
+        size_t device;
+        bool operator<(const Arrival &o) const { return time > o.time; }
+    };
+    std::priority_queue<Arrival> arrivals;
+    const double chunkSec = SAMPLES_PER_CHUNK / config.rateHz;
+    for (size_t d = 0; d < devices; ++d)
+    {
+        arrivals.push({devs[d]->startSec + chunkSec + rng.nextUniform() * jitterSec, d});
+    }
+
+    int16_t frameBuf[SAMPLES_PER_CHUNK * CH_MAX];
+    SampleData sample;
+    const double t0 = monotonicSec();
+    while (!arrivals.empty())
+    {
+        const Arrival a = arrivals.top();
+        arrivals.pop();
+        SyntheticDevice &dev = *devs[a.device];
+        for (size_t i = 0; i < SAMPLES_PER_CHUNK; ++i)
+        {
+            dev.generator.generate(sample);
+            memcpy(&frameBuf[i * CH_MAX], sample.signals, sizeof(sample.signals));
+        }
+        const double first = dev.startSec + dev.chunk * SAMPLES_PER_CHUNK * dev.periodSec;
+        if (rng.nextUniform() >= lossRate)
+        {
+            merger.push(a.device, first, dev.periodSec, frameBuf, SAMPLES_PER_CHUNK);
+        }
+        dev.chunk++;
+        const double next = dev.startSec + (dev.chunk + 1) * SAMPLES_PER_CHUNK * dev.periodSec;
+        if (next < durationSec)
+        {
+            arrivals.push({next + rng.nextUniform() * jitterSec, a.device});
+        }
+    }
+    merger.flush();
+    const double elapsed = monotonicSec() - t0;
+    printStats(merger, devices, elapsed, frames / config.rateHz);
+    return 0;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] FILE...  |  --bench N\n"
+            "  --out DIR            write merged.npy / present.npy\n"
+            "  --offset DEV:SEC     start time of device DEV on the common timeline\n"
+            "  --max-skew SEC       wait this long for a lagging device (default 0.5)\n"
+            "  --block N            frames per merged block (default 25)\n"
+            "  --queue N            per-device buffered frames (default 4096)\n"
+            "  --duration SEC       bench: stream length (default 60)\n"
+            "  --jitter SEC         bench: arrival jitter (default 0.05)\n"
+            "  --loss P             bench: chunk loss probability (default 0.001)\n"
+            "  --seed N             bench: seed\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    MergerConfig config;
+    std::vector<std::string> inputs;
+    std::vector<std::pair<size_t, double>> offsets;
+    std::string outDir;
+    size_t benchDevices = 0;
+    double durationSec = 60.0;
+    double jitterSec = 0.05;
+    double lossRate = 0.001;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue)
+            outDir = argv[++i];
+        else if (arg == "--offset" && hasValue)
+        {
+            char *colon = nullptr;
+            const size_t dev = strtoul(argv[++i], &colon, 10);
+            offsets.emplace_back(dev, *colon == ':' ? strtod(colon + 1, nullptr) : 0.0);
+        }
+        else if (arg == "--max-skew" && hasValue)
+            config.maxSkewSec = strtod(argv[++i], nullptr);
+        else if (arg == "--block" && hasValue)
+            config.blockFrames = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--queue" && hasValue)
+            config.maxQueuedFrames = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--bench" && hasValue)
+            benchDevices = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--duration" && hasValue)
+            durationSec = strtod(argv[++i], nullptr);
+        else if (arg == "--jitter" && hasValue)
+            jitterSec = strtod(argv[++i], nullptr);
+        else if (arg == "--loss" && hasValue)
+            lossRate = strtod(argv[++i], nullptr);
+        else if (arg == "--seed" && hasValue)
+            seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+            inputs.push_back(arg);
+    }
+    if (benchDevices > 0)
+    {
+        return runBench(benchDevices, durationSec, config, jitterSec, lossRate, seed);
+    }
+    if (inputs.empty())
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    config.devices = inputs.size();
+    AppendNpyFile mergedFile;
+    AppendNpyFile presentFile;
+    const bool writeOut = !outDir.empty();
+    if (writeOut && (!mergedFile.create(outDir + "/merged.npy", "<i2", {config.devices, CH_MAX}) ||
+                     !presentFile.create(outDir + "/present.npy", "|u1", {config.devices})))
+    {
+        return 1;
+    }
+    uint64_t frames = 0;
+    StreamMerger merger(config, [&](const MergedBlock &block)
+                        {
+                            frames += block.frames;
+                            if (writeOut)
+                            {
+                                mergedFile.append(block.data.data(), block.data.size() * sizeof(int16_t), block.frames);
+                                presentFile.append(block.present.data(), block.present.size(), block.frames);
+                            }
+                        });
+
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    for (size_t d = 0; d < inputs.size(); ++d)
+    {
+        double offset = 0.0;
+        for (const auto &o : offsets)
+        {
+            offset = o.first == d ? o.second : offset;
+        }
+        sources.emplace_back(new CaptureSource(d, offset, merger));
+        if (!sources.back()->open(inputs[d]))
+        {
+            return 1;
+        }
+    }
+
+    // 常に時間軸が最も遅れているファイルから読み、ライブ受信に近い到着順で merger へ流す
+    const double t0 = monotonicSec();
+    for (;;)
+    {
+        CaptureSource *behind = nullptr;
+        for (auto &src : sources)
+        {
+            if (!src->finished() && (!behind || src->timeSec() < behind->timeSec()))
+            {
+                behind = src.get();
+            }
+        }
+        if (!behind)
+        {
+            break;
+        }
+        behind->pump();
+    }
+    merger.flush();
+    const double elapsed = monotonicSec() - t0;
+
+    if (writeOut && !(mergedFile.close() && presentFile.close()))
+    {
+        perror("[MERGE] write");
+        return 1;
+    }
+    printStats(merger, config.devices, elapsed, frames / config.rateHz);
+    return 0;
+}
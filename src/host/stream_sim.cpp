@@ -0,0 +1,338 @@
+// ホスト版ストリームシミュレータ: コマンドログの記録と再生
+//
+//   stream_sim record SCRIPT --log OUT.ecl [--stream OUT.bin] [--digest N] [--crc 0|1]
+//       テキストのコマンド台本 (行ごとに "<サンプル位置> <cmd> [payload...]"、16 進) を
+//       ファームウェアと同じ手順で適用し、コマンドログとパケット列を書き出す。
+//   stream_sim replay LOG.ecl [--stream OUT.bin] [--verify CAPTURE.bin] [--digest N] [--crc 0|1]
+//       デバイスまたは record で得たログを再生し、ビット単位で同じパケット列を作る。
+//
+// --digest N でファームウェアと同じく N チャンクごとに StreamDigestPacket を挟む。
+// --crc 1 で各パケットに CRC-32C トレーラを付ける (設定パケットのフラグも立てる)。
+// パケット列は DeviceConfigPacket / ChunkedSamplePacket をそのまま連結したもの。
+// 設定パケットにはファームウェアと同じくセッショントークン (START の seed) が入る。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eeg_command_log.h"
+#include "eeg_crc.h"
+#include "eeg_host_clock.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+#include "eeg_stream_engine.h"
+
+namespace
+{
+
+constexpr size_t HOST_COMMAND_LOG_BYTES = 16u << 20;
+
+struct TimedCommand
+{
+    uint32_t sampleIndex;
+    std::vector<uint8_t> bytes; // bytes[0] がコマンド
+};
+
+bool readFile(const std::string &path, std::vector<uint8_t> &out)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        out.insert(out.end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+bool writeFile(const std::string &path, const uint8_t *data, size_t size)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr || fwrite(data, 1, size, fp) != size)
+    {
+        perror(path.c_str());
+        if (fp != nullptr)
+        {
+            fclose(fp);
+        }
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+bool parseScript(const std::string &path, std::vector<TimedCommand> &commands)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp == nullptr)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    char line[512];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fp) != nullptr)
+    {
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if (hash != nullptr)
+        {
+            *hash = '\0';
+        }
+        char *save = nullptr;
+        char *tok = strtok_r(line, " \t\r\n", &save);
+        if (tok == nullptr)
+        {
+            continue;
+        }
+        TimedCommand cmd;
+        cmd.sampleIndex = static_cast<uint32_t>(strtoul(tok, nullptr, 10));
+        while ((tok = strtok_r(nullptr, " \t\r\n", &save)) != nullptr)
+        {
+            cmd.bytes.push_back(static_cast<uint8_t>(strtoul(tok, nullptr, 16)));
+        }
+        if (cmd.bytes.empty())
+        {
+            fprintf(stderr, "%s:%d: missing command byte\n", path.c_str(), lineNo);
+            fclose(fp);
+            return false;
+        }
+        commands.push_back(cmd);
+    }
+    fclose(fp);
+    return true;
+}
+
+void appendPacket(std::vector<uint8_t> &stream, const void *packet, size_t size, bool crc)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(packet);
+    const size_t start = stream.size();
+    stream.insert(stream.end(), p, p + size);
+    if (crc)
+    {
+        stream.resize(start + size + PACKET_CRC_BYTES);
+        appendPacketCrc(stream.data() + start, size);
+    }
+}
+
+// ファームウェアのメインループと同じ順序で進める:
+// コマンドの位置までサンプルを生成 → コマンド適用 → 次のサンプル生成
+class Simulator
+{
+public:
+    Simulator(CommandLog *log, uint32_t digestInterval, bool crc) : engine_(log), digestInterval_(digestInterval), crc_(crc) {}
+
+    void apply(const TimedCommand &cmd, uint32_t sessionSeed)
+    {
+        const uint8_t op = cmd.bytes[0];
+        if (op == CMD_START_STREAMING)
+        {
+            engine_.startSession(sessionSeed);
+            DeviceConfigPacket cfg;
+            engine_.fillConfigPacket(cfg, crc_);
+            appendPacket(stream_, &cfg, sizeof(cfg), crc_);
+            return;
+        }
+        if (!engine_.sessionActive())
+        {
+            return;
+        }
+        advanceTo(cmd.sampleIndex);
+        if (op == CMD_STOP_STREAMING)
+        {
+            engine_.stopSession();
+        }
+        else
+        {
+            engine_.applyCommand(cmd.bytes.data(), cmd.bytes.size());
+        }
+    }
+
+    std::vector<uint8_t> &stream() { return stream_; }
+    uint64_t samplesGenerated() const { return samples_; }
+
+private:
+    void advanceTo(uint32_t sampleIndex)
+    {
+        while (engine_.sampleIndex() < sampleIndex)
+        {
+            samples_++;
+            if (engine_.step())
+            {
+                appendPacket(stream_, &engine_.packet(), sizeof(ChunkedSamplePacket), crc_);
+                if (digestInterval_ > 0 && engine_.digest().chunks() % digestInterval_ == 0)
+                {
+                    StreamDigestPacket digest;
+                    engine_.digest().fill(digest, engine_.packet().start_index);
+                    appendPacket(stream_, &digest, sizeof(digest), crc_);
+                }
+            }
+        }
+    }
+
+    DummyStreamEngine engine_;
+    uint32_t digestInterval_;
+    bool crc_;
+    std::vector<uint8_t> stream_;
+    uint64_t samples_ = 0;
+};
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s record SCRIPT --log OUT.ecl [--stream OUT.bin] [--digest N] [--crc 0|1]\n"
+            "  %s replay LOG.ecl [--stream OUT.bin] [--verify CAPTURE.bin] [--digest N] [--crc 0|1]\n",
+            argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const std::string mode = argv[1];
+    const std::string input = argv[2];
+    std::string logPath;
+    std::string streamPath;
+    std::string verifyPath;
+    uint32_t digestInterval = 0;
+    bool crc = false;
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--log")
+            logPath = argv[i + 1];
+        else if (arg == "--stream")
+            streamPath = argv[i + 1];
+        else if (arg == "--verify")
+            verifyPath = argv[i + 1];
+        else if (arg == "--digest")
+            digestInterval = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--crc")
+            crc = strtoul(argv[i + 1], nullptr, 10) != 0;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> logStorage(HOST_COMMAND_LOG_BYTES);
+    CommandLog log(logStorage.data(), logStorage.size());
+    const double t0 = monotonicSec();
+    std::unique_ptr<Simulator> sim;
+
+    if (mode == "record" && !logPath.empty())
+    {
+        std::vector<TimedCommand> commands;
+        if (!parseScript(input, commands))
+        {
+            return 1;
+        }
+        sim.reset(new Simulator(&log, digestInterval, crc));
+        uint32_t sessionCounter = 0;
+        for (const TimedCommand &cmd : commands)
+        {
+            // セッション seed はファームウェアと同じ採番
+            const uint32_t seed = cmd.bytes[0] == CMD_START_STREAMING ? static_cast<uint32_t>(splitmix64(++sessionCounter)) : 0;
+            sim->apply(cmd, seed);
+        }
+        // 台本が STOP で終わっていなければ最後のコマンド位置で止める
+        sim->apply({0, {CMD_STOP_STREAMING}}, 0);
+        if (log.overflowed())
+        {
+            fprintf(stderr, "[SIM] command log overflowed\n");
+            return 1;
+        }
+        if (!writeFile(logPath, log.data(), log.size()))
+        {
+            return 1;
+        }
+    }
+    else if (mode == "replay")
+    {
+        std::vector<uint8_t> logBytes;
+        if (!readFile(input, logBytes))
+        {
+            return 1;
+        }
+        CommandLogReader reader(logBytes.data(), logBytes.size());
+        if (!reader.valid())
+        {
+            fprintf(stderr, "[SIM] %s is not a command log\n", input.c_str());
+            return 1;
+        }
+        sim.reset(new Simulator(nullptr, digestInterval, crc));
+        CommandLogEntry entry;
+        while (reader.next(entry))
+        {
+            TimedCommand cmd;
+            cmd.sampleIndex = entry.sampleIndex;
+            cmd.bytes.push_back(entry.cmd);
+            cmd.bytes.insert(cmd.bytes.end(), entry.payload, entry.payload + entry.length);
+            uint32_t seed = 0;
+            if (entry.cmd == CMD_START_STREAMING && entry.length >= 4)
+            {
+                seed = entry.payload[0] | (entry.payload[1] << 8) | (entry.payload[2] << 16) | (static_cast<uint32_t>(entry.payload[3]) << 24);
+            }
+            sim->apply(cmd, seed);
+        }
+    }
+    else
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const double elapsed = monotonicSec() - t0;
+    const std::vector<uint8_t> &stream = sim->stream();
+    fprintf(stderr, "[SIM] %llu samples, %zu stream bytes in %.3fs (%.0fx real time)\n",
+            static_cast<unsigned long long>(sim->samplesGenerated()), stream.size(), elapsed,
+            sim->samplesGenerated() / static_cast<double>(SAMPLE_RATE_HZ) / (elapsed > 0 ? elapsed : 1e-9));
+
+    int rc = 0;
+    if (!streamPath.empty() && !writeFile(streamPath, stream.data(), stream.size()))
+    {
+        rc = 1;
+    }
+    if (!verifyPath.empty())
+    {
+        std::vector<uint8_t> expected;
+        if (!readFile(verifyPath, expected))
+        {
+            rc = 1;
+        }
+        else
+        {
+            size_t i = 0;
+            while (i < expected.size() && i < stream.size() && expected[i] == stream[i])
+            {
+                i++;
+            }
+            if (i == expected.size() && i == stream.size())
+            {
+                fprintf(stderr, "[SIM] verify OK: %zu bytes identical\n", i);
+            }
+            else
+            {
+                fprintf(stderr, "[SIM] verify FAILED: first difference at byte %zu (expected %zu bytes, got %zu)\n", i, expected.size(), stream.size());
+                rc = 1;
+            }
+        }
+    }
+    return rc;
+}
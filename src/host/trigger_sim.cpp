@@ -0,0 +1,327 @@
+// ホスト版トリガー入力: 外部トリガーのエッジをファームウェアと同じ経路でサンプル位置に載せる
+//
+//   trigger_sim --edges FILE [--seconds N] [--log OUT.ecl] [--stream OUT.bin]
+//       エッジ時刻 (行ごとに "<秒> [value]"、セッション開始からの時刻) をサンプルクロックに直して注入する。
+//       時間はシミュレーションなので、同じファイルからは常に同じストリームになる。
+//   trigger_sim --udp PORT [--seconds N] [--log OUT.ecl] [--stream OUT.bin]
+//       サンプルクロックを実時間で回し、データグラムが届いた時刻をエッジとする (1 バイト目があれば value)。
+//       例: echo -n $'\x01' | nc -u -w0 127.0.0.1 PORT
+//
+// どちらも割り込み側 (stampTriggerEdge → TriggerEdgeQueue) とメインループ側 (popDue → CMD_TRIGGER_PULSE) を
+// ファームウェアと同じコード (eeg_trigger_input.h) で通す。ログは stream_sim replay でビット単位で再生できる。
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "eeg_command_log.h"
+#include "eeg_host_clock.h"
+#include "eeg_protocol.h"
+#include "eeg_random.h"
+#include "eeg_stream_engine.h"
+#include "eeg_trigger_input.h"
+
+namespace
+{
+
+constexpr size_t HOST_COMMAND_LOG_BYTES = 1u << 20;
+constexpr double SAMPLE_PERIOD_SEC = 1.0 / SAMPLE_RATE_HZ;
+
+struct EdgeTime
+{
+    double seconds;
+    uint8_t value;
+};
+
+struct SimOptions
+{
+    std::string edgesPath;
+    uint16_t udpPort = 0;
+    double seconds = 0.0; // 0 = ファイルなら最後のエッジ + 1 秒、UDP なら Ctrl-C まで
+    std::string logPath;
+    std::string streamPath;
+};
+
+bool writeFile(const std::string &path, const uint8_t *data, size_t size)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr || fwrite(data, 1, size, fp) != size)
+    {
+        perror(path.c_str());
+        if (fp != nullptr)
+        {
+            fclose(fp);
+        }
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+bool parseEdges(const std::string &path, std::vector<EdgeTime> &edges)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp == nullptr)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fp) != nullptr)
+    {
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if (hash != nullptr)
+        {
+            *hash = '\0';
+        }
+        char *save = nullptr;
+        char *tok = strtok_r(line, " \t\r\n", &save);
+        if (tok == nullptr)
+        {
+            continue;
+        }
+        EdgeTime edge;
+        edge.seconds = strtod(tok, nullptr);
+        tok = strtok_r(nullptr, " \t\r\n", &save);
+        edge.value = tok != nullptr ? static_cast<uint8_t>(strtoul(tok, nullptr, 10)) : 1;
+        if (edge.seconds < 0.0)
+        {
+            fprintf(stderr, "%s:%d: negative edge time\n", path.c_str(), lineNo);
+            fclose(fp);
+            return false;
+        }
+        edges.push_back(edge);
+    }
+    fclose(fp);
+    std::stable_sort(edges.begin(), edges.end(), [](const EdgeTime &a, const EdgeTime &b) { return a.seconds < b.seconds; });
+    return true;
+}
+
+void appendPacket(std::vector<uint8_t> &stream, const void *packet, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(packet);
+    stream.insert(stream.end(), p, p + size);
+}
+
+// サンプル tick k は (k + 1) x 周期 の時刻に来る (ファームウェアのタイマーと同じく、開始から 1 周期後が最初)。
+// エッジの時刻からは、それまでの tick 数と直前の tick からの位相を求めて stamp する
+class TriggerSim
+{
+public:
+    explicit TriggerSim(CommandLog *log) : engine_(log)
+    {
+        // ファームウェアの最初のセッションと同じ seed
+        engine_.startSession(static_cast<uint32_t>(splitmix64(1)));
+        DeviceConfigPacket cfg;
+        engine_.fillConfigPacket(cfg, false);
+        appendPacket(stream_, &cfg, sizeof(cfg));
+        queue_.clear();
+    }
+
+    // 割り込み側: 時刻 seconds (セッション開始から) のエッジ
+    void edge(double seconds, uint8_t value)
+    {
+        const double position = seconds / SAMPLE_PERIOD_SEC;
+        const double ticks = std::floor(position);
+        const uint32_t phase = static_cast<uint32_t>(std::min((position - ticks) * 4294967296.0, 4294967295.0));
+        if (queue_.push(stampTriggerEdge(static_cast<uint32_t>(ticks), phase, value & 0x0F)))
+        {
+            pendingTimes_.push_back(seconds);
+        }
+    }
+
+    // メインループ側: 次の tick のサンプルを生成する
+    void tick()
+    {
+        TriggerEdge due;
+        while (queue_.popDue(tick_, due))
+        {
+            uint8_t bytes[3];
+            engine_.applyCommand(bytes, triggerEdgeCommand(due, bytes));
+            const double seconds = pendingTimes_.front();
+            pendingTimes_.erase(pendingTimes_.begin());
+            // 印を付けたサンプルとの位置関係から戻したエッジ時刻と、元の時刻の差
+            const double restored = (tick_ + due.phase / 256.0) * SAMPLE_PERIOD_SEC;
+            const double errorUs = (restored - seconds) * 1e6;
+            maxErrorUs_ = std::max(maxErrorUs_, std::fabs(errorUs));
+            edges_++;
+            printf("[TRG] edge %.6fs value=%u -> sample %u (+%u/256 after the previous sample, error %+.1f us, %u ticks late)\n", seconds,
+                   due.value, engine_.sampleIndex(), due.phase, errorUs, tick_ - due.tick);
+        }
+        if (engine_.step())
+        {
+            appendPacket(stream_, &engine_.packet(), sizeof(ChunkedSamplePacket));
+        }
+        tick_++;
+    }
+
+    // tick k が来る時刻 (セッション開始から)
+    double nextTickSec() const { return (tick_ + 1) * SAMPLE_PERIOD_SEC; }
+
+    void finish()
+    {
+        engine_.stopSession();
+    }
+
+    const std::vector<uint8_t> &stream() const { return stream_; }
+    uint32_t samples() const { return tick_; }
+    uint32_t edges() const { return edges_; }
+    const TriggerEdgeQueue &queue() const { return queue_; }
+    double maxErrorUs() const { return maxErrorUs_; }
+
+private:
+    DummyStreamEngine engine_;
+    TriggerEdgeQueue queue_;
+    std::vector<double> pendingTimes_; // キューに入っているエッジの元の時刻 (報告用)
+    std::vector<uint8_t> stream_;
+    uint32_t tick_ = 0;
+    uint32_t edges_ = 0;
+    double maxErrorUs_ = 0.0;
+};
+
+// エッジの後に来る tick の前に stamp するので、tick と同時刻のエッジはその tick のサンプルより後になる
+void runFromFile(TriggerSim &sim, const std::vector<EdgeTime> &edges, double seconds)
+{
+    size_t next = 0;
+    const uint32_t samples = static_cast<uint32_t>(seconds * SAMPLE_RATE_HZ);
+    while (sim.samples() < samples)
+    {
+        while (next < edges.size() && edges[next].seconds < sim.nextTickSec())
+        {
+            sim.edge(edges[next].seconds, edges[next].value);
+            next++;
+        }
+        sim.tick();
+    }
+}
+
+int runFromUdp(TriggerSim &sim, uint16_t port, double seconds)
+{
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        perror("udp");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    fprintf(stderr, "[TRG] Listening for edges on udp/%u\n", port);
+    const double t0 = monotonicSec();
+    while (seconds <= 0.0 || sim.samples() < seconds * SAMPLE_RATE_HZ)
+    {
+        // 次の tick までデータグラムを待つ。届いた時刻がエッジ
+        const double waitSec = sim.nextTickSec() - (monotonicSec() - t0);
+        pollfd pfd = {fd, POLLIN, 0};
+        if (waitSec > 0.0 && poll(&pfd, 1, static_cast<int>(std::ceil(waitSec * 1000.0))) > 0)
+        {
+            uint8_t buf[64];
+            const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            const double at = monotonicSec() - t0;
+            if (n >= 0)
+            {
+                sim.edge(at, n >= 1 ? buf[0] : 1);
+            }
+            continue;
+        }
+        // 遅れた分はまとめて追いつく (ファームウェアの未処理 tick と同じ)
+        while (sim.nextTickSec() <= monotonicSec() - t0)
+        {
+            sim.tick();
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s --edges FILE [--seconds N] [--log OUT.ecl] [--stream OUT.bin]\n"
+            "  %s --udp PORT [--seconds N] [--log OUT.ecl] [--stream OUT.bin]\n"
+            "FILE: one edge per line, \"<seconds from session start> [value 1..15]\"\n",
+            argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    SimOptions opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--edges")
+            opt.edgesPath = argv[i + 1];
+        else if (arg == "--udp")
+            opt.udpPort = static_cast<uint16_t>(strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--seconds")
+            opt.seconds = strtod(argv[i + 1], nullptr);
+        else if (arg == "--log")
+            opt.logPath = argv[i + 1];
+        else if (arg == "--stream")
+            opt.streamPath = argv[i + 1];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.edgesPath.empty() == (opt.udpPort == 0))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> logStorage(HOST_COMMAND_LOG_BYTES);
+    CommandLog log(logStorage.data(), logStorage.size());
+    TriggerSim sim(&log);
+
+    if (!opt.edgesPath.empty())
+    {
+        std::vector<EdgeTime> edges;
+        if (!parseEdges(opt.edgesPath, edges))
+        {
+            return 1;
+        }
+        const double seconds = opt.seconds > 0.0 ? opt.seconds : (edges.empty() ? 1.0 : edges.back().seconds + 1.0);
+        runFromFile(sim, edges, seconds);
+    }
+    else if (runFromUdp(sim, opt.udpPort, opt.seconds) != 0)
+    {
+        return 1;
+    }
+    sim.finish();
+
+    fprintf(stderr, "[TRG] %u samples, %u edges injected (max timing error %.1f us), %u bounced, %u dropped (queue full)\n", sim.samples(),
+            sim.edges(), sim.maxErrorUs(), sim.queue().bounced(), sim.queue().overflowed());
+
+    int rc = 0;
+    if (!opt.logPath.empty() && (log.overflowed() || !writeFile(opt.logPath, log.data(), log.size())))
+    {
+        rc = 1;
+    }
+    if (!opt.streamPath.empty() && !writeFile(opt.streamPath, sim.stream().data(), sim.stream().size()))
+    {
+        rc = 1;
+    }
+    return rc;
+}
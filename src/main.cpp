@@ -6,66 +6,30 @@
 #include <esp_err.h>
 #include <string.h>
 #include <math.h>
-#include "p300_waveform_data.h"
 #include <algorithm>
+#include "eeg_band_power.h"
+#include "eeg_biquad.h"
+#include "eeg_chunk_backlog.h"
+#include "eeg_clock_model.h"
+#include "eeg_command_log.h"
+#include "eeg_crc.h"
+#include "eeg_deadline_monitor.h"
+#include "eeg_erp.h"
+#include "eeg_preview.h"
+#include "eeg_protocol.h"
+#include "eeg_signal_generator.h"
+#include "eeg_spectrum.h"
+#include "eeg_stream_engine.h"
+#include "eeg_trigger_input.h"
 
 // ========= ADS1299 実装と互換の設定 =========
 #define DEVICE_NAME "ADS1299_EEG_NUS"
-#define CH_MAX 8
-#define SAMPLE_RATE_HZ 250
-#define SAMPLES_PER_CHUNK 25 // 250SPS / 10Hz = 25
 
 // ========= BLE (NUS-like) UUIDs (ADS1299 実装と同一) =========
 #define SERVICE_UUID "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
 #define CHARACTERISTIC_UUID_TX "6E400003-B5A3-F393-E0A9-E50E24DCCA9E" // Notify
 #define CHARACTERISTIC_UUID_RX "6E400002-B5A3-F393-E0A9-E50E24DCCA9E" // Write
 
-// ========= パケット種別 (ADS1299 実装と同一) =========
-#define PKT_TYPE_DATA_CHUNK 0x66
-#define PKT_TYPE_DEVICE_CFG 0xDD
-
-// ========= 制御コマンド (ADS1299 実装と同一) =========
-#define CMD_START_STREAMING 0xAA
-#define CMD_STOP_STREAMING 0x5B
-#define CMD_TRIGGER_PULSE 0xC1
-
-// ========= データ構造 (ADS1299 実装と同一) =========
-struct __attribute__((packed)) ElectrodeConfig
-{
-    char name[8];
-    uint8_t type;
-    uint8_t reserved;
-};
-
-// IMU なし、符号付き 16bit 信号に修正
-struct __attribute__((packed)) SampleData
-{
-    int16_t signals[CH_MAX]; // 符号付き 16bit, little-endian
-    uint8_t trigger_state;   // GPIO 下位 4bit を模倣 (0..15)
-    uint8_t reserved[3];     // 予約領域
-};
-
-struct __attribute__((packed)) ChunkedSamplePacket
-{
-    uint8_t packet_type;  // 0x66
-    uint16_t start_index; // LE
-    uint8_t num_samples;  // 25
-    SampleData samples[SAMPLES_PER_CHUNK];
-};
-
-struct __attribute__((packed)) DeviceConfigPacket
-{
-    uint8_t packet_type;  // 0xDD
-    uint8_t num_channels; // 実使用 ch 数（今回は 8ch 固定のダミー）
-    uint8_t reserved[6];
-    ElectrodeConfig configs[CH_MAX];
-};
-
-static_assert(sizeof(SampleData) == 20, "SampleData must be 20 bytes");
-static_assert(sizeof(ChunkedSamplePacket) <= 512, "Chunk packet exceeds BLE payload expectations");
-
-constexpr size_t SAMPLE_DATA_BYTES = sizeof(SampleData);
-constexpr size_t CHUNK_HEADER_BYTES = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t);
 constexpr uint16_t DEFAULT_ATT_MTU = 23;
 constexpr uint16_t REQUIRED_MTU_BYTES = static_cast<uint16_t>(sizeof(ChunkedSamplePacket) + 3);
 
@@ -82,89 +46,320 @@ volatile bool mtuReady = false;
 volatile bool streamStartRequested = false;
 
 // 送信パケットをグローバルに確保 (スタックオーバーフロー防止)
-ChunkedSamplePacket chunkPacket;
 DeviceConfigPacket deviceConfigPacket;
 
 // BLE コールバックからメインループへ処理を依頼するためのフラグ
 volatile bool g_send_config_packet = false;
 
+// パケット CRC トレーラ (CMD_SET_PACKET_CRC)。切り替えは次の設定パケット送信時
+constexpr size_t MAX_TX_PACKET_BYTES = (sizeof(ChunkedSamplePacket) > sizeof(DeviceConfigPacket) ? sizeof(ChunkedSamplePacket) : sizeof(DeviceConfigPacket)) + PACKET_CRC_BYTES;
+volatile bool packetCrcRequested = false;
+bool packetCrcEnabled = false;
+uint8_t txPacketBuffer[MAX_TX_PACKET_BYTES];
+
 // サンプリング用タイマー
+// タイマーはサンプルレートの TIMEBASE_OVERSAMPLE 倍で回し、Q32 の位相アキュムレータが
+// 整数を跨いだ tick でサンプルを 1 つ生成する。増分を変えればクロックのずれを ppb 単位で再現できる。
+constexpr uint32_t TIMEBASE_OVERSAMPLE = 16; // 250Hz x 16 = 4kHz (ジッタ <= 250us)
+constexpr uint32_t MAX_PENDING_SAMPLE_TICKS = SAMPLES_PER_CHUNK;
 hw_timer_t *timer = nullptr;
 portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;
-volatile bool sampleReady = false;
-
-// データバッファとカウンタ
-SampleData sampleBuffer[SAMPLES_PER_CHUNK];
-volatile int sampleBufferIndex = 0;
-uint16_t sampleIndexCounter = 0;
-
-// ========= P300 波形再生用の状態 =========
-constexpr float ADS1299_VREF = 4.5f;
-constexpr float ADS1299_GAIN = 24.0f;
-constexpr float ADC_MAX_COUNTS = 32768.0f;                                                     // using 16-bit signed dummy output
-constexpr float MICROVOLT_PER_COUNT = (ADS1299_VREF / ADS1299_GAIN) / ADC_MAX_COUNTS * 1.0e6f; // ≈5.72µV
-constexpr float MICROVOLT_TO_COUNT = 1.0f / MICROVOLT_PER_COUNT;
-constexpr size_t TRIGGER_PULSE_WIDTH_SAMPLES = 6; // ≒24ms
-constexpr float BACKGROUND_NOISE_UV = 1.2f;
-constexpr float TARGET_EVENT_SCALE = 1.0f;
-constexpr float NONTARGET_EVENT_SCALE = 0.10f;
-constexpr float DEFAULT_EVENT_SCALE = 0.05f;
-constexpr float CHANNEL_GAIN[CH_MAX] = {1.0f, 0.65f, 0.55f, 0.5f, 0.45f, 0.4f, 0.35f, 0.3f};
-constexpr float CHANNEL_PHASE[CH_MAX] = {0.0f, 0.7f, 1.4f, 2.1f, 0.5f, 1.2f, 1.9f, 2.6f};
-constexpr float ALPHA_FREQ_HZ = 10.0f;
-constexpr float BETA_FREQ_HZ = 20.0f;
-constexpr float ALPHA_AMPLITUDE_UV = 8.0f;
-constexpr float BETA_AMPLITUDE_UV = 3.0f;
+volatile uint32_t timebaseIncrement = static_cast<uint32_t>((1ULL << 32) / TIMEBASE_OVERSAMPLE);
+uint32_t timebasePhase = 0;               // ISR 専用
+volatile uint32_t pendingSampleTicks = 0; // timerMux 保護
+volatile uint32_t queuedSampleTicks = 0;  // timerMux 保護: 起動から積んだ tick 数 (取りこぼした分は数えない)
+uint32_t consumedSampleTicks = 0;         // メインループ: 取り出した (捨てた分を含む) tick 数 = 次のサンプルの tick 番号
+constexpr uint32_t TIMER_ALARM_US = 1000000 / (SAMPLE_RATE_HZ * TIMEBASE_OVERSAMPLE);
+
+// 起動時間の計測。micros() はアプリの起動 (ブートローダの後) からの時間
+struct BootPhase
+{
+    const char *name;
+    uint32_t endMicros;
+};
+constexpr size_t MAX_BOOT_PHASES = 8;
+BootPhase bootPhases[MAX_BOOT_PHASES];
+size_t bootPhaseCount = 0;
+volatile uint32_t bootFirstConnectMicros = 0; // 0 = まだ
+volatile uint32_t bootFirstStartMicros = 0;
+bool bootReportSent = false;
+
+// 開始直後の最初のチャンクは待たずに先に作っておく (prefill)。タイマーの tick を待つと START から
+// 最初のデータまで 1 チャンク周期 (100ms) かかるので、最初のチャンクだけ一気に生成し、その分時間軸を過去へずらす。
+// 通知がまだ有効でなければ作ったチャンクを持ったまま待ち、有効になったら設定パケットと続けて送る。
+bool prefillRequested = false;
+bool prefillReady = false; // streamEngine.packet() が未送信の先行チャンク
+uint32_t streamStartMicros = 0;
+uint32_t prefillMicros = 0;
+size_t prefillSamples = 0;
+
+// デッドライン監視。チャンクごとに生成と特徴量計算にかかったサイクル数と tick の遅れを見て、
+// 間に合わなくなりそうなら任意の処理を順に止める (eeg_deadline_monitor.h)
+DeadlineMonitor deadline;
+volatile uint32_t lostSampleTicks = 0; // ISR: 未処理 tick が上限に達して捨てた数
+uint32_t lostTicksAtBlockStart = 0;
+uint32_t blockBusyCycles = 0;
+uint32_t sampleNotifyCycles = 0; // generateSample 中の notify にかかった分 (予算から除く)
+uint32_t blockMaxLag = 0;
+bool analysisSuspended = false;
+bool degradeReportPending = false;
+
+// クロックずれのエミュレーション (メインループで 1 秒ごとに増分を更新)
+ClockDriftModel clockModel(1);
+ClockProfile pendingClockProfile;
+volatile bool g_apply_clock_profile = false;
+float currentClockPpm = 0.0f;
+uint32_t totalSamplesGenerated = 0;
+
+// テレメトリ
+DeviceTelemetryPacket telemetryPacket;
+volatile uint8_t telemetryIntervalChunks = 0; // 0 = 無効
+uint8_t chunksSinceTelemetry = 0;
+uint32_t lastTelemetryMicros = 0;
+uint32_t lastTelemetrySamples = 0;
+
+// ストリームダイジェスト (N チャンクごとのチェックポイント)
+StreamDigestPacket digestPacket;
+volatile uint8_t digestIntervalChunks = 0; // 0 = 無効
+
+// 間引きプレビュー (CMD_SET_PREVIEW)。設定は BLE コールバックで受け、メインループで反映する
+PreviewDecimator previewDecimator;
+PreviewPacketizer previewPacketizer;
+uint8_t pendingPreviewConfig[3] = {0, 0, 0}; // [factor][channel_mask][flags], eventMux 保護
+volatile bool g_apply_preview_config = false;
+bool previewOnly = false;
+
+// 帯域パワー特徴量 (CMD_SET_BAND_POWER)。プレビューと同じくメインループで反映する
+BandPowerEstimator bandPower;
+uint8_t pendingBandPowerConfig[3 + BAND_POWER_MAX_BANDS * 2] = {}; // [rate][channel_mask][flags][lo hi]..., eventMux 保護
+uint8_t pendingBandPowerLength = 0;
+volatile bool g_apply_band_power_config = false;
+bool bandPowerOnly = false;
+
+// 対数振幅スペクトル (CMD_SET_SPECTRUM)。最初のブロックにかかったサイクル数をログに出す
+SpectrumAnalyzer spectrum;
+uint8_t pendingSpectrumConfig[5] = {}; // [fft_log2][channel_mask][overlap][max_hz][flags], eventMux 保護
+volatile bool g_apply_spectrum_config = false;
+bool spectrumOnly = false;
+uint32_t spectrumBlockCycles = 0;
+size_t spectrumChannelsTimed = 0;
+
+// トリガー同期の加算平均 (CMD_SET_ERP)
+ErpAverager erpAverager;
+uint8_t pendingErpConfig[7] = {}; // [pre_ms LE16][post_ms LE16][report_s][channel_mask][flags], eventMux 保護
+volatile bool g_apply_erp_config = false;
+bool erpOnly = false;
+
+// 切断中の store-and-forward (CMD_SET_STORE_FORWARD)。有効なら切断してもセッションを保持して生成を続け、
+// チャンクを PSRAM のリングに貯める。次の START で同じセッションを再開し、貯めた分から順に追送する (ライブはその後ろに並ぶ)
+constexpr size_t STORE_FORWARD_INTERNAL_MAX_CHUNKS = 100; // PSRAM がないときの上限 (10 秒, 約 50KB)
+// start_index (16 ビット) は 262 秒で一周する。受信側が再開前との前後を判別できるよう、貯めるのは半周未満に抑える
+constexpr uint16_t STORE_FORWARD_MAX_SECONDS = 120;
+ChunkBacklog backlog;
+uint16_t storeForwardSeconds = 0;
+volatile uint16_t pendingStoreForwardSeconds = 0;
+volatile bool g_apply_store_forward = false;
+volatile bool storeForwardHolding = false; // 切断中でセッションを保持している
+bool backlogDrainLogged = true;
+
+// 外部トリガー入力 (CMD_SET_TRIGGER_INPUT)。エッジ割り込みでサンプルクロック上の位置を記録し、
+// そのサンプルを生成する直前に CMD_TRIGGER_PULSE としてエンジンに通す (eeg_trigger_input.h)
+constexpr uint8_t TRIGGER_INPUT_PIN = 2; // XIAO ESP32S3 の D1
+portMUX_TYPE triggerMux = portMUX_INITIALIZER_UNLOCKED;
+TriggerEdgeQueue triggerEdges; // triggerMux 保護
+volatile uint8_t triggerInputValue = 1;
+uint8_t triggerInputEdge = 0; // 0 = 無効
+volatile uint8_t pendingTriggerInput[2] = {}; // [edge][value]
+volatile bool g_apply_trigger_input = false;
+
+// 信号生成とチャンク化 (メインループからのみ触る)
+constexpr size_t COMMAND_LOG_BYTES = 4096;
+uint8_t commandLogStorage[COMMAND_LOG_BYTES];
+CommandLog commandLog(commandLogStorage, COMMAND_LOG_BYTES);
+DummyStreamEngine streamEngine(&commandLog);
+uint32_t sessionCounter = 0;
+
+// セッションの再開 (CMD_RESUME_STREAMING)。切断で止まったセッションは STOP か次の START まで残り、
+// トークンが一致すれば設定パケットもリセットもなしで同じインデックスの続きから送る
+volatile uint32_t sessionToken = 0;   // 今のセッションのトークン (= seed)
+volatile bool sessionPaused = false;  // 切断で一時停止中 (store-and-forward なし)
+volatile bool resumeRequested = false;
+volatile uint32_t pendingResumeToken = 0;
+volatile uint16_t resumeLastIndex = 0; // ホストが最後に受け取ったチャンクの start_index
+volatile bool g_trim_backlog = false;
+
+// コマンドログのダンプ要求 (bit0: 送信後にクリア)
+volatile bool g_dump_command_log = false;
+volatile bool g_clear_command_log_after_dump = false;
+
+// ========= 刺激コマンドのキュー =========
+// BLE コールバックは生成器を直接触らず、コマンドをここに積む。
+// メインループが次のサンプル生成の直前にまとめて適用する。
+struct StimulusCommand
+{
+    uint8_t length;
+    uint8_t bytes[7];
+};
+
+constexpr size_t STIM_COMMAND_QUEUE_LEN = 16;
 
 portMUX_TYPE eventMux = portMUX_INITIALIZER_UNLOCKED;
-bool p300Active = false;
-size_t p300Cursor = 0;
-uint8_t currentTriggerValue = 0;
-size_t triggerSamplesRemaining = 0;
+StimulusCommand stimCommandQueue[STIM_COMMAND_QUEUE_LEN];
+size_t stimCommandHead = 0;
+size_t stimCommandCount = 0;
+bool stimResetRequested = false;
 
 static void startStreamingNow();
 static void handleStartStreamingRequest();
 static void handleStopStreaming();
+static void applyDegradeLevel(uint8_t level);
+static bool generateSample(uint32_t lag);
+static void prefillFirstChunk();
+static void discardPendingSampleTicks();
+void IRAM_ATTR onTriggerEdge();
+static void sendReadyChunk(bool streamingNow);
 
-static float randomUniform()
+static void resetStimulusPlayback()
 {
-    return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    portENTER_CRITICAL(&eventMux);
+    stimCommandCount = 0;
+    stimResetRequested = true;
+    portEXIT_CRITICAL(&eventMux);
 }
 
-static float sampleNoiseUv(float amplitudeUv)
+static void enqueueStimulusCommand(const std::string &v)
 {
-    const float centered = randomUniform() * 2.0f - 1.0f;
-    return centered * amplitudeUv;
+    StimulusCommand command;
+    command.length = static_cast<uint8_t>(std::min(v.size(), sizeof(command.bytes)));
+    memcpy(command.bytes, v.data(), command.length);
+
+    bool queued = false;
+    portENTER_CRITICAL(&eventMux);
+    if (stimCommandCount < STIM_COMMAND_QUEUE_LEN)
+    {
+        stimCommandQueue[(stimCommandHead + stimCommandCount) % STIM_COMMAND_QUEUE_LEN] = command;
+        stimCommandCount++;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&eventMux);
+    if (!queued)
+    {
+        Serial.printf("[CMD] Stimulus queue full. Dropped cmd=0x%02X\n", command.bytes[0]);
+    }
 }
 
-static int16_t microvoltToCounts(float microvolt)
+// フィルタのサンプルあたりサイクル数を測る (設定を受理したときに 1 回だけ)。
+// 同じ設定のコピーに 1 秒分のサンプルを通すので、本物の状態は汚さない
+static uint32_t measureFilterCyclesPerSample(const BiquadChain &filter)
 {
-    const float raw = microvolt * MICROVOLT_TO_COUNT;
-    const float clamped = std::max(-32768.0f, std::min(32767.0f, raw));
-    return static_cast<int16_t>(::lrintf(clamped));
+    constexpr uint32_t BENCH_SAMPLES = SAMPLE_RATE_HZ;
+    BiquadChain bench = filter;
+    int16_t signals[CH_MAX];
+    const uint32_t start = ESP.getCycleCount();
+    for (uint32_t n = 0; n < BENCH_SAMPLES; ++n)
+    {
+        for (size_t ch = 0; ch < CH_MAX; ++ch)
+        {
+            signals[ch] = static_cast<int16_t>((n * 97u + ch * 1013u) & 0x3FFF) - 0x2000;
+        }
+        bench.process(signals);
+    }
+    return (ESP.getCycleCount() - start) / BENCH_SAMPLES;
 }
 
-static float eventAmplitudeScale(uint8_t triggerValue)
+static void applyStimulusCommand(const StimulusCommand &command)
 {
-    if (triggerValue == 1)
+    const uint8_t cmd = command.bytes[0];
+    const bool accepted = streamEngine.applyCommand(command.bytes, command.length);
+    const uint32_t at = streamEngine.sampleIndex();
+    if (cmd == CMD_TRIGGER_PULSE)
     {
-        return TARGET_EVENT_SCALE;
+        if (command.length >= 2)
+        {
+            Serial.printf("[CMD] Trigger pulse requested. value=%u (sample %u)\n", command.bytes[1], at);
+        }
+        else
+        {
+            Serial.printf("[CMD] Trigger pulse requested without value. Default=1 (sample %u)\n", at);
+        }
     }
-    if (triggerValue == 2)
+    else if (cmd == CMD_SET_STIM_MODE)
     {
-        return NONTARGET_EVENT_SCALE;
+        const bool ssvep = streamEngine.generator().stimulusMode() == STIM_MODE_SSVEP;
+        Serial.printf("[CMD] Stimulus mode=%s (sample %u)\n", ssvep ? "SSVEP" : "P300", at);
+    }
+    else if (cmd == CMD_SSVEP_CONFIG)
+    {
+        if (!accepted)
+        {
+            Serial.println("[CMD] SSVEP config rejected.");
+            return;
+        }
+        const SsvepTagConfig &cfg = streamEngine.generator().ssvepTag(command.bytes[1]);
+        Serial.printf("[CMD] SSVEP tag %u: %.2fHz x%u, %u samples\n", command.bytes[1], cfg.freqHz, cfg.harmonics, cfg.durationSamples);
+    }
+    else if (cmd == CMD_SET_FILTER)
+    {
+        if (!accepted)
+        {
+            Serial.println("[FLT] Filter config rejected (cutoff at or above Nyquist or short payload).");
+            return;
+        }
+        const BiquadChain &filter = streamEngine.filter();
+        const FilterSpec &spec = filter.spec();
+        Serial.printf("[FLT] notch=%uHz x%u hp=%.2fHz lp=%uHz -> %u stages (sample %u)\n", spec.notchHz, spec.notchHarmonics,
+                      spec.highpassCentiHz / 100.0f, spec.lowpassHz, static_cast<unsigned>(filter.stages()), at);
+        if (filter.enabled())
+        {
+            // 1 サンプル (全チャンネル) あたりのサイクルから、CPU を使い切った場合のサンプルレート上限を出す
+            const uint32_t cycles = measureFilterCyclesPerSample(filter);
+            const uint32_t hz = ESP.getCpuFreqMHz() * 1000000u;
+            Serial.printf("[FLT] %u stages x %u ch = %u cycles/sample (%.3f%% CPU at %uHz, %.1f cycles/stage/ch, ceiling %u SPS)\n",
+                          static_cast<unsigned>(filter.stages()), CH_MAX, cycles, 100.0 * cycles * SAMPLE_RATE_HZ / hz,
+                          SAMPLE_RATE_HZ, static_cast<double>(cycles) / (filter.stages() * CH_MAX), cycles > 0 ? hz / cycles : 0);
+        }
     }
-    return DEFAULT_EVENT_SCALE;
 }
 
-static void resetStimulusPlayback()
+// サンプル生成の直前に呼ぶ。キューの取り出しだけを臨界区間で行う。
+static void applyPendingStimulusCommands()
 {
+    StimulusCommand pending[STIM_COMMAND_QUEUE_LEN];
+    size_t count = 0;
+    bool doReset = false;
+
     portENTER_CRITICAL(&eventMux);
-    p300Active = false;
-    p300Cursor = 0;
-    currentTriggerValue = 0;
-    triggerSamplesRemaining = 0;
+    doReset = stimResetRequested;
+    stimResetRequested = false;
+    for (; count < stimCommandCount; ++count)
+    {
+        pending[count] = stimCommandQueue[(stimCommandHead + count) % STIM_COMMAND_QUEUE_LEN];
+    }
+    stimCommandHead = (stimCommandHead + count) % STIM_COMMAND_QUEUE_LEN;
+    stimCommandCount = 0;
     portEXIT_CRITICAL(&eventMux);
+
+    if (doReset)
+    {
+        // セッションごとに seed を変え、START レコードに残す
+        sessionCounter++;
+        streamEngine.startSession(static_cast<uint32_t>(splitmix64(sessionCounter)));
+        sessionToken = streamEngine.sessionSeed();
+        backlog.clear();
+        if (deadline.level() != DEGRADE_NONE)
+        {
+            applyDegradeLevel(deadline.level()); // 生成器は作り直しになるので段階を掛け直す
+        }
+        previewDecimator.reset();
+        previewPacketizer.reset(previewDecimator);
+        bandPower.reset();
+        spectrum.reset();
+        erpAverager.reset();
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        applyStimulusCommand(pending[i]);
+    }
 }
 
 static void startStreamingNow()
@@ -173,12 +368,50 @@ static void startStreamingNow()
     {
         return;
     }
+    if (bootFirstStartMicros == 0)
+    {
+        bootFirstStartMicros = micros();
+    }
+    prefillRequested = false;
+    prefillReady = false;
+    const bool resume = resumeRequested;
+    const bool held = storeForwardHolding;
+    const bool kept = held || sessionPaused;
+    resumeRequested = false;
+    storeForwardHolding = false;
+    sessionPaused = false;
     isStreaming = true;
     streamStartRequested = false;
-    sampleIndexCounter = 0;
-    sampleBufferIndex = 0;
-    resetStimulusPlayback();
+
+    // 再開: 設定は変わっていないので設定パケットは送らない (CRC トレーラが新しい MTU に収まらないときだけ送り直す)
+    const bool crcFits = !packetCrcEnabled || negotiatedMtu >= REQUIRED_MTU_BYTES + PACKET_CRC_BYTES;
+    if (resume && kept && sessionToken != 0 && pendingResumeToken == sessionToken && crcFits)
+    {
+        g_trim_backlog = true;
+        Serial.printf("[CMD] Session %08X resumed after index %u (MTU=%u, backlog %u chunks)\n", static_cast<unsigned>(sessionToken),
+                      resumeLastIndex, negotiatedMtu, static_cast<unsigned>(backlog.size()));
+        return;
+    }
+    if (held && !resume)
+    {
+        if (crcFits)
+        {
+            // 切断中も続けていたセッションをそのまま再開する (貯めたチャンクはメインループが追送する)。
+            // 設定パケットは受信側の連続性チェックとダイジェストを初期化してしまうので送らない
+            Serial.printf("[SNF] Session resumed (MTU=%u, backlog %u chunks)\n", negotiatedMtu, static_cast<unsigned>(backlog.size()));
+            return;
+        }
+        Serial.printf("[SNF] CRC trailer does not fit MTU=%u. Starting a new session.\n", negotiatedMtu);
+    }
     g_send_config_packet = true;
+    if (resume)
+    {
+        Serial.printf("[CMD] Resume token %08X does not match a paused session. Starting a new one.\n",
+                      static_cast<unsigned>(pendingResumeToken));
+    }
+    resetStimulusPlayback();
+    prefillRequested = true;
+    streamStartMicros = micros();
     Serial.printf("[CMD] Streaming started (MTU=%u)\n", negotiatedMtu);
 }
 
@@ -196,23 +429,281 @@ static void handleStartStreamingRequest()
     }
 }
 
+// [token LE32][last_start_index LE16]。MTU が揃っていなければ onMtuChanged から続ける
+static void handleResumeRequest(const std::string &v)
+{
+    if (v.size() >= 7)
+    {
+        pendingResumeToken = static_cast<uint32_t>(static_cast<uint8_t>(v[1])) | (static_cast<uint32_t>(static_cast<uint8_t>(v[2])) << 8) |
+                             (static_cast<uint32_t>(static_cast<uint8_t>(v[3])) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(v[4])) << 24);
+        resumeLastIndex = static_cast<uint16_t>(static_cast<uint8_t>(v[5]) | (static_cast<uint8_t>(v[6]) << 8));
+        resumeRequested = true;
+    }
+    else
+    {
+        Serial.println("[CMD] Resume too short. Treated as START.");
+    }
+    handleStartStreamingRequest();
+}
+
 static void handleStopStreaming()
 {
     isStreaming = false;
     streamStartRequested = false;
-    sampleBufferIndex = 0;
+    resumeRequested = false;
+    storeForwardHolding = false;
+    sessionPaused = false;
+    prefillRequested = false;
+    prefillReady = false;
     resetStimulusPlayback();
     Serial.println("[CMD] Stop streaming");
 }
 
-static void startStimulusEvent(uint8_t triggerValue)
+static uint32_t timebaseIncrementForPpm(float ppm)
+{
+    const double increment = static_cast<double>(1ULL << 32) / TIMEBASE_OVERSAMPLE * (1.0 + ppm * 1e-6);
+    return static_cast<uint32_t>(increment + 0.5);
+}
+
+static void handleClockProfileCommand(const std::string &v)
+{
+    if (v.size() < 7)
+    {
+        Serial.println("[CMD] Clock profile too short. Ignored.");
+        return;
+    }
+    const int16_t offsetCenti = static_cast<int16_t>(static_cast<uint8_t>(v[1]) | (static_cast<uint8_t>(v[2]) << 8));
+    const uint16_t wanderCenti = static_cast<uint8_t>(v[3]) | (static_cast<uint8_t>(v[4]) << 8);
+    const uint16_t tauSec = static_cast<uint8_t>(v[5]) | (static_cast<uint8_t>(v[6]) << 8);
+    portENTER_CRITICAL(&eventMux);
+    pendingClockProfile.offsetPpm = offsetCenti / 100.0f;
+    pendingClockProfile.wanderPpm = wanderCenti / 100.0f;
+    pendingClockProfile.wanderTauSec = tauSec;
+    portEXIT_CRITICAL(&eventMux);
+    g_apply_clock_profile = true;
+}
+
+// 1 秒ごと、またはプロファイル変更時に呼ぶ
+static void updateClockDrift(float dtSec)
+{
+    if (g_apply_clock_profile)
+    {
+        ClockProfile profile;
+        portENTER_CRITICAL(&eventMux);
+        profile = pendingClockProfile;
+        g_apply_clock_profile = false;
+        portEXIT_CRITICAL(&eventMux);
+        clockModel.configure(profile);
+        Serial.printf("[CLK] Profile offset=%.2fppm wander=%.2fppm tau=%.0fs\n", profile.offsetPpm, profile.wanderPpm, profile.wanderTauSec);
+    }
+    currentClockPpm = clockModel.update(dtSec);
+    timebaseIncrement = timebaseIncrementForPpm(currentClockPpm);
+}
+
+static void applyPreviewConfig()
+{
+    uint8_t config[sizeof(pendingPreviewConfig)];
+    portENTER_CRITICAL(&eventMux);
+    memcpy(config, pendingPreviewConfig, sizeof(config));
+    g_apply_preview_config = false;
+    portEXIT_CRITICAL(&eventMux);
+
+    if (config[0] == 0)
+    {
+        previewDecimator.disable();
+        previewOnly = false;
+        Serial.println("[CMD] Preview off");
+        return;
+    }
+    if (!previewDecimator.configure(config[0], config[1]))
+    {
+        previewOnly = false;
+        Serial.printf("[CMD] Preview config rejected (factor=%u mask=0x%02X)\n", config[0], config[1]);
+        return;
+    }
+    previewPacketizer.reset(previewDecimator);
+    previewOnly = (config[2] & PREVIEW_FLAG_ONLY) != 0;
+    Serial.printf("[CMD] Preview 1/%u on mask=0x%02X (%u ch)%s\n", config[0], config[1],
+                  static_cast<unsigned>(previewDecimator.channels()), previewOnly ? ", preview only" : "");
+}
+
+static void applyBandPowerConfig()
+{
+    uint8_t config[sizeof(pendingBandPowerConfig)];
+    uint8_t length;
+    portENTER_CRITICAL(&eventMux);
+    memcpy(config, pendingBandPowerConfig, sizeof(config));
+    length = pendingBandPowerLength;
+    g_apply_band_power_config = false;
+    portEXIT_CRITICAL(&eventMux);
+
+    if (config[0] == 0)
+    {
+        bandPower.disable();
+        bandPowerOnly = false;
+        Serial.println("[CMD] Band power off");
+        return;
+    }
+    BandEdges bands[BAND_POWER_MAX_BANDS];
+    const size_t bandCount = length > 3 ? (length - 3) / 2 : 0;
+    for (size_t b = 0; b < bandCount; ++b)
+    {
+        bands[b].loHz = config[3 + b * 2];
+        bands[b].hiHz = config[4 + b * 2];
+    }
+    if (!bandPower.configure(config[0], config[1], bands, bandCount))
+    {
+        bandPowerOnly = false;
+        Serial.printf("[CMD] Band power config rejected (rate=%u mask=0x%02X bands=%u)\n", config[0], config[1],
+                      static_cast<unsigned>(bandCount));
+        return;
+    }
+    bandPowerOnly = (config[2] & BAND_POWER_FLAG_ONLY) != 0;
+    Serial.printf("[CMD] Band power %uHz mask=0x%02X: %u bands, %u bins/ch, %u B/packet%s\n", config[0], config[1],
+                  static_cast<unsigned>(bandPower.bands()), static_cast<unsigned>(bandPower.bins()),
+                  static_cast<unsigned>(bandPower.packetSize()), bandPowerOnly ? ", features only" : "");
+}
+
+static void applySpectrumConfig()
+{
+    uint8_t config[sizeof(pendingSpectrumConfig)];
+    portENTER_CRITICAL(&eventMux);
+    memcpy(config, pendingSpectrumConfig, sizeof(config));
+    g_apply_spectrum_config = false;
+    portEXIT_CRITICAL(&eventMux);
+
+    if (config[0] == 0)
+    {
+        spectrum.disable();
+        spectrumOnly = false;
+        Serial.println("[CMD] Spectrum off");
+        return;
+    }
+    if (!spectrum.configure(config[0], config[1], config[2], config[3]))
+    {
+        spectrumOnly = false;
+        Serial.printf("[CMD] Spectrum config rejected (log2=%u mask=0x%02X overlap=%u max=%uHz)\n", config[0], config[1],
+                      config[2], config[3]);
+        return;
+    }
+    spectrumOnly = (config[4] & SPECTRUM_FLAG_ONLY) != 0;
+    spectrumBlockCycles = 0;
+    spectrumChannelsTimed = 0;
+    Serial.printf("[CMD] Spectrum N=%u hop=%u mask=0x%02X: %u bins, %u B/packet%s\n", static_cast<unsigned>(spectrum.fftSize()),
+                  static_cast<unsigned>(spectrum.hop()), config[1], static_cast<unsigned>(spectrum.bins()),
+                  static_cast<unsigned>(spectrum.packetSize()), spectrumOnly ? ", spectrum only" : "");
+}
+
+static void applyErpConfig()
 {
+    uint8_t config[sizeof(pendingErpConfig)];
     portENTER_CRITICAL(&eventMux);
-    p300Active = true;
-    p300Cursor = std::min<std::size_t>(P300_TRIGGER_OFFSET_SAMPLES, P300_CYCLE_SAMPLES - 1);
-    currentTriggerValue = (triggerValue & 0x0F);
-    triggerSamplesRemaining = TRIGGER_PULSE_WIDTH_SAMPLES;
+    memcpy(config, pendingErpConfig, sizeof(config));
+    g_apply_erp_config = false;
     portEXIT_CRITICAL(&eventMux);
+
+    const uint16_t preMs = config[0] | (config[1] << 8);
+    const uint16_t postMs = config[2] | (config[3] << 8);
+    if (config[4] == 0)
+    {
+        erpAverager.disable();
+        erpOnly = false;
+        Serial.println("[CMD] ERP averaging off");
+        return;
+    }
+    const size_t pre = static_cast<size_t>(preMs) * SAMPLE_RATE_HZ / 1000u;
+    const size_t post = static_cast<size_t>(postMs) * SAMPLE_RATE_HZ / 1000u;
+    if (!erpAverager.configure(pre, post, static_cast<uint32_t>(config[4]) * SAMPLE_RATE_HZ, config[5],
+                               (config[6] & ERP_FLAG_RESET_AFTER_REPORT) != 0))
+    {
+        erpOnly = false;
+        Serial.printf("[CMD] ERP config rejected (pre=%ums post=%ums, max %u samples, mask=0x%02X)\n", preMs, postMs,
+                      static_cast<unsigned>(ERP_MAX_EPOCH_SAMPLES), config[5]);
+        return;
+    }
+    erpOnly = (config[6] & ERP_FLAG_ONLY) != 0;
+    Serial.printf("[CMD] ERP -%ums..+%ums (%u samples) every %us, mask=0x%02X%s%s\n", preMs, postMs,
+                  static_cast<unsigned>(erpAverager.epochSamples()), config[4], config[5],
+                  (config[6] & ERP_FLAG_RESET_AFTER_REPORT) ? ", reset after report" : "", erpOnly ? ", averages only" : "");
+}
+
+// バックログの領域を取り直す。PSRAM があればそちらに確保する
+static void applyStoreForwardConfig()
+{
+    g_apply_store_forward = false;
+    const uint16_t requested = pendingStoreForwardSeconds;
+    const uint16_t seconds = std::min(requested, STORE_FORWARD_MAX_SECONDS);
+    free(backlog.storage());
+    backlog.attach(nullptr, 0);
+    storeForwardSeconds = 0;
+    if (seconds == 0)
+    {
+        Serial.println("[SNF] Store-and-forward off");
+        return;
+    }
+    const bool psram = psramFound();
+    size_t chunks = static_cast<size_t>(seconds) * SAMPLE_RATE_HZ / SAMPLES_PER_CHUNK;
+    if (psram)
+    {
+        chunks = std::min(chunks, static_cast<size_t>(ESP.getFreePsram() / 2 / sizeof(BacklogChunk)));
+    }
+    else
+    {
+        chunks = std::min(chunks, STORE_FORWARD_INTERNAL_MAX_CHUNKS);
+    }
+    void *storage = chunks > 0 ? (psram ? ps_malloc(chunks * sizeof(BacklogChunk)) : malloc(chunks * sizeof(BacklogChunk))) : nullptr;
+    if (storage == nullptr)
+    {
+        Serial.printf("[SNF] Cannot allocate backlog for %u s\n", seconds);
+        return;
+    }
+    backlog.attach(static_cast<BacklogChunk *>(storage), chunks);
+    storeForwardSeconds = seconds;
+    Serial.printf("[SNF] Store-and-forward on: %u chunks (%.1f s, %u KB in %s)\n", static_cast<unsigned>(chunks),
+                  static_cast<float>(chunks) * SAMPLES_PER_CHUNK / SAMPLE_RATE_HZ,
+                  static_cast<unsigned>(chunks * sizeof(BacklogChunk) / 1024), psram ? "PSRAM" : "internal RAM");
+}
+
+// エッジの向きに合わせて内部プルを選ぶ (未接続のピンで誤トリガーしないように)
+static void applyTriggerInputConfig()
+{
+    g_apply_trigger_input = false;
+    const uint8_t edge = pendingTriggerInput[0];
+    const uint8_t value = pendingTriggerInput[1] & 0x0F;
+    if (triggerInputEdge != 0)
+    {
+        detachInterrupt(digitalPinToInterrupt(TRIGGER_INPUT_PIN));
+    }
+    triggerInputEdge = edge == 1 || edge == 2 ? edge : 0;
+    triggerInputValue = value != 0 ? value : 1;
+    portENTER_CRITICAL(&triggerMux);
+    triggerEdges.clear();
+    portEXIT_CRITICAL(&triggerMux);
+    if (triggerInputEdge == 0)
+    {
+        Serial.println("[TRG] Trigger input off");
+        return;
+    }
+    pinMode(TRIGGER_INPUT_PIN, triggerInputEdge == 1 ? INPUT_PULLDOWN : INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(TRIGGER_INPUT_PIN), onTriggerEdge, triggerInputEdge == 1 ? RISING : FALLING);
+    Serial.printf("[TRG] Trigger input on GPIO%u (%s edge) -> value %u\n", TRIGGER_INPUT_PIN, triggerInputEdge == 1 ? "rising" : "falling",
+                  triggerInputValue);
+}
+
+// 全パケットの送信口。CRC が有効ならトレーラを付けて送る
+static void notifyPacket(const void *packet, size_t size)
+{
+    if (packetCrcEnabled && size + PACKET_CRC_BYTES <= sizeof(txPacketBuffer))
+    {
+        memcpy(txPacketBuffer, packet, size);
+        appendPacketCrc(txPacketBuffer, size);
+        pTxCharacteristic->setValue(txPacketBuffer, size + PACKET_CRC_BYTES);
+    }
+    else
+    {
+        pTxCharacteristic->setValue((uint8_t *)packet, size);
+    }
+    pTxCharacteristic->notify();
 }
 
 static bool notificationsEnabled()
@@ -230,22 +721,15 @@ static bool notificationsEnabled()
     return (flags & 0x0001) != 0;
 }
 
-// ADS1299 互換の電極設定
-const ElectrodeConfig defaultElectrodes[CH_MAX] = {
-    {"FP1", 0, 0},
-    {"FP2", 0, 0},
-    {"C3", 0, 0},
-    {"C4", 0, 0},
-    {"P3", 0, 0},
-    {"P4", 0, 0},
-    {"O1", 0, 0},
-    {"O2", 0, 0}};
-
 // ========= BLE コールバック (ADS1299 実装と同一) =========
 class ServerCallbacks : public BLEServerCallbacks
 {
     void onConnect(BLEServer *s) override
     {
+        if (bootFirstConnectMicros == 0)
+        {
+            bootFirstConnectMicros = micros();
+        }
         deviceConnected = true;
         negotiatedMtu = DEFAULT_ATT_MTU;
         mtuReady = false;
@@ -262,12 +746,16 @@ class ServerCallbacks : public BLEServerCallbacks
     }
     void onDisconnect(BLEServer *s) override
     {
+        // store-and-forward が有効ならセッションは止めず、生成を続けて貯める
+        storeForwardHolding = storeForwardSeconds > 0 && (isStreaming || storeForwardHolding);
+        sessionPaused = !storeForwardHolding && (isStreaming || sessionPaused);
         deviceConnected = false;
         isStreaming = false;
         streamStartRequested = false;
         mtuReady = false;
         BLEDevice::startAdvertising();
-        Serial.println(">>> [BLE] Client DISCONNECTED. Streaming stopped. Advertising restarted.");
+        Serial.printf(">>> [BLE] Client DISCONNECTED. %s Advertising restarted.\n",
+                      storeForwardHolding ? "Session held (store-and-forward)." : (sessionPaused ? "Session paused." : "Streaming stopped."));
     }
     void onDisconnect(BLEServer *s, esp_ble_gatts_cb_param_t *param) override
     {
@@ -311,116 +799,492 @@ class RxCallbacks : public BLECharacteristicCallbacks
         {
             handleStartStreamingRequest();
         }
+        else if (cmd == CMD_RESUME_STREAMING)
+        {
+            handleResumeRequest(v);
+        }
         else if (cmd == CMD_STOP_STREAMING)
         {
             handleStopStreaming();
         }
-        else if (cmd == CMD_TRIGGER_PULSE)
+        else if (cmd == CMD_TRIGGER_PULSE || cmd == CMD_SET_STIM_MODE || cmd == CMD_SSVEP_CONFIG || cmd == CMD_SET_FILTER)
+        {
+            enqueueStimulusCommand(v);
+        }
+        else if (cmd == CMD_SET_CLOCK_PROFILE)
+        {
+            handleClockProfileCommand(v);
+        }
+        else if (cmd == CMD_SET_TELEMETRY)
+        {
+            telemetryIntervalChunks = v.size() >= 2 ? static_cast<uint8_t>(v[1]) : 10;
+            Serial.printf("[CMD] Telemetry every %u chunks\n", telemetryIntervalChunks);
+        }
+        else if (cmd == CMD_SET_STREAM_DIGEST)
         {
-            if (v.size() >= 2)
+            digestIntervalChunks = v.size() >= 2 ? static_cast<uint8_t>(v[1]) : 50;
+            Serial.printf("[CMD] Stream digest every %u chunks\n", digestIntervalChunks);
+        }
+        else if (cmd == CMD_SET_PREVIEW)
+        {
+            portENTER_CRITICAL(&eventMux);
+            for (size_t i = 0; i < sizeof(pendingPreviewConfig); ++i)
             {
-                const uint8_t triggerValue = static_cast<uint8_t>(v[1]);
-                startStimulusEvent(triggerValue);
-                Serial.printf("[CMD] Trigger pulse requested. value=%u\n", triggerValue);
+                pendingPreviewConfig[i] = i + 1 < v.size() ? static_cast<uint8_t>(v[i + 1]) : 0;
             }
-            else
+            portEXIT_CRITICAL(&eventMux);
+            g_apply_preview_config = true;
+        }
+        else if (cmd == CMD_SET_BAND_POWER)
+        {
+            portENTER_CRITICAL(&eventMux);
+            pendingBandPowerLength = static_cast<uint8_t>(std::min(v.size() - 1, sizeof(pendingBandPowerConfig)));
+            for (size_t i = 0; i < sizeof(pendingBandPowerConfig); ++i)
             {
-                startStimulusEvent(1);
-                Serial.println("[CMD] Trigger pulse requested without value. Default=1");
+                pendingBandPowerConfig[i] = i + 1 < v.size() ? static_cast<uint8_t>(v[i + 1]) : 0;
             }
+            portEXIT_CRITICAL(&eventMux);
+            g_apply_band_power_config = true;
+        }
+        else if (cmd == CMD_SET_SPECTRUM)
+        {
+            portENTER_CRITICAL(&eventMux);
+            for (size_t i = 0; i < sizeof(pendingSpectrumConfig); ++i)
+            {
+                pendingSpectrumConfig[i] = i + 1 < v.size() ? static_cast<uint8_t>(v[i + 1]) : 0;
+            }
+            portEXIT_CRITICAL(&eventMux);
+            g_apply_spectrum_config = true;
+        }
+        else if (cmd == CMD_SET_ERP)
+        {
+            portENTER_CRITICAL(&eventMux);
+            for (size_t i = 0; i < sizeof(pendingErpConfig); ++i)
+            {
+                pendingErpConfig[i] = i + 1 < v.size() ? static_cast<uint8_t>(v[i + 1]) : 0;
+            }
+            portEXIT_CRITICAL(&eventMux);
+            g_apply_erp_config = true;
+        }
+        else if (cmd == CMD_SET_PACKET_CRC)
+        {
+            packetCrcRequested = v.size() >= 2 && static_cast<uint8_t>(v[1]) == 1;
+            Serial.printf("[CMD] Packet CRC %s (from next stream start)\n", packetCrcRequested ? "CRC-32C" : "off");
+        }
+        else if (cmd == CMD_SET_STORE_FORWARD)
+        {
+            pendingStoreForwardSeconds = v.size() >= 3 ? static_cast<uint16_t>(static_cast<uint8_t>(v[1]) | (static_cast<uint8_t>(v[2]) << 8)) : 60;
+            g_apply_store_forward = true;
+        }
+        else if (cmd == CMD_SET_TRIGGER_INPUT)
+        {
+            pendingTriggerInput[0] = v.size() >= 2 ? static_cast<uint8_t>(v[1]) : 0;
+            pendingTriggerInput[1] = v.size() >= 3 ? static_cast<uint8_t>(v[2]) : 1;
+            g_apply_trigger_input = true;
+        }
+        else if (cmd == CMD_DUMP_COMMAND_LOG)
+        {
+            g_clear_command_log_after_dump = v.size() >= 2 && (static_cast<uint8_t>(v[1]) & 0x01);
+            g_dump_command_log = true;
         }
     }
 };
 
 // ========= タイマー割り込み処理 =========
 void IRAM_ATTR onTimer()
+{
+    const uint32_t previous = timebasePhase;
+    timebasePhase = previous + timebaseIncrement;
+    if (timebasePhase < previous) // 位相が 1 サンプル分を跨いだ
+    {
+        portENTER_CRITICAL_ISR(&timerMux);
+        if (pendingSampleTicks < MAX_PENDING_SAMPLE_TICKS)
+        {
+            pendingSampleTicks++;
+            queuedSampleTicks++;
+        }
+        else
+        {
+            lostSampleTicks++;
+        }
+        portEXIT_CRITICAL_ISR(&timerMux);
+    }
+}
+
+// ========= トリガー入力割り込み =========
+// 積んだ tick 数と位相を読み、前回のタイマー割り込みからの経過 (timerRead) で位相を補間する
+void IRAM_ATTR onTriggerEdge()
 {
     portENTER_CRITICAL_ISR(&timerMux);
-    sampleReady = true;
+    const uint32_t ticks = queuedSampleTicks;
+    const uint32_t phase = timebasePhase;
+    const uint32_t sinceAlarmUs = timer != nullptr ? static_cast<uint32_t>(timerRead(timer)) : 0;
     portEXIT_CRITICAL_ISR(&timerMux);
+    const uint64_t position = phase + static_cast<uint64_t>(timebaseIncrement) * std::min(sinceAlarmUs, TIMER_ALARM_US) / TIMER_ALARM_US;
+    const TriggerEdge edge = stampTriggerEdge(ticks + static_cast<uint32_t>(position >> 32), static_cast<uint32_t>(position), triggerInputValue);
+    portENTER_CRITICAL_ISR(&triggerMux);
+    triggerEdges.push(edge);
+    portEXIT_CRITICAL_ISR(&triggerMux);
 }
 
-// ========= ダミーデータ生成 (ADS1299 互換) =========
-void generateDummyAds1299Sample(SampleData &outSample)
+// ========= コマンドログの送信 =========
+static void sendCommandLog()
 {
-    bool localActive;
-    size_t localCursor;
-    uint8_t localTriggerValue;
-    size_t localTriggerRemaining;
+    static CommandLogPacket logPacket;
+    const uint8_t *data = commandLog.data();
+    const size_t total = commandLog.size();
+    size_t offset = 0;
+    uint8_t sequence = 0;
+    do
+    {
+        const size_t n = std::min(total - offset, sizeof(logPacket.data));
+        logPacket.packet_type = PKT_TYPE_COMMAND_LOG;
+        logPacket.sequence = sequence++;
+        logPacket.flags = 0;
+        if (offset + n >= total)
+        {
+            logPacket.flags |= COMMAND_LOG_FLAG_LAST;
+        }
+        if (commandLog.overflowed())
+        {
+            logPacket.flags |= COMMAND_LOG_FLAG_OVERFLOW;
+        }
+        logPacket.length = static_cast<uint8_t>(n);
+        memcpy(logPacket.data, data + offset, n);
+        notifyPacket(&logPacket, COMMAND_LOG_PACKET_HEADER_BYTES + n);
+        delay(2);
+        offset += n;
+    } while (offset < total);
 
-    portENTER_CRITICAL(&eventMux);
-    localActive = p300Active;
-    localCursor = p300Cursor;
-    localTriggerValue = currentTriggerValue;
-    localTriggerRemaining = triggerSamplesRemaining;
-    portEXIT_CRITICAL(&eventMux);
+    Serial.printf("[CMD] Sent command log (%u bytes%s)\n", static_cast<unsigned>(total), commandLog.overflowed() ? ", overflowed" : "");
+    if (g_clear_command_log_after_dump)
+    {
+        commandLog.clear();
+    }
+}
+
+// ========= テレメトリの送信 =========
+static void sendTelemetry()
+{
+    const uint32_t nowMicros = micros();
+    const uint32_t elapsedMicros = nowMicros - lastTelemetryMicros;
+    const uint32_t samples = totalSamplesGenerated - lastTelemetrySamples;
+    telemetryPacket.packet_type = PKT_TYPE_TELEMETRY;
+    telemetryPacket.version = 2;
+    telemetryPacket.sample_index = static_cast<uint16_t>(streamEngine.sampleIndex());
+    telemetryPacket.uptime_ms = millis();
+    telemetryPacket.clock_offset_ppb = static_cast<int32_t>(lrintf(currentClockPpm * 1000.0f));
+    telemetryPacket.effective_rate_mhz = (lastTelemetryMicros != 0 && elapsedMicros > 0)
+                                             ? static_cast<uint32_t>(static_cast<uint64_t>(samples) * 1000000000ULL / elapsedMicros)
+                                             : 0;
+    telemetryPacket.samples_generated = totalSamplesGenerated;
+    telemetryPacket.degrade_level = deadline.level();
+    telemetryPacket.degrade_changes = static_cast<uint8_t>(deadline.changes());
+    telemetryPacket.min_slack_permille = static_cast<int16_t>(std::max<int32_t>(-32768, deadline.takeMinSlackPermille()));
+    telemetryPacket.lost_ticks = lostSampleTicks;
+    degradeReportPending = false;
+    lastTelemetryMicros = nowMicros;
+    lastTelemetrySamples = totalSamplesGenerated;
 
-    float p300Uv = 0.0f;
-    bool playbackStillActive = localActive;
-    size_t updatedCursor = localCursor;
+    notifyPacket(&telemetryPacket, sizeof(telemetryPacket));
+}
 
-    if (localActive && localCursor < P300_CYCLE_SAMPLES)
+// ========= 起動時間 =========
+static void markBootPhase(const char *name)
+{
+    if (bootPhaseCount < MAX_BOOT_PHASES)
+    {
+        bootPhases[bootPhaseCount].name = name;
+        bootPhases[bootPhaseCount].endMicros = micros();
+        bootPhaseCount++;
+    }
+}
+
+// 起動直後は USB シリアルのホストがまだ開いていないことが多いので、最初のデータパケットを送ったときにも出す
+static void printBootReport(uint32_t firstDataMicros)
+{
+    uint32_t previous = 0;
+    for (size_t i = 0; i < bootPhaseCount; ++i)
     {
-        p300Uv = P300_WAVEFORM_MICROVOLT[localCursor];
-        updatedCursor = localCursor + 1;
-        if (updatedCursor >= P300_CYCLE_SAMPLES)
+        Serial.printf("[BOOT] %-12s %8.1f ms (at %8.1f ms)\n", bootPhases[i].name, (bootPhases[i].endMicros - previous) / 1000.0f,
+                      bootPhases[i].endMicros / 1000.0f);
+        previous = bootPhases[i].endMicros;
+    }
+    if (firstDataMicros != 0)
+    {
+        Serial.printf("[BOOT] first connect at %.1f ms, stream start at %.1f ms, first data packet at %.1f ms (start -> data %.1f ms)\n",
+                      bootFirstConnectMicros / 1000.0f, bootFirstStartMicros / 1000.0f, firstDataMicros / 1000.0f,
+                      (firstDataMicros - bootFirstStartMicros) / 1000.0f);
+    }
+}
+
+// ========= デッドライン監視 =========
+// 生成に効く分 (ノイズ / フィルタ / SSVEP) は CMD_SET_QUALITY としてエンジンに通し、次のサンプルの位置でログに残す
+static void applyDegradeLevel(uint8_t level)
+{
+    const uint8_t command[2] = {CMD_SET_QUALITY, level};
+    streamEngine.applyCommand(command, sizeof(command));
+    const bool suspend = level >= DEGRADE_NO_ANALYSIS;
+    if (analysisSuspended && !suspend)
+    {
+        // 止めていた間のブロックは途中から使えないので最初からやり直す
+        spectrum.reset();
+        bandPower.reset();
+    }
+    analysisSuspended = suspend;
+}
+
+// チャンクが埋まるたびに呼ぶ
+static void endDeadlineBlock()
+{
+    const uint32_t lost = lostSampleTicks;
+    const uint32_t lostInBlock = lost - lostTicksAtBlockStart;
+    if (deadline.endBlock(blockBusyCycles, blockMaxLag, lostInBlock))
+    {
+        applyDegradeLevel(deadline.level());
+        degradeReportPending = true;
+        Serial.printf("[DL] Quality level %u (%s): slack %d permille, lag %u ticks, lost %u ticks\n", deadline.level(),
+                      degradeLevelName(deadline.level()), static_cast<int>(deadline.slackPermille()), blockMaxLag, lostInBlock);
+    }
+    lostTicksAtBlockStart = lost;
+    blockBusyCycles = 0;
+    blockMaxLag = 0;
+}
+
+// 生成しない間の tick を捨てる。捨てた分も tick 番号は進め、トリガー入力のエッジも捨てる
+static void discardPendingSampleTicks()
+{
+    portENTER_CRITICAL(&timerMux);
+    consumedSampleTicks += pendingSampleTicks;
+    pendingSampleTicks = 0;
+    portEXIT_CRITICAL(&timerMux);
+    portENTER_CRITICAL(&triggerMux);
+    triggerEdges.clear();
+    portEXIT_CRITICAL(&triggerMux);
+}
+
+// サンプリング用タイマー。待機中に 4kHz の割り込みを回しても捨てるだけなので、最初のストリーム開始まで起動しない
+static void startSamplingTimer()
+{
+    // 1 チャンク分の時間をサイクル数にしたものが 1 ブロックの予算
+    deadline.configure(ESP.getCpuFreqMHz() * 1000000u / SAMPLE_RATE_HZ * SAMPLES_PER_CHUNK);
+    const int timer_id = 0;
+    const uint32_t prescaler = 80; // 80MHz / 80 = 1MHz
+    const uint64_t alarm_value = TIMER_ALARM_US;
+    timer = timerBegin(timer_id, prescaler, true);
+    timerAttachInterrupt(timer, &onTimer, true);
+    timerAlarmWrite(timer, alarm_value, true);
+    timerAlarmEnable(timer);
+    Serial.printf("Sampling timer started for %d Hz (timebase %u Hz)\n", SAMPLE_RATE_HZ, SAMPLE_RATE_HZ * TIMEBASE_OVERSAMPLE);
+}
+
+// 外部トリガーのうち、tick 番号 tick のサンプルに載せるものをエンジンに通す
+static void injectDueTriggerEdges(uint32_t tick)
+{
+    TriggerEdge edge;
+    for (;;)
+    {
+        portENTER_CRITICAL(&triggerMux);
+        const bool due = triggerEdges.popDue(tick, edge);
+        portEXIT_CRITICAL(&triggerMux);
+        if (!due)
         {
-            playbackStillActive = false;
-            updatedCursor = 0;
+            return;
         }
+        uint8_t bytes[3];
+        streamEngine.applyCommand(bytes, triggerEdgeCommand(edge, bytes));
+        Serial.printf("[TRG] Edge value=%u -> sample %u (+%u/256 after the previous sample, %d ticks late)\n", edge.value,
+                      streamEngine.sampleIndex(), edge.phase, static_cast<int>(tick - edge.tick));
     }
-    else
+}
+
+// generateSample の中から送る。notify は BLE スタックの待ちを含むので、かかった時間を予算から除く
+static void notifyUntimed(const void *packet, size_t size)
+{
+    const uint32_t start = ESP.getCycleCount();
+    notifyPacket(packet, size);
+    sampleNotifyCycles += ESP.getCycleCount() - start;
+}
+
+// 1 サンプル生成して特徴量を進める。チャンクが埋まったら true (streamEngine.packet() が有効)
+// lag はこのサンプルの tick を取り出したときの未処理 tick 数。0 はタイマーによらない生成 (prefill)
+static bool generateSample(uint32_t lag)
+{
+    const uint32_t workStart = ESP.getCycleCount();
+    sampleNotifyCycles = 0;
+    blockMaxLag = std::max(blockMaxLag, lag);
+    totalSamplesGenerated++;
+    // 揺らぎは 1 秒ごとに進める。途中でプロファイルを変えたときは時間を進めずに反映だけする
+    const bool secondElapsed = totalSamplesGenerated % SAMPLE_RATE_HZ == 0;
+    if (g_apply_clock_profile || secondElapsed)
     {
-        playbackStillActive = false;
-        updatedCursor = 0;
+        updateClockDrift(secondElapsed ? 1.0f : 0.0f);
     }
 
-    const float timeSec = static_cast<float>(sampleIndexCounter) / static_cast<float>(SAMPLE_RATE_HZ);
-    const float eventScale = localActive ? eventAmplitudeScale(localTriggerValue) : 0.0f;
+    // ダミーデータを生成してチャンクに格納
+    applyPendingStimulusCommands();
+    if (lag > 0)
+    {
+        injectDueTriggerEdges(consumedSampleTicks++);
+    }
+    if (g_apply_preview_config)
+    {
+        applyPreviewConfig();
+    }
+    if (g_apply_band_power_config)
+    {
+        applyBandPowerConfig();
+    }
+    if (g_apply_spectrum_config)
+    {
+        applySpectrumConfig();
+    }
+    if (g_apply_erp_config)
+    {
+        applyErpConfig();
+    }
+    const bool chunkReady = streamEngine.step();
 
-    for (int ch = 0; ch < CH_MAX; ++ch)
+    // --- [2b] プレビュー (間引き) はサンプルごとに進め、パケットが埋まったら送る ---
+    int16_t signals[CH_MAX];
+    memcpy(signals, streamEngine.lastSample().signals, sizeof(signals));
+    if (previewDecimator.enabled())
     {
-        const float gain = CHANNEL_GAIN[ch];
-        const float phase = CHANNEL_PHASE[ch];
+        int16_t frame[CH_MAX];
+        if (previewDecimator.push(signals, frame) && previewPacketizer.push(frame) && notificationsEnabled())
+        {
+            notifyUntimed(&previewPacketizer.packet(), previewPacketizer.packetSize());
+        }
+    }
+    // --- [2c] 帯域パワーもサンプルごとに進め、ブロックの終わりで送る ---
+    if (!analysisSuspended && bandPower.push(signals) && notificationsEnabled())
+    {
+        notifyUntimed(&bandPower.packet(), bandPower.packetSize());
+    }
 
-        const float alpha = ALPHA_AMPLITUDE_UV * sinf(2.0f * PI * ALPHA_FREQ_HZ * timeSec + phase);
-        const float beta = BETA_AMPLITUDE_UV * sinf(2.0f * PI * BETA_FREQ_HZ * timeSec + phase * 0.7f);
-        float channelUv = (alpha + beta) * gain;
-        channelUv += sampleNoiseUv(BACKGROUND_NOISE_UV) * gain;
-        if (eventScale > 0.0f)
+    // --- [2d] スペクトルは 1 サンプルにつき 1 チャンネルずつ計算して送る ---
+    if (spectrum.enabled() && !analysisSuspended)
+    {
+        const uint32_t start = ESP.getCycleCount();
+        const bool computed = spectrum.push(signals);
+        if (computed && spectrumChannelsTimed < spectrum.channels())
         {
-            channelUv += p300Uv * eventScale * gain;
+            // 最初のブロックだけ測り、hop 周期に対する割合を出す
+            spectrumBlockCycles += ESP.getCycleCount() - start;
+            if (++spectrumChannelsTimed == spectrum.channels())
+            {
+                const double hopCycles = static_cast<double>(ESP.getCpuFreqMHz()) * 1e6 * spectrum.hop() / SAMPLE_RATE_HZ;
+                Serial.printf("[FFT] N=%u: %u cycles/channel, %u cycles/block (%.3f%% of the %u-sample hop)\n",
+                              static_cast<unsigned>(spectrum.fftSize()),
+                              static_cast<unsigned>(spectrumBlockCycles / spectrum.channels()), spectrumBlockCycles,
+                              100.0 * spectrumBlockCycles / hopCycles, static_cast<unsigned>(spectrum.hop()));
+            }
+        }
+        if (computed && notificationsEnabled())
+        {
+            notifyUntimed(&spectrum.packet(), spectrum.packetSize());
         }
-        outSample.signals[ch] = microvoltToCounts(channelUv);
     }
 
-    uint8_t triggerState = 0;
-    if (localTriggerRemaining > 0)
+    // --- [2e] ERP はトリガーの立ち上がりでエポックを切り、報告は 1 サンプルに 1 パケットずつ ---
+    if (erpAverager.push(signals, streamEngine.lastSample().trigger_state) && notificationsEnabled())
     {
-        triggerState = static_cast<uint8_t>(localTriggerValue & 0x0F);
-        localTriggerRemaining--;
+        notifyUntimed(&erpAverager.packet(), erpAverager.packetSize());
     }
-    outSample.trigger_state = triggerState;
 
-    outSample.reserved[0] = triggerState;
-    outSample.reserved[1] = triggerState ? 0xA5 : 0x00;
-    outSample.reserved[2] = 0x00;
+    // 送信 (notify と待ち) は予算に含めない。チャンク本体は sendReadyChunk で送るので元から外れている
+    blockBusyCycles += ESP.getCycleCount() - workStart - sampleNotifyCycles;
+    if (chunkReady)
+    {
+        endDeadlineBlock();
+    }
+    return chunkReady;
+}
 
-    portENTER_CRITICAL(&eventMux);
-    p300Active = playbackStillActive;
-    p300Cursor = updatedCursor;
-    currentTriggerValue = playbackStillActive ? localTriggerValue : 0;
-    triggerSamplesRemaining = localTriggerRemaining;
-    portEXIT_CRITICAL(&eventMux);
+// ダイジェストのチェックポイント (digestIntervalChunks チャンクごと)。digest はそのチャンクまで畳み込んだ値
+static void sendDigestCheckpoint(const StreamDigest &digest, uint16_t startIndex)
+{
+    if (digestIntervalChunks > 0 && digest.chunks() % digestIntervalChunks == 0)
+    {
+        digest.fill(digestPacket, startIndex);
+        notifyPacket(&digestPacket, sizeof(digestPacket));
+    }
+}
+
+// 品質の段階が変わったときは間隔を待たずに送る
+static void sendTelemetryIfDue()
+{
+    if (telemetryIntervalChunks > 0 && (++chunksSinceTelemetry >= telemetryIntervalChunks || degradeReportPending))
+    {
+        chunksSinceTelemetry = 0;
+        sendTelemetry();
+    }
+}
+
+// 埋まったチャンクを送る (プレビュー / 特徴量 / スペクトル / ERP のみのモードでは送らない)
+static void sendReadyChunk(bool streamingNow)
+{
+    const bool rawSuppressed = previewOnly || bandPowerOnly || spectrumOnly || erpOnly;
+    // store-and-forward が有効なら、送れないチャンク (切断中 / 再開直後で設定パケットや CCCD 待ち) は貯めておく。
+    // 追送が終わるまではライブも後ろに並べ、start_index の順に送る
+    const bool canSendLive = streamingNow && !g_send_config_packet && notificationsEnabled();
+    if ((!canSendLive || !backlog.empty()) && backlog.capacity() > 0)
+    {
+        if (!rawSuppressed)
+        {
+            backlog.push(streamEngine.packet(), streamEngine.digest());
+        }
+        if (canSendLive)
+        {
+            sendTelemetryIfDue();
+        }
+    }
+    else if (notificationsEnabled())
+    {
+        if (!rawSuppressed)
+        {
+            notifyPacket(&streamEngine.packet(), sizeof(ChunkedSamplePacket));
+            if (!bootReportSent)
+            {
+                bootReportSent = true;
+                printBootReport(micros());
+            }
+            delay(2);
+            sendDigestCheckpoint(streamEngine.digest(), streamEngine.packet().start_index);
+        }
+        sendTelemetryIfDue();
+    }
+    else
+    {
+        Serial.println("[BLE] Notifications disabled. Skipping notify.");
+    }
+}
+
+// 最初のチャンクの残りをタイマーを待たずに生成する。送るのは設定パケットの後
+static void prefillFirstChunk()
+{
+    prefillRequested = false;
+    if (timer == nullptr)
+    {
+        startSamplingTimer();
+    }
+    const uint32_t start = micros();
+    prefillSamples = 1;
+    while (!generateSample(0))
+    {
+        prefillSamples++;
+    }
+    prefillMicros = micros() - start;
+    prefillReady = true;
 }
 
 // ========= Setup =========
+// 固定の待ち時間は置かず、広告開始までを最短にする (テスト治具は電源を頻繁に入れ直すため)
 void setup()
 {
     Serial.begin(115200);
-    delay(1000);
     Serial.println("\n--- ADS1299-Compatible Dummy Data Streamer ---");
-    srand(1); // 再現性のあるノイズ生成
+    markBootPhase("serial");
 
     // BLEデバイス初期化
     BLEDevice::init(DEVICE_NAME);
@@ -429,6 +1293,7 @@ void setup()
     {
         Serial.printf("[BLE] Failed to request MTU 517 (err=0x%02X)\n", static_cast<uint32_t>(mtuResult));
     }
+    markBootPhase("ble_init");
     pServer = BLEDevice::createServer();
     pServer->setCallbacks(new ServerCallbacks());
     BLEService *pService = pServer->createService(SERVICE_UUID);
@@ -445,21 +1310,14 @@ void setup()
     pRxCharacteristic->setCallbacks(new RxCallbacks());
 
     pService->start();
+    markBootPhase("gatt");
     BLEAdvertising *adv = BLEDevice::getAdvertising();
     adv->addServiceUUID(SERVICE_UUID);
     adv->setScanResponse(true);
     BLEDevice::startAdvertising();
+    markBootPhase("advertising");
     Serial.println("BLE advertising started (ADS1299-NUS compatible)");
-
-    // サンプリング用タイマー設定
-    const int timer_id = 0;
-    const uint32_t prescaler = 80; // 80MHz / 80 = 1MHz
-    const uint64_t alarm_value = 1000000 / SAMPLE_RATE_HZ;
-    timer = timerBegin(timer_id, prescaler, true);
-    timerAttachInterrupt(timer, &onTimer, true);
-    timerAlarmWrite(timer, alarm_value, true);
-    timerAlarmEnable(timer);
-    Serial.printf("Sampling timer started for %d Hz\n", SAMPLE_RATE_HZ);
+    printBootReport(0);
 }
 
 // ========= Loop =========
@@ -474,63 +1332,133 @@ void loop()
         }
         else if (!notificationsEnabled())
         {
-            // Wait until CCCD enables notifications
+            // CCCD 待ちの間に最初のチャンクを作っておく (通知は無効なので特徴量パケットも出ない)
+            if (prefillRequested)
+            {
+                prefillFirstChunk();
+            }
         }
         else
         {
             g_send_config_packet = false;
-            deviceConfigPacket.packet_type = PKT_TYPE_DEVICE_CFG;
-            deviceConfigPacket.num_channels = CH_MAX; // 8ch のダミーデバイスとして通知
-            memset(deviceConfigPacket.reserved, 0, sizeof(deviceConfigPacket.reserved));
-            memcpy(deviceConfigPacket.configs, defaultElectrodes, sizeof(defaultElectrodes));
+            // START 直後ならここでセッションを始め、設定パケットにトークンを載せる (コマンドの適用位置は変わらない)
+            applyPendingStimulusCommands();
+            // トレーラ付きのチャンクが MTU に収まる場合だけ CRC を有効にする
+            packetCrcEnabled = packetCrcRequested && negotiatedMtu >= REQUIRED_MTU_BYTES + PACKET_CRC_BYTES;
+            streamEngine.fillConfigPacket(deviceConfigPacket, packetCrcEnabled);
 
-            pTxCharacteristic->setValue((uint8_t *)&deviceConfigPacket, sizeof(deviceConfigPacket));
-            pTxCharacteristic->notify();
-            Serial.println("[CMD] Start streaming -> Sent DeviceConfigPacket");
-            delay(10); // 送信処理のための短い待機
+            notifyPacket(&deviceConfigPacket, sizeof(deviceConfigPacket));
+            Serial.printf("[CMD] Start streaming -> Sent DeviceConfigPacket (crc=%s)\n", packetCrcEnabled ? "on" : "off");
+            // 設定パケットに続けて最初のチャンクを送る (待ちは入れない)
+            if (prefillRequested)
+            {
+                prefillFirstChunk();
+            }
+            if (prefillReady)
+            {
+                prefillReady = false;
+                sendReadyChunk(true);
+                Serial.printf("[CMD] Start -> first data packet %.2f ms (prefilled %u samples in %.2f ms)\n",
+                              (micros() - streamStartMicros) / 1000.0f, static_cast<unsigned>(prefillSamples), prefillMicros / 1000.0f);
+                // 先行したチャンクの分だけ時間軸を過去へずらし、以降はここからタイマーで刻む
+                discardPendingSampleTicks();
+            }
         }
     }
 
-    // --- [2] ストリーミング中のデータ生成とバッファリング ---
-    if (isStreaming && deviceConnected && mtuReady)
+    // --- [1b] 停止 (STOP / 切断) はここで検出し、実際に生成を止めた位置をログに残す ---
+    // store-and-forward で保持中のセッションは、切断中も生成を続ける
+    const bool streamingNow = isStreaming && deviceConnected && mtuReady;
+    // 一時停止中 (切断、store-and-forward なし) のセッションは再開に備えて残す
+    const bool generatingNow = streamingNow || storeForwardHolding;
+    if (streamEngine.sessionActive() && !generatingNow && !isStreaming && !sessionPaused)
     {
-        if (sampleReady)
-        {
-            portENTER_CRITICAL(&timerMux);
-            sampleReady = false;
-            portEXIT_CRITICAL(&timerMux);
+        streamEngine.stopSession();
+        backlog.clear();
+        sessionToken = 0;
+        prefillReady = false;
+    }
 
-            // ダミーデータを生成してバッファに格納
-            generateDummyAds1299Sample(sampleBuffer[sampleBufferIndex]);
-            sampleBufferIndex++;
-            sampleIndexCounter++;
+    // 再開: ホストが受け取り済みのチャンクはバックログから捨てる
+    if (g_trim_backlog)
+    {
+        g_trim_backlog = false;
+        const uint16_t last = resumeLastIndex;
+        size_t skipped = 0;
+        while (!backlog.empty() && static_cast<int16_t>(backlog.front().packet.start_index - last) <= 0)
+        {
+            backlog.pop();
+            skipped++;
         }
+        Serial.printf("[CMD] Resume: skipped %u chunks already received, %u to send, next sample %u\n", static_cast<unsigned>(skipped),
+                      static_cast<unsigned>(backlog.size()), static_cast<unsigned>(streamEngine.sampleIndex()));
+    }
 
-        // --- [3] バッファが満たされたらBLEで送信 ---
-        if (sampleBufferIndex >= SAMPLES_PER_CHUNK)
-        {
-            chunkPacket.packet_type = PKT_TYPE_DATA_CHUNK;
-            chunkPacket.start_index = (uint16_t)(sampleIndexCounter - SAMPLES_PER_CHUNK);
-            chunkPacket.num_samples = SAMPLES_PER_CHUNK;
-            memcpy(chunkPacket.samples, sampleBuffer, sizeof(sampleBuffer));
+    // バックログの設定変更は保持中のセッションがないときだけ反映する (貯めたチャンクを捨てないため)
+    if (g_apply_store_forward && !storeForwardHolding && backlog.empty())
+    {
+        applyStoreForwardConfig();
+    }
+    if (g_apply_trigger_input)
+    {
+        applyTriggerInputConfig();
+    }
 
-            if (notificationsEnabled())
-            {
-                pTxCharacteristic->setValue((uint8_t *)&chunkPacket, sizeof(chunkPacket));
-                pTxCharacteristic->notify();
-                delay(2);
-            }
-            else
-            {
-                Serial.println("[BLE] Notifications disabled. Skipping notify.");
-            }
+    // --- [1c] 貯めたチャンクの追送: 1 パスにつき 1 チャンクずつ、リンクが許す速さで送る ---
+    if (streamingNow && !g_send_config_packet && !backlog.empty() && notificationsEnabled())
+    {
+        const BacklogChunk &entry = backlog.front();
+        notifyPacket(&entry.packet, sizeof(ChunkedSamplePacket));
+        sendDigestCheckpoint(entry.digest, entry.packet.start_index);
+        backlog.pop();
+        backlogDrainLogged = false;
+        delay(2);
+    }
+    else if (!backlogDrainLogged && backlog.empty())
+    {
+        backlogDrainLogged = true;
+        Serial.printf("[SNF] Backlog drained (%u chunks dropped while disconnected)\n", static_cast<unsigned>(backlog.dropped()));
+    }
+
+    if (g_dump_command_log && deviceConnected && mtuReady && notificationsEnabled())
+    {
+        g_dump_command_log = false;
+        sendCommandLog();
+    }
+
+    // --- [2] ストリーミング中のデータ生成とバッファリング ---
+    if (prefillReady)
+    {
+        // 先行チャンクを持ったまま CCCD を待つ。時間軸は送った時点から始めるので tick は捨てる
+        discardPendingSampleTicks();
+        delay(1);
+    }
+    else if (generatingNow)
+    {
+        if (timer == nullptr)
+        {
+            startSamplingTimer();
+        }
+        bool sampleDue = false;
+        uint32_t lag = 0;
+        portENTER_CRITICAL(&timerMux);
+        if (pendingSampleTicks > 0)
+        {
+            lag = pendingSampleTicks;
+            pendingSampleTicks--;
+            sampleDue = true;
+        }
+        portEXIT_CRITICAL(&timerMux);
 
-            sampleBufferIndex = 0; // バッファインデックスをリセット
+        if (sampleDue && generateSample(lag))
+        {
+            sendReadyChunk(streamingNow);
         }
     }
     else
     {
         // ストリーミング中でない場合はCPUを少し休ませる
+        discardPendingSampleTicks();
         delay(10);
     }
 }